@@ -19,8 +19,15 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstring>
+#include <functional>
+#include <list>
+#include <memory>
 #include <stdint.h>
+#include <thread>
+#include <vector>
 
 #include "SimpleSerial.h"
 
@@ -28,15 +35,12 @@
 
 namespace Thunder {
 namespace SimpleSerial {
-    static Protocol::SequenceType GetSequence()
-    {
-        static Protocol::SequenceType g_sequence = 0;
-        TRACE_GLOBAL(Doofah::DataExchangeFlow, (_T("Provided sequence id: 0x%02X(%d)"), g_sequence, g_sequence));
-        return g_sequence++;
-    }
-
     static void PrintMessage(const Protocol::Message& message)
     {
+        if (TRACE_ENABLED(Doofah::DataExchangeFlow) == false) {
+            return;
+        }
+
         string data;
         Core::ToHexString(message.Data(), message.Size(), data);
 
@@ -57,14 +61,583 @@ namespace SimpleSerial {
             Core::ToHexString(message.Payload(), message.PayloadLength(), data);
         
             TRACE_GLOBAL(Doofah::DataExchangeFlow, ("  - Raw payload: %s", data.c_str()));
-            TRACE_GLOBAL(Doofah::DataExchangeFlow, ("  - Checksum: 0x%02X", Protocol::CRC8(message.Size() - 1, message.Data())));
+            TRACE_GLOBAL(Doofah::DataExchangeFlow, ("  - Checksum: 0x%08X", Protocol::Checksum::Calculate(message.Checksum(), message.Size() - Protocol::Checksum::Size(message.Checksum()), message.Data())));
         }
 
         TRACE_GLOBAL(Doofah::DataExchangeFlow, ("===== [Message Stop] =========================================================="));
     }
 
+    // The last frames that went over the link, kept as they were. Recording is a copy into the
+    // ring, without a lock or an allocation. Only with a DataExchangeFlow consumer attached are
+    // they rendered, the ones recorded before it was attached included.
+    class FrameLog {
+    public:
+        static constexpr uint16_t Capacity = 64;
+
+        static_assert((Capacity & (Capacity - 1)) == 0, "The log capacity must be a power of two");
+
+        enum Direction : uint8_t {
+            OUTBOUND,
+            INBOUND
+        };
+
+        FrameLog(const FrameLog&) = delete;
+        FrameLog& operator=(const FrameLog&) = delete;
+
+        FrameLog()
+            : _records()
+            , _head(0)
+            , _rendered(0)
+        {
+            for (uint16_t index = 0; index < Capacity; index++) {
+                _records[index].sequence.store(0, std::memory_order_relaxed);
+            }
+        }
+        ~FrameLog() = default;
+
+    public:
+        void Record(const Direction direction, const Protocol::Message& message)
+        {
+            const uint32_t ticket(_head.fetch_add(1, std::memory_order_relaxed));
+            Entry& entry(_records[ticket & (Capacity - 1)]);
+
+            // Odd while it is written, readers skip a record that changed under them.
+            entry.sequence.store((ticket << 1) | 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            entry.time = Core::Time::Now().Ticks();
+            entry.direction = direction;
+            entry.frame = message;
+
+            entry.sequence.store((ticket + 1) << 1, std::memory_order_release);
+
+            if (TRACE_ENABLED(Doofah::DataExchangeFlow) == true) {
+                Render();
+            }
+        }
+
+    private:
+        void Render()
+        {
+            const uint32_t head(_head.load(std::memory_order_acquire));
+            uint32_t ticket(_rendered.exchange(head, std::memory_order_relaxed));
+
+            if ((head - ticket) > Capacity) {
+                ticket = head - Capacity;
+            }
+
+            for (; ticket != head; ticket++) {
+                Entry& entry(_records[ticket & (Capacity - 1)]);
+                const uint32_t sequence(entry.sequence.load(std::memory_order_acquire));
+
+                if (sequence == ((ticket + 1) << 1)) {
+                    const uint64_t time VARIABLE_IS_NOT_USED(entry.time);
+                    const Direction direction VARIABLE_IS_NOT_USED(entry.direction);
+                    Protocol::Message frame;
+
+                    frame = entry.frame;
+
+                    std::atomic_thread_fence(std::memory_order_acquire);
+
+                    if (entry.sequence.load(std::memory_order_relaxed) == sequence) {
+                        TRACE_GLOBAL(Doofah::DataExchangeFlow, ("%s frame at %llu us", (direction == OUTBOUND) ? "Outbound" : "Inbound", static_cast<unsigned long long>(time)));
+                        PrintMessage(frame);
+                    }
+                }
+            }
+        }
+
+    private:
+        struct Entry {
+            std::atomic<uint32_t> sequence;
+            uint64_t time;
+            Direction direction;
+            Protocol::Message frame;
+        };
+
+        Entry _records[Capacity];
+        std::atomic<uint32_t> _head;
+        std::atomic<uint32_t> _rendered;
+    };
+
+    // Every span of bytes that went over the link, appended to a memory mapped file of a fixed
+    // size. The file starts with a Header, each span is a Record followed by its bytes, a zeroed
+    // Record ends it. Room is reserved with an atomic offset, so the sending and the receiving
+    // side never wait for each other, spans that do not fit anymore are dropped.
+    class CaptureFile {
+    public:
+        static constexpr uint32_t Magic = 0x50434644; // "DFCP"
+        static constexpr uint16_t Version = 3;
+
+        enum Direction : uint8_t {
+            TRANSMIT = 1,
+            RECEIVE = 2
+        };
+
+#pragma pack(push, 1)
+        struct Header {
+            uint32_t magic;
+            uint16_t version;
+            uint16_t reserved;
+        };
+        struct Record {
+            uint64_t time; // Nanoseconds since the capture started, on a monotonic clock
+            uint16_t length;
+            Direction direction;
+            Protocol::FramingType framing; // Of the link when the span went over it
+            Protocol::ChecksumType checksum; // Idem
+        };
+#pragma pack(pop)
+
+        CaptureFile() = delete;
+        CaptureFile(const CaptureFile&) = delete;
+        CaptureFile& operator=(const CaptureFile&) = delete;
+
+        CaptureFile(const string& fileName, const uint32_t size)
+            : _file(fileName, Core::DataElementFile::READABLE | Core::DataElementFile::WRITABLE | Core::DataElementFile::CREATE | Core::DataElementFile::SHAREABLE, size)
+            , _origin(Now())
+            , _offset(sizeof(Header))
+            , _dropped(0)
+        {
+            if (IsValid() == true) {
+                const Header header = { Magic, Version, 0 };
+
+                ::memset(_file.Buffer(), 0, static_cast<size_t>(_file.Size()));
+                ::memcpy(_file.Buffer(), &header, sizeof(header));
+            }
+        }
+        ~CaptureFile()
+        {
+            if (IsValid() == true) {
+                _file.Sync();
+            }
+
+            if (_dropped > 0) {
+                TRACE_GLOBAL(Trace::Warning, ("Capture full, %d spans dropped", _dropped.load()));
+            }
+        }
+
+    public:
+        inline bool IsValid() const
+        {
+            return ((_file.IsValid() == true) && (_file.Size() > sizeof(Header)));
+        }
+        void Append(const Direction direction, const Protocol::FramingType framing, const Protocol::ChecksumType checksum, const uint16_t length, const uint8_t data[])
+        {
+            const uint64_t size(sizeof(Record) + length);
+            const uint64_t offset(_offset.fetch_add(size, std::memory_order_relaxed));
+
+            // Always leave room for the zeroed Record at the end.
+            if ((offset + size + sizeof(Record)) <= _file.Size()) {
+                Record record;
+
+                record.time = Now() - _origin;
+                record.length = length;
+                record.direction = direction;
+                record.framing = framing;
+                record.checksum = checksum;
+
+                ::memcpy(&(_file.Buffer()[offset]), &record, sizeof(record));
+                ::memcpy(&(_file.Buffer()[offset + sizeof(record)]), data, length);
+            } else {
+                _dropped++;
+            }
+        }
+        static uint64_t Now()
+        {
+            return (static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()));
+        }
+
+    private:
+        Core::DataElementFile _file;
+        const uint64_t _origin;
+        std::atomic<uint64_t> _offset;
+        std::atomic<uint32_t> _dropped;
+    };
+
     template <typename LINK>
     class DataExchange {
+    public:
+        // Number of requests that may be outstanding on the link at the same time.
+        static constexpr uint8_t DefaultWindow = 4;
+        // Keep at least half of the sequence space free so a late response can never
+        // be mistaken for the response of a new request.
+        static constexpr uint8_t MaxWindow = 128;
+
+        // A received frame, owned by the caller until the proxy is released back to the pool.
+        typedef Core::ProxyType<Protocol::Message> Response;
+
+        // Where the time of one exchange went, in microseconds. The endpoint and device stages
+        // are only known when the response carried a Payload::Timing trailer.
+        struct Stages {
+            uint32_t queued; // Post() until the last byte was handed to the link
+            uint32_t line; // On the line both ways, everything the endpoint did not account for
+            uint32_t endpoint; // Request complete on the endpoint until handed to the device
+            uint32_t device; // Handed to the device until the device returned
+            uint32_t total; // Post() until the response came in
+            bool timed;
+        };
+
+        // Called once for every asynchronous request, from the link or the expiry job. The response
+        // is only valid when the result is ERROR_NONE. Must not block, the link waits for it.
+        typedef std::function<void(const uint32_t result, const Response& response)> Completion;
+
+        // Keys go ahead of configuration and discovery, in the window as well as on the line.
+        enum Lane : uint8_t {
+            INTERACTIVE = 0,
+            BACKGROUND = 1
+        };
+        static constexpr uint8_t Lanes = 2;
+        // Times in a row a waiting background request may be passed by an interactive one.
+        static constexpr uint8_t MaxPasses = 8;
+
+        struct LaneStatistics {
+            uint32_t depth; // Requests waiting for room in the window or for the line right now
+            uint32_t peak; // Highest depth so far
+            uint32_t frames; // Requests put on the line
+            uint32_t passed; // Times a waiting request of this lane was passed by one of another
+        };
+
+        // Outcome of a Replay().
+        struct ReplayReport {
+            uint32_t received; // Spans fed through ReceiveData()
+            uint32_t posted; // Captured requests sent again
+            uint32_t retransmitted; // Captured retransmissions, left to the request they repeat
+            uint32_t answered; // Posted requests a captured response completed
+            uint32_t unanswered; // Posted requests that got no response in time, unacknowledged ones not counted
+            uint32_t diverged; // Frames sent other than captured, or captured and not sent
+            uint32_t duration; // In milliseconds
+        };
+        // Time a replayed request of the operation gets for its response, in milliseconds.
+        typedef std::function<uint32_t(const Protocol::OperationType operation)> AllowedTime;
+
+        // Health of the link since it was created.
+        struct Statistics {
+            uint32_t exchanges; // Requests that waited for an answer
+            uint32_t timeouts; // Of which no answer came in time
+            uint32_t corrupted; // Of which the answer, or the request on the way in, was garbled
+            uint32_t resyncs; // Received frames dropped for a bad checksum, the parser looks for the next start after each
+            uint32_t retransmits; // Requests sent again, after a garbled answer or none in time
+            uint32_t recovered; // Exchanges that only completed thanks to a retransmission
+            LaneStatistics lanes[Lanes];
+        };
+
+    private:
+        class Slot {
+        public:
+            Slot(const Slot&) = delete;
+            Slot& operator=(const Slot&) = delete;
+
+            Slot()
+                : _request(nullptr)
+                , _signal(false, true)
+                , _result(Core::ERROR_NONE)
+                , _response()
+                , _posted(0)
+                , _sent(0)
+                , _completed(0)
+                , _timed(false)
+                , _timing()
+                , _frame()
+                , _completion()
+                , _deadline(0)
+                , _retries(0)
+                , _interval(0)
+                , _retransmission(0)
+                , _retransmits(0)
+                , _stalled(false)
+            {
+            }
+            // An asynchronous request, sent from its own copy of the request.
+            Slot(Response& frame, Completion&& completion, const uint64_t deadline)
+                : Slot()
+            {
+                _frame = frame;
+                _completion = std::move(completion);
+                _deadline = deadline;
+            }
+            ~Slot() = default;
+
+        public:
+            inline void Assign(Protocol::Message& request)
+            {
+                _request = &request;
+                _result = Core::ERROR_NONE;
+                _response.Release();
+                _posted = Core::Time::Now().Ticks();
+                _sent = 0;
+                _completed = 0;
+                _timed = false;
+                _retransmission = 0;
+                _retransmits = 0;
+                _stalled = false;
+            }
+            inline Protocol::Message& Request()
+            {
+                ASSERT(_request != nullptr);
+                return (*_request);
+            }
+            inline const Protocol::Message& Request() const
+            {
+                ASSERT(_request != nullptr);
+                return (*_request);
+            }
+            inline bool IsMatch(const Protocol::Message& message) const
+            {
+                return ((_request->Operation() == message.Operation()) && (_request->Sequence() == message.Sequence()));
+            }
+            inline uint32_t Result() const
+            {
+                return (_result);
+            }
+            inline void Complete(const uint32_t result)
+            {
+                _result = result;
+                _signal.SetEvent();
+            }
+            inline void Complete(const Response& response)
+            {
+                _completed = Core::Time::Now().Ticks();
+                _response = response;
+                Complete(Core::ERROR_NONE);
+            }
+            inline void Sent()
+            {
+                _sent = Core::Time::Now().Ticks();
+            }
+            inline void Timing(const Payload::Timing& timing)
+            {
+                _timing = timing;
+                _timed = true;
+            }
+            void Measure(Stages& stages) const
+            {
+                const uint64_t sent = (_sent != 0) ? _sent : _posted;
+
+                stages.queued = static_cast<uint32_t>(sent - _posted);
+                stages.total = static_cast<uint32_t>(_completed - _posted);
+                stages.line = static_cast<uint32_t>(_completed - sent);
+                stages.timed = _timed;
+
+                if (_timed == true) {
+                    // The endpoint clock only counts differences, it wraps like micros() does.
+                    const uint32_t held = _timing.submitted - _timing.received;
+
+                    stages.endpoint = _timing.dispatched - _timing.received;
+                    stages.device = _timing.submitted - _timing.dispatched;
+                    stages.line = (stages.line > held) ? (stages.line - held) : 0;
+                } else {
+                    stages.endpoint = 0;
+                    stages.device = 0;
+                }
+            }
+            inline const Response& Reply() const
+            {
+                return (_response);
+            }
+            inline uint32_t Wait(const uint32_t waitTime)
+            {
+                return (_signal.Lock(waitTime));
+            }
+            inline bool IsAsynchronous() const
+            {
+                return (_completion != nullptr);
+            }
+            inline uint64_t Deadline() const
+            {
+                return (_deadline);
+            }
+            inline Protocol::Message& Frame()
+            {
+                return (*_frame);
+            }
+            inline void Notify(const uint32_t result, const Response& response) const
+            {
+                _completion(result, response);
+            }
+            // Times the request may go out again, interval in milliseconds between the attempts.
+            inline void Retries(const uint8_t retries, const uint32_t interval)
+            {
+                _retries = retries;
+                _interval = interval;
+            }
+            inline uint8_t Retries() const
+            {
+                return (_retries);
+            }
+            inline uint32_t Interval() const
+            {
+                return (_interval);
+            }
+            // Starts the wait for an answer, until the next retransmission.
+            inline void Arm()
+            {
+                _retransmission = (_retries > 0) ? Core::Time::Now().Ticks() + (static_cast<uint64_t>(_interval) * Core::Time::TicksPerMillisecond) : 0;
+            }
+            // Zero when no retransmission is left.
+            inline uint64_t Retransmission() const
+            {
+                return (_retransmission);
+            }
+            inline void Retransmitted(const bool stalled)
+            {
+                ASSERT(_retries > 0);
+
+                _retries--;
+                _retransmits++;
+                _stalled = _stalled || stalled;
+
+                Arm();
+            }
+            inline uint8_t Retransmits() const
+            {
+                return (_retransmits);
+            }
+            // Went out again because no answer came in time.
+            inline bool IsStalled() const
+            {
+                return (_stalled);
+            }
+
+        private:
+            Protocol::Message* _request;
+            Core::Event _signal;
+            uint32_t _result;
+            Response _response;
+            uint64_t _posted;
+            uint64_t _sent;
+            uint64_t _completed;
+            bool _timed;
+            Payload::Timing _timing;
+            Response _frame;
+            Completion _completion;
+            uint64_t _deadline;
+            uint8_t _retries;
+            uint32_t _interval;
+            uint64_t _retransmission;
+            uint8_t _retransmits;
+            bool _stalled;
+        };
+
+        // Unacknowledged frames, copied in by any number of callers without a lock and taken out by
+        // whoever holds the _adminLock. A cell is only handed out again once its frame left for the
+        // line, so the queues can point into the ring.
+        class Ring {
+        public:
+            static constexpr uint16_t Capacity = MaxWindow;
+
+            static_assert((Capacity & (Capacity - 1)) == 0, "The ring capacity must be a power of two");
+
+            Ring(const Ring&) = delete;
+            Ring& operator=(const Ring&) = delete;
+
+            Ring()
+                : _cells()
+                , _head(0)
+                , _tail(0)
+                , _released(0)
+            {
+                for (uint16_t index = 0; index < Capacity; index++) {
+                    _cells[index].sequence.store(index, std::memory_order_relaxed);
+                    _cells[index].done = false;
+                }
+            }
+            ~Ring() = default;
+
+        public:
+            // Returns false when the ring is full.
+            bool Push(const Protocol::Message& message)
+            {
+                uint32_t position(_head.load(std::memory_order_relaxed));
+                Cell* cell(nullptr);
+
+                while (cell == nullptr) {
+                    Cell& candidate(_cells[position & (Capacity - 1)]);
+                    const int32_t distance(static_cast<int32_t>(candidate.sequence.load(std::memory_order_acquire) - position));
+
+                    if (distance < 0) {
+                        break;
+                    } else if (distance > 0) {
+                        position = _head.load(std::memory_order_relaxed);
+                    } else if (_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed) == true) {
+                        cell = &candidate;
+                    }
+                }
+
+                if (cell != nullptr) {
+                    cell->frame = message;
+                    cell->sequence.store(position + 1, std::memory_order_release);
+                }
+
+                return (cell != nullptr);
+            }
+            // Must be called with the _adminLock taken. The oldest frame that is completely copied in.
+            Protocol::Message* Pop()
+            {
+                Cell& cell(_cells[_tail & (Capacity - 1)]);
+                Protocol::Message* result(nullptr);
+
+                if (cell.sequence.load(std::memory_order_acquire) == (_tail + 1)) {
+                    result = &(cell.frame);
+                    _tail++;
+                }
+
+                return (result);
+            }
+            // Frames submitted but not taken out yet.
+            inline uint32_t Size() const
+            {
+                return (_head.load(std::memory_order_relaxed) - _tail);
+            }
+            // Must be called with the _adminLock taken. The frame, if it is one taken out of the ring,
+            // is done with. Cells are handed back in ring order, the lanes may send out of it.
+            bool Release(const Protocol::Message& message)
+            {
+                uint32_t position(_released);
+
+                while ((position != _tail) && (&message != &(_cells[position & (Capacity - 1)].frame))) {
+                    position++;
+                }
+
+                const bool result(position != _tail);
+
+                if (result == true) {
+                    _cells[position & (Capacity - 1)].done = true;
+
+                    while ((_released != _tail) && (_cells[_released & (Capacity - 1)].done == true)) {
+                        Cell& cell(_cells[_released & (Capacity - 1)]);
+
+                        cell.done = false;
+                        cell.sequence.store(_released + Capacity, std::memory_order_release);
+                        _released++;
+                    }
+                }
+
+                return (result);
+            }
+            // Must be called with the _adminLock taken. Drops all frames, sent or not.
+            void Clear()
+            {
+                while (Pop() != nullptr) {
+                }
+                while (_released != _tail) {
+                    Release(_cells[_released & (Capacity - 1)].frame);
+                }
+            }
+
+        private:
+            struct Cell {
+                std::atomic<uint32_t> sequence;
+                bool done;
+                Protocol::Message frame;
+            };
+
+            Cell _cells[Capacity];
+            std::atomic<uint32_t> _head;
+            uint32_t _tail;
+            uint32_t _released;
+        };
+
     public:
         DataExchange(const DataExchange<LINK>&) = delete;
         DataExchange<LINK>& operator=(const DataExchange<LINK>&) = delete;
@@ -72,14 +645,45 @@ namespace SimpleSerial {
         DataExchange()
             : _adminLock()
             , _channel(*this)
-            , _current(nullptr)
-            , _exchange(false, true)
-            , _buffer()
+            , _window(DefaultWindow)
+            , _framing(Protocol::FramingType::PREAMBLE)
+            , _checksum(Protocol::ChecksumType::CRC8)
+            , _timing(false)
+            , _retries(0)
+            , _failures(0)
+            , _statistics()
+            , _sequence(0)
+            , _queue()
+            , _waiting()
+            , _passes(0)
+            , _overtakes(0)
+            , _pending()
+            , _sending(nullptr)
+            , _interactiveSpace(false, false)
+            , _backgroundSpace(false, false)
+            , _submissions()
+            , _drained(false, false)
+            , _refusal(Core::ERROR_NONE)
+            , _backlog()
+            , _expiry(*this)
+            , _nextExpiry(0)
+            , _pool(MaxWindow)
+            , _buffer(_pool.Element())
+            , _frames()
+            , _capture()
+            , _sniffing(false)
+            , _sniffed(0)
+            , _sniffer()
         {
-            _buffer.Clear();
+            _pending.reserve(MaxWindow);
+            _buffer->Clear();
+            _sniffer.Clear();
         }
 
-        virtual ~DataExchange() = default;
+        virtual ~DataExchange()
+        {
+            _expiry.Revoke();
+        }
 
     private:
         class Handler : public LINK {
@@ -138,106 +742,1090 @@ namespace SimpleSerial {
         {
             return (_channel.Close(waitTime));
         }
-        inline uint32_t Flush()
+        inline uint8_t Window() const
         {
-            _adminLock.Lock();
-
-            _channel.Flush();
-            _buffer.Clear();
-            _current = nullptr;
+            return (_window);
+        }
+        // The part of the window requests of this kind get at once, the background lane leaves
+        // the last slot to the interactive one.
+        inline uint8_t Window(const Protocol::OperationType operation) const
+        {
+            const uint8_t window(_window);
 
+            return (((Classify(operation) == BACKGROUND) && (window > 1)) ? (window - 1) : window);
+        }
+        inline void Window(const uint8_t window)
+        {
+            _adminLock.Lock();
+            _window = std::max(uint8_t(1), std::min(window, static_cast<uint8_t>(MaxWindow)));
             _adminLock.Unlock();
 
-            _exchange.SetEvent();
-
-            return (Core::ERROR_NONE);
+            Vacated();
         }
-        inline uint32_t Post(Protocol::Message& message, const uint32_t allowedTime)
+        inline Protocol::FramingType Framing() const
         {
-            message.Finalize();
-            return (message.Operation() == Protocol::OperationType::EVENT) ? Submit(message) : Exchange(message, allowedTime);
+            return (_framing);
         }
-
-        virtual void StateChange()
+        // Only switch once the endpoint agreed, frames still in flight are lost.
+        inline void Framing(const Protocol::FramingType framing)
         {
+            _adminLock.Lock();
+            _framing = framing;
+            _adminLock.Unlock();
         }
-        virtual void Send(const Protocol::Message& message VARIABLE_IS_NOT_USED)
+        inline Protocol::ChecksumType Checksum() const
         {
-            TRACE(Trace::Information, ("Send message Operation=0x%02X", message.Operation()));
-            PrintMessage(message);
+            return (_checksum);
         }
-        virtual void Received(const Protocol::Message& message VARIABLE_IS_NOT_USED)
+        // Like the framing, only switch once the endpoint agreed.
+        inline void Checksum(const Protocol::ChecksumType checksum)
         {
-            TRACE(Trace::Information, ("Received message Operation=0x%02X", message.Operation()));
-            PrintMessage(message);
+            _adminLock.Lock();
+            _checksum = checksum;
+            _buffer->Checksum(checksum);
+            _adminLock.Unlock();
         }
-
-    private:
-        uint32_t Submit(Protocol::Message& request)
+        inline Statistics Counters() const
         {
-            uint32_t result(Core::ERROR_INPROGRESS);
-
             _adminLock.Lock();
 
-            if (_current == nullptr) {
-                _current = &request;
-                _adminLock.Unlock();
-
-                _channel.Trigger();
-                result = Core::ERROR_NONE;
+            Statistics result(_statistics);
 
-            } else {
-                _adminLock.Unlock();
+            for (uint8_t lane = 0; lane < Lanes; lane++) {
+                result.lanes[lane].depth = Depth(static_cast<Lane>(lane));
             }
 
+            // Submitted frames not in their lane yet, unacknowledged keys as good as always.
+            result.lanes[Classify(Protocol::OperationType::KEY_NOACK)].depth += _submissions.Size();
+
+            _adminLock.Unlock();
+
             return (result);
         }
-        uint32_t Exchange(Protocol::Message& request, const uint32_t allowedTime)
+        inline bool Timing() const
+        {
+            return (_timing);
+        }
+        // Only for endpoints of Protocol::TimingVersion or up, others reject the flagged operations.
+        inline void Timing(const bool timing)
         {
-            uint32_t result(Core::ERROR_INPROGRESS);
-
             _adminLock.Lock();
+            _timing = timing;
+            _adminLock.Unlock();
+        }
+        inline uint8_t Retries() const
+        {
+            return (_retries);
+        }
+        // Only for endpoints of Protocol::RetransmitVersion or up, others reject the flagged operations.
+        // The allowed time of a request is spread over the attempts.
+        inline void Retries(const uint8_t retries)
+        {
+            _adminLock.Lock();
+            _retries = retries;
+            _adminLock.Unlock();
+        }
+        // Times a request of the operation may go out.
+        inline uint8_t Attempts(const Protocol::OperationType operation) const
+        {
+            return ((Retransmittable(operation) == true) ? _retries + 1 : 1);
+        }
+        // Captures the link to the file, an empty name ends the capture. Only while the link is closed.
+        uint32_t Capture(const string& fileName, const uint32_t size)
+        {
+            uint32_t result(Core::ERROR_NONE);
 
-            if (_current == nullptr) {
-                _current = &request;
-                _adminLock.Unlock();
-
-                _exchange.ResetEvent();
+            ASSERT(_channel.IsOpen() == false);
 
-                _channel.Trigger();
+            _capture.reset();
 
-                // Lock event until Completed() sets it.
-                result = _exchange.Lock(allowedTime);
+            if (fileName.empty() == false) {
+                _capture.reset(new CaptureFile(fileName, size));
 
-                if ((result == Core::ERROR_NONE) && (request.IsValid() == false)) {
-                    result = Core::ERROR_INCORRECT_HASH;
+                if (_capture->IsValid() == false) {
+                    TRACE(Trace::Error, ("Could not create capture %s", fileName.c_str()));
+                    _capture.reset();
+                    result = Core::ERROR_OPENING_FAILED;
                 }
-
-                _adminLock.Lock();
-                _current = nullptr;
             }
 
+            return (result);
+        }
+        // Plays a capture back through this side as if it were the link, with the link closed.
+        // Every request the capture sent goes out again at its original moment, divided by speed,
+        // under its captured sequence id and with the allowed time the caller gives its operation.
+        // The received spans go through ReceiveData() at their moments, so the captured responses
+        // answer the replayed requests, or come too late for them. What SendData() produces is
+        // checked frame by frame against the capture. A speed of zero plays as fast as possible.
+        uint32_t Replay(const string& fileName, const uint8_t speed, const AllowedTime& allowedTime, ReplayReport& report)
+        {
+            uint32_t result(Core::ERROR_NONE);
+            Core::DataElementFile file(fileName, Core::DataElementFile::READABLE);
+
+            CaptureFile::Header header = {};
+
+            ::memset(&report, 0, sizeof(report));
+
+            if ((file.IsValid() == true) && (file.Size() >= sizeof(header))) {
+                ::memcpy(&header, file.Buffer(), sizeof(header));
+            }
+
+            if ((_channel.IsOpen() == true) || (_capture != nullptr)) {
+                result = Core::ERROR_ILLEGAL_STATE;
+            } else if ((file.IsValid() == false) || (file.Size() < sizeof(header))) {
+                result = Core::ERROR_OPENING_FAILED;
+            } else if ((header.magic != CaptureFile::Magic) || (header.version != CaptureFile::Version)) {
+                result = Core::ERROR_NOT_SUPPORTED;
+            } else {
+                const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+                const uint8_t* data(file.Buffer());
+                const uint8_t window(_window);
+                const bool timing(_timing);
+                const uint8_t retries(_retries);
+                const Protocol::FramingType framing(_framing);
+                const Protocol::ChecksumType checksum(_checksum);
+                uint64_t offset(sizeof(header));
+                uint8_t produced[Protocol::MaxDataSize * 2];
+                CaptureFile::Record record;
+
+                // Completions come from the link as well as from the expiry job.
+                std::atomic<uint32_t> answered(0);
+                std::atomic<uint32_t> unanswered(0);
+
+                // Frames cut from the captured sends, and from what this side sends in their place.
+                Protocol::Message outbound;
+                Protocol::Message inbound;
+                Protocol::Message* frame;
+                std::list<Protocol::Message> expected;
+
+                outbound.Clear();
+                outbound.Checksum(_checksum);
+                inbound.Clear();
+                inbound.Checksum(_checksum);
+
+                // The capture shows what the window let through and what was sent again, so all of
+                // it is admitted at once and nothing is retransmitted on its own.
+                _adminLock.Lock();
+                _window = MaxWindow;
+                _retries = 0;
+                _adminLock.Unlock();
+
+                // Sends whatever is queued, every frame is checked against the oldest captured one.
+                auto collect = [this, &produced, &inbound, &frame, &expected, &report]() {
+                    uint16_t size;
+
+                    while ((size = SendData(produced, sizeof(produced))) > 0) {
+                        frame = &inbound;
+
+                        Protocol::Parse(frame, size, produced, [&expected, &report](Protocol::Message* message) {
+                            if (expected.empty() == true) {
+                                report.diverged++;
+                            } else {
+                                if ((message->Size() != expected.front().Size()) || (::memcmp(message->Data(), expected.front().Data(), message->Size()) != 0)) {
+                                    report.diverged++;
+                                }
+
+                                expected.pop_front();
+                            }
+                        }, _framing);
+                    }
+                };
+
+                while ((offset + sizeof(record)) <= file.Size()) {
+                    ::memcpy(&record, &(data[offset]), sizeof(record));
+
+                    if ((record.length == 0) || ((offset + sizeof(record) + record.length) > file.Size())) {
+                        break;
+                    }
+
+                    if (speed > 0) {
+                        std::this_thread::sleep_until(start + std::chrono::nanoseconds(record.time / speed));
+                    }
+
+                    if ((record.framing != _framing) || (record.checksum != _checksum)) {
+                        Framing(record.framing);
+                        Checksum(record.checksum);
+                        outbound.Clear();
+                        outbound.Checksum(record.checksum);
+                        inbound.Clear();
+                        inbound.Checksum(record.checksum);
+                    }
+
+                    const uint8_t* span(&(data[offset + sizeof(record)]));
+
+                    if (record.direction == CaptureFile::RECEIVE) {
+                        // The link hands over a buffer of its own, the file is mapped read only.
+                        std::vector<uint8_t> received(span, span + record.length);
+
+                        ReceiveData(received.data(), record.length);
+                        report.received++;
+                    } else {
+                        frame = &outbound;
+
+                        Protocol::Parse(frame, record.length, span, [this, &allowedTime, &answered, &unanswered, &expected, &report](Protocol::Message* message) {
+                            // A frame cut off by the start of the capture is of no use.
+                            if ((message->IsValid() == true) && (message->IsRetransmit() == true)) {
+                                report.retransmitted++;
+                            } else if (message->IsValid() == true) {
+                                Protocol::Message request;
+                                uint32_t outcome;
+
+                                request = *message;
+
+                                expected.emplace_back();
+                                expected.back() = *message;
+
+                                _sequence = message->Sequence();
+                                Timing(message->IsTimed());
+
+                                if (Protocol::IsUnacknowledged(message->Operation()) == true) {
+                                    outcome = Submit(request, allowedTime(message->Operation()));
+                                } else {
+                                    outcome = Post(request, allowedTime(message->Operation()), [&answered, &unanswered](const uint32_t result, const Response&) {
+                                        if (result == Core::ERROR_NONE) {
+                                            answered++;
+                                        } else {
+                                            unanswered++;
+                                        }
+                                    });
+                                }
+
+                                if (outcome == Core::ERROR_NONE) {
+                                    report.posted++;
+                                } else {
+                                    expected.pop_back();
+                                    report.diverged++;
+                                }
+                            }
+                        }, _framing);
+                    }
+
+                    // Responses may have made room for requests that waited, so look after both.
+                    collect();
+
+                    offset += sizeof(record) + record.length;
+                }
+
+                // What is still in flight got no answer in the capture.
+                Flush(Core::ERROR_TIMEDOUT);
+                _expiry.Revoke();
+
+                _adminLock.Lock();
+                _nextExpiry = 0;
+                _window = window;
+                _timing = timing;
+                _retries = retries;
+                _framing = framing;
+                _checksum = checksum;
+                _buffer->Checksum(checksum);
+                _adminLock.Unlock();
+
+                report.diverged += static_cast<uint32_t>(expected.size());
+                report.answered = answered;
+                report.unanswered = unanswered;
+                report.duration = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+            }
+
+            return (result);
+        }
+        // Ends all requests in flight with the given result.
+        inline uint32_t Flush(const uint32_t reason = Core::ERROR_ASYNC_ABORTED)
+        {
+            std::list<Slot*> aborted;
+
+            _adminLock.Lock();
+
+            _channel.Flush();
+            _buffer->Clear();
+            _queue[INTERACTIVE].clear();
+            _queue[BACKGROUND].clear();
+            _submissions.Clear();
+            _sending = nullptr;
+
+            for (Slot* slot : _pending) {
+                if (slot->IsAsynchronous() == true) {
+                    aborted.push_back(slot);
+                } else {
+                    slot->Complete(reason);
+                }
+            }
+
+            _pending.clear();
+
+            aborted.splice(aborted.end(), _backlog);
+
+            _adminLock.Unlock();
+
+            Vacated();
+            _drained.SetEvent();
+
+            for (Slot* slot : aborted) {
+                slot->Notify(reason, Response());
+                delete slot;
+            }
+
+            return (Core::ERROR_NONE);
+        }
+        // Flushes with the given result and refuses every new request with it right away, until
+        // Resume(). Callers fail fast while a lost link is brought back, instead of timing out.
+        inline void Suspend(const uint32_t reason)
+        {
+            ASSERT(reason != Core::ERROR_NONE);
+
+            _refusal = reason;
+
+            Flush(reason);
+        }
+        inline void Resume()
+        {
+            _refusal = Core::ERROR_NONE;
+        }
+        inline bool IsSuspended() const
+        {
+            return (_refusal != Core::ERROR_NONE);
+        }
+        // Counts the incoming frames that are valid under the checksum the link is not on, to tell
+        // an endpoint on the other checksum from a bad line.
+        inline void Sniff(const bool enabled)
+        {
+            _sniffed = 0;
+            _sniffing = enabled;
+        }
+        inline uint32_t Sniffed() const
+        {
+            return (_sniffed);
+        }
+        // The response is handed over as is, straight from the receive pool.
+        inline uint32_t Post(Protocol::Message& message, const uint32_t allowedTime, Response& response)
+        {
+            ASSERT(Protocol::IsUnacknowledged(message.Operation()) == false);
+            return (Exchange(message, allowedTime, response));
+        }
+        // The response, if any, is copied over the request. Unacknowledged operations return as
+        // soon as they are queued, allowedTime only limits the wait for room in the queue.
+        inline uint32_t Post(Protocol::Message& message, const uint32_t allowedTime)
+        {
+            uint32_t result(Core::ERROR_NONE);
+
+            if (Protocol::IsUnacknowledged(message.Operation()) == true) {
+                result = Submit(message, allowedTime);
+            } else {
+                Response response;
+
+                result = Exchange(message, allowedTime, response);
+
+                if (response.IsValid() == true) {
+                    message = *response;
+                }
+            }
+
+            return (result);
+        }
+        // Returns as soon as the request is queued, the completion reports the response. Requests
+        // that find the window full wait in line, allowedTime covers that wait too.
+        inline uint32_t Post(const Protocol::Message& message, const uint32_t allowedTime, Completion&& completion)
+        {
+            ASSERT(Protocol::IsUnacknowledged(message.Operation()) == false);
+            ASSERT(completion != nullptr);
+
+            uint32_t result(_refusal);
+
+            if (result == Core::ERROR_NONE) {
+                const uint64_t deadline(Core::Time::Now().Ticks() + (static_cast<uint64_t>(allowedTime) * Core::Time::TicksPerMillisecond));
+                Response frame(_pool.Element());
+
+                *frame = message;
+
+                Slot* slot = new Slot(frame, std::move(completion), deadline);
+
+                _adminLock.Lock();
+
+                Prepare(*slot, message, allowedTime);
+
+                slot->Assign(slot->Frame());
+                _backlog.push_back(slot);
+
+                Track(Classify(message.Operation()));
+
+                const bool promoted = Promote();
+                const uint64_t due = Due(*slot, Core::Time::Now().Ticks());
+                const bool reschedule = ((_nextExpiry == 0) || (due < _nextExpiry));
+
+                if (reschedule == true) {
+                    _nextExpiry = due;
+                }
+
+                _adminLock.Unlock();
+
+                if (reschedule == true) {
+                    _expiry.Reschedule(Core::Time::Now().Add(Remaining(due)));
+                }
+                if (promoted == true) {
+                    _channel.Trigger();
+                }
+            }
+
+            return (result);
+        }
+        // Keeps as many of the requests in flight as the window allows, allowedTime covers all
+        // of them. Every response that came in is copied over its request.
+        inline uint32_t Post(const uint8_t count, Protocol::Message* messages[], const uint32_t allowedTime)
+        {
+            return (Exchange(count, messages, allowedTime));
+        }
+
+        virtual void StateChange()
+        {
+        }
+        virtual void Send(const Protocol::Message& message VARIABLE_IS_NOT_USED)
+        {
+            TRACE(Trace::Information, ("Send message Operation=0x%02X", message.Operation()));
+        }
+        // A request got no usable answer, failures is the number of such requests in a row.
+        virtual void Failed(const uint8_t failures VARIABLE_IS_NOT_USED)
+        {
+            TRACE(Trace::Error, ("Exchange failed, %d in a row", failures));
+        }
+        // A request of the given operation made it onto the line, but got no answer in time.
+        virtual void Expired(const Protocol::OperationType operation VARIABLE_IS_NOT_USED)
+        {
+        }
+        // An exchange completed, with the time spent in every stage.
+        virtual void Measured(const Protocol::OperationType operation VARIABLE_IS_NOT_USED, const Protocol::DeviceAddressType address VARIABLE_IS_NOT_USED, const Stages& stages VARIABLE_IS_NOT_USED)
+        {
+        }
+        virtual void Received(const Protocol::Message& message VARIABLE_IS_NOT_USED)
+        {
+            TRACE(Trace::Information, ("Received message Operation=0x%02X", message.Operation()));
+        }
+
+    private:
+        friend Core::ThreadPool::JobType<DataExchange<LINK>&>;
+
+        // Rounded up, so a wait does not end short of the deadline or spin on a zero timeout.
+        static uint32_t Remaining(const uint64_t deadline)
+        {
+            const uint64_t now(Core::Time::Now().Ticks());
+
+            return ((now < deadline) ? static_cast<uint32_t>((deadline - now + Core::Time::TicksPerMillisecond - 1) / Core::Time::TicksPerMillisecond) : 0);
+        }
+        // A switch of the framing, the checksum or the speed is answered the old way and made right
+        // after, a second one would not be understood. PINGs measure the line as it is.
+        static bool Retransmittable(const Protocol::OperationType operation)
+        {
+            return ((operation != Protocol::OperationType::FRAMING) && (operation != Protocol::OperationType::CHECKSUM) && (operation != Protocol::OperationType::BAUDRATE) && (operation != Protocol::OperationType::PING));
+        }
+        // Must be called with the _adminLock taken.
+        void Prepare(Slot& slot, const Protocol::Message& request, const uint32_t allowedTime) const
+        {
+            const uint8_t retries((Retransmittable(request.Operation()) == true) ? _retries : 0);
+
+            slot.Retries(retries, allowedTime / (retries + 1));
+        }
+        // When the expiry job has to look at an asynchronous request next. One still in the backlog
+        // is armed once it is promoted, so no earlier than an interval from now.
+        static uint64_t Due(const Slot& slot, const uint64_t now)
+        {
+            uint64_t result(slot.Deadline());
+
+            if ((slot.Retransmission() != 0) && (slot.Retransmission() < result)) {
+                result = slot.Retransmission();
+            } else if ((slot.Retransmission() == 0) && (slot.Retries() > 0)) {
+                result = std::min(result, now + (static_cast<uint64_t>(slot.Interval()) * Core::Time::TicksPerMillisecond));
+            }
+
+            return (result);
+        }
+        static Lane Classify(const Protocol::OperationType operation)
+        {
+            return (((operation == Protocol::OperationType::KEY) || (operation == Protocol::OperationType::KEY_NOACK) || (operation == Protocol::OperationType::KEY_BATCH) || (operation == Protocol::OperationType::SEQUENCE)) ? INTERACTIVE : BACKGROUND);
+        }
+        inline Core::Event& Room(const Lane lane)
+        {
+            return ((lane == INTERACTIVE) ? _interactiveSpace : _backgroundSpace);
+        }
+        // The waiters of both lanes check for themselves whose room it is.
+        inline void Vacated()
+        {
+            _interactiveSpace.SetEvent();
+            _backgroundSpace.SetEvent();
+        }
+        // Must be called with the _adminLock taken. Requests waiting for room in the window.
+        uint32_t Waiting(const Lane lane) const
+        {
+            return (_waiting[lane] + static_cast<uint32_t>(std::count_if(_backlog.begin(), _backlog.end(), [lane](const Slot* slot) { return (Classify(slot->Request().Operation()) == lane); })));
+        }
+        // Must be called with the _adminLock taken.
+        uint32_t Depth(const Lane lane) const
+        {
+            return (Waiting(lane) + static_cast<uint32_t>(_queue[lane].size()));
+        }
+        // Must be called with the _adminLock taken.
+        void Track(const Lane lane)
+        {
+            LaneStatistics& statistics(_statistics.lanes[lane]);
+
+            statistics.peak = std::max(statistics.peak, Depth(lane));
+        }
+        // Must be called with the _adminLock taken. The last slot of the window is kept for the
+        // interactive lane, which goes first unless a background request was passed MaxPasses times.
+        bool Admissible(const Lane lane) const
+        {
+            const bool starved((_passes >= MaxPasses) && (Waiting(BACKGROUND) > 0));
+            bool result(_pending.size() < _window);
+
+            if (lane == INTERACTIVE) {
+                result = result && (starved == false);
+            } else {
+                result = result && ((starved == true) || ((Waiting(INTERACTIVE) == 0) && ((_window == 1) || (_pending.size() < static_cast<size_t>(_window - 1)))));
+            }
+
+            return (result);
+        }
+        // Must be called with the _adminLock taken, for a request that got room in the window.
+        void Admit(const Lane lane)
+        {
+            if (lane == BACKGROUND) {
+                _passes = 0;
+            } else if (Waiting(BACKGROUND) > 0) {
+                _passes++;
+                _statistics.lanes[BACKGROUND].passed++;
+            }
+        }
+        // Must be called with the _adminLock taken. The oldest asynchronous request of a lane that
+        // has room in the window, interactive first.
+        typename std::list<Slot*>::iterator Eligible()
+        {
+            typename std::list<Slot*>::iterator result(_backlog.end());
+
+            if (Admissible(INTERACTIVE) == true) {
+                result = std::find_if(_backlog.begin(), _backlog.end(), [](const Slot* slot) { return (Classify(slot->Request().Operation()) == INTERACTIVE); });
+            }
+            if ((result == _backlog.end()) && (Admissible(BACKGROUND) == true)) {
+                result = std::find_if(_backlog.begin(), _backlog.end(), [](const Slot* slot) { return (Classify(slot->Request().Operation()) == BACKGROUND); });
+            }
+
+            return (result);
+        }
+        // Must be called with the _adminLock taken. The next frame for the line, interactive first
+        // unless a background frame was passed MaxPasses times.
+        Protocol::Message* Next()
+        {
+            std::list<Protocol::Message*>& interactive(_queue[INTERACTIVE]);
+            std::list<Protocol::Message*>& background(_queue[BACKGROUND]);
+            Protocol::Message* result(nullptr);
+
+            if ((interactive.empty() == false) && ((background.empty() == true) || (_overtakes < MaxPasses))) {
+                result = interactive.front();
+                interactive.pop_front();
+
+                _statistics.lanes[INTERACTIVE].frames++;
+
+                if (background.empty() == false) {
+                    _overtakes++;
+                    _statistics.lanes[BACKGROUND].passed++;
+                }
+            } else if (background.empty() == false) {
+                result = background.front();
+                background.pop_front();
+
+                _statistics.lanes[BACKGROUND].frames++;
+                _overtakes = 0;
+            }
+
+            return (result);
+        }
+        // Must be called with the _adminLock taken. Sends the request again under the same sequence,
+        // ahead of the new ones. One that did not make it onto the line yet just waits another interval.
+        bool Retransmit(Slot& slot, const bool stalled)
+        {
+            Protocol::Message& request(slot.Request());
+            std::list<Protocol::Message*>& queue(_queue[Classify(request.Operation())]);
+            const bool result((slot.Retries() > 0) && (_sending != &request) && (std::find(queue.begin(), queue.end(), &request) == queue.end()));
+
+            if (result == true) {
+                TRACE(Doofah::DataExchangeFlow, (_T("Retransmit sequence id: 0x%02X(%d)"), request.Sequence(), request.Sequence()));
+
+                request.Retransmit(true);
+                request.Finalize();
+
+                queue.push_front(&request);
+                _statistics.retransmits++;
+
+                slot.Retransmitted(stalled);
+            } else {
+                slot.Arm();
+            }
+
+            return (result);
+        }
+        // Must be called with the _adminLock taken. Skips sequence ids that are still
+        // owned by an outstanding request, so a wrapped counter never hands out a live id.
+        Protocol::SequenceType Sequence(const Protocol::OperationType operation)
+        {
+            Protocol::SequenceType sequence;
+            bool inUse;
+
+            do {
+                sequence = _sequence.fetch_add(1, std::memory_order_relaxed);
+                inUse = false;
+
+                for (const Slot* slot : _pending) {
+                    if ((slot->Request().Operation() == operation) && (slot->Request().Sequence() == sequence)) {
+                        inUse = true;
+                        break;
+                    }
+                }
+            } while (inUse == true);
+
+            TRACE(Doofah::DataExchangeFlow, (_T("Provided sequence id: 0x%02X(%d)"), sequence, sequence));
+
+            return (sequence);
+        }
+        // Must be called with the _adminLock taken. Moves the frames submitted so far into their
+        // lanes, so they keep their place ahead of the requests queued after them.
+        void Drain()
+        {
+            Protocol::Message* frame;
+
+            while ((frame = _submissions.Pop()) != nullptr) {
+                const Lane lane(Classify(frame->Operation()));
+
+                _queue[lane].push_back(frame);
+
+                Track(lane);
+            }
+        }
+        // Must be called with the _adminLock taken.
+        void Enqueue(Protocol::Message& request)
+        {
+            const Lane lane(Classify(request.Operation()));
+
+            Drain();
+
+            request.Sequence(Sequence(request.Operation()));
+            request.Checksum(_checksum);
+            request.Finalize();
+
+            _queue[lane].push_back(&request);
+
+            Track(lane);
+        }
+        // Must be called with the _adminLock taken.
+        void Dequeue(Protocol::Message& request)
+        {
+            std::list<Protocol::Message*>& queue(_queue[Classify(request.Operation())]);
+            typename std::list<Protocol::Message*>::iterator index(std::find(queue.begin(), queue.end(), &request));
+
+            if (index != queue.end()) {
+                queue.erase(index);
+            } else if (_sending == &request) {
+                // Abandon the frame half way, the receiving side resyncs on the next preamble.
+                _sending = nullptr;
+            }
+        }
+        // Nobody waits for these, so they go out from a copy in the ring and the caller never takes
+        // the _adminLock. Only a full ring makes it wait, for frames to leave for the line.
+        uint32_t Submit(Protocol::Message& request, const uint32_t allowedTime)
+        {
+            const uint64_t deadline(Core::Time::Now().Ticks() + (static_cast<uint64_t>(allowedTime) * Core::Time::TicksPerMillisecond));
+            uint32_t result(_refusal);
+
+            if (result == Core::ERROR_NONE) {
+                // Never in the window, so no outstanding request can own the sequence id.
+                request.Sequence(_sequence.fetch_add(1, std::memory_order_relaxed));
+                request.Checksum(_checksum);
+                request.Finalize();
+
+                bool queued(_submissions.Push(request));
+
+                while ((queued == false) && (result == Core::ERROR_NONE)) {
+                    _drained.ResetEvent();
+
+                    if (((queued = _submissions.Push(request)) == false) && ((result = _drained.Lock(Remaining(deadline))) == Core::ERROR_NONE)) {
+                        result = _refusal;
+                    }
+                }
+
+                if (result == Core::ERROR_NONE) {
+                    _channel.Trigger();
+                }
+            }
+
+            return (result);
+        }
+        // Must be called with the _adminLock taken.
+        void Sent(Protocol::Message& message)
+        {
+            if (_submissions.Release(message) == true) {
+                _drained.SetEvent();
+            } else {
+                typename std::vector<Slot*>::iterator slot(std::find_if(_pending.begin(), _pending.end(), [&message](const Slot* entry) { return (&(entry->Request()) == &message); }));
+
+                if (slot != _pending.end()) {
+                    (*slot)->Sent();
+                }
+            }
+        }
+        uint32_t Exchange(Protocol::Message& request, const uint32_t allowedTime, Response& response)
+        {
+            const uint64_t deadline(Core::Time::Now().Ticks() + (static_cast<uint64_t>(allowedTime) * Core::Time::TicksPerMillisecond));
+            Slot slot;
+
+            uint32_t result = Acquire(slot, request, allowedTime, deadline);
+
+            if (result == Core::ERROR_NONE) {
+                result = Await(slot, deadline, response);
+            }
+
+            return (result);
+        }
+        uint32_t Exchange(const uint8_t count, Protocol::Message* requests[], const uint32_t allowedTime)
+        {
+            uint32_t result(Core::ERROR_NONE);
+            uint32_t refused(Core::ERROR_NONE);
+            const uint64_t deadline(Core::Time::Now().Ticks() + (static_cast<uint64_t>(allowedTime) * Core::Time::TicksPerMillisecond));
+            std::unique_ptr<Slot[]> slots(new Slot[count]);
+            uint8_t acquired(0);
+            uint8_t awaited(0);
+
+            // The requests slide through the window: once it has no room for the next one, the
+            // oldest one in flight is awaited first. Our own slots only leave the window through
+            // Await(), waiting for room while holding all of them would wait for ourselves.
+            while (awaited < count) {
+                if ((acquired < count) && (refused == Core::ERROR_NONE) && ((acquired == awaited) || (HasRoom(Classify(requests[acquired]->Operation())) == true))) {
+                    // A window with room does not look at the clock, so we do.
+                    refused = (Remaining(deadline) > 0) ? Acquire(slots[acquired], *requests[acquired], allowedTime, deadline) : static_cast<uint32_t>(Core::ERROR_TIMEDOUT);
+
+                    if (refused == Core::ERROR_NONE) {
+                        acquired++;
+                    } else if (result == Core::ERROR_NONE) {
+                        result = refused;
+                    }
+                } else if (awaited < acquired) {
+                    Response response;
+
+                    uint32_t outcome = Await(slots[awaited], deadline, response);
+
+                    if (response.IsValid() == true) {
+                        *requests[awaited] = *response;
+                    }
+
+                    if (result == Core::ERROR_NONE) {
+                        result = outcome;
+                    }
+
+                    awaited++;
+                } else {
+                    break;
+                }
+            }
+
+            return (result);
+        }
+        bool HasRoom(const Lane lane) const
+        {
+            _adminLock.Lock();
+            const bool result(Admissible(lane));
             _adminLock.Unlock();
 
             return (result);
         }
+        // Must be called with the _adminLock taken. Moves the waiting asynchronous requests
+        // into the free room of the window, returns true if any got queued.
+        bool Promote()
+        {
+            bool result(false);
+            typename std::list<Slot*>::iterator index(Eligible());
+
+            while (index != _backlog.end()) {
+                Slot* slot(*index);
+
+                Admit(Classify(slot->Request().Operation()));
+
+                _backlog.erase(index);
+
+                slot->Request().Timed(_timing);
+                slot->Request().Retransmit(false);
+                Enqueue(slot->Request());
+                slot->Arm();
+                _pending.push_back(slot);
+
+                result = true;
+                index = Eligible();
+            }
+
+            return (result);
+        }
+        // Must be called with the _adminLock taken. Settles the outcome of a request that left the
+        // window, returns true when it counts as a failure of the line.
+        bool Account(Slot& slot, uint32_t& result, const Response& response)
+        {
+            if ((result == Core::ERROR_NONE) && (response->IsValid() == false)) {
+                result = Core::ERROR_INCORRECT_HASH;
+            }
+
+            const bool timedout = (result == Core::ERROR_TIMEDOUT);
+            const bool corrupted = ((result == Core::ERROR_INCORRECT_HASH) || ((result == Core::ERROR_NONE) && (response->Result() == Protocol::ResultType::CRC_INVALID)));
+            // A retransmission hides a bad line from the caller, not from the link.
+            const bool failed = ((timedout == true) || (corrupted == true) || (slot.Retransmits() > 0));
+
+            Dequeue(slot.Request());
+
+            typename std::vector<Slot*>::iterator index(std::find(_pending.begin(), _pending.end(), &slot));
+
+            if (index != _pending.end()) {
+                _pending.erase(index);
+            }
+
+            _statistics.exchanges++;
+
+            if (timedout == true) {
+                _statistics.timeouts++;
+            } else if (corrupted == true) {
+                _statistics.corrupted++;
+            } else if ((result == Core::ERROR_NONE) && (slot.Retransmits() > 0)) {
+                _statistics.recovered++;
+            }
+
+            if (failed == false) {
+                _failures = 0;
+            } else if (_failures < 0xFF) {
+                _failures++;
+            }
+
+            return (failed);
+        }
+        // Reports the outcome of Account(), without the _adminLock taken.
+        void Report(const Slot& slot, const uint32_t result, const bool failed, const uint8_t failures)
+        {
+            if ((result == Core::ERROR_TIMEDOUT) || (slot.IsStalled() == true)) {
+                Expired(slot.Request().Operation());
+            }
+
+            if (failed == true) {
+                Failed(failures);
+            } else if ((result == Core::ERROR_NONE) && (slot.Retransmits() == 0)) {
+                // Only a request that went out once tells the round trip, it is unknown which attempt got answered.
+                Stages stages;
+
+                slot.Measure(stages);
+
+                Measured(slot.Request().Operation(), slot.Request().Address(), stages);
+            }
+        }
+        // Waits for room in the window and queues the request, every caller only waits for its own turn.
+        uint32_t Acquire(Slot& slot, Protocol::Message& request, const uint32_t allowedTime, const uint64_t deadline)
+        {
+            const Lane lane(Classify(request.Operation()));
+            Core::Event& space(Room(lane));
+            uint32_t result(_refusal);
+
+            _adminLock.Lock();
+
+            _waiting[lane]++;
+
+            Track(lane);
+
+            while ((result == Core::ERROR_NONE) && (Admissible(lane) == false)) {
+                space.ResetEvent();
+                _adminLock.Unlock();
+
+                result = space.Lock(Remaining(deadline));
+
+                _adminLock.Lock();
+
+                // Woken by a Suspend() maybe.
+                if (result == Core::ERROR_NONE) {
+                    result = _refusal;
+                }
+            }
+
+            _waiting[lane]--;
+
+            if (result == Core::ERROR_NONE) {
+                Admit(lane);
+                Prepare(slot, request, allowedTime);
 
-        uint32_t Completed(const Protocol::Message& message)
+                slot.Assign(request);
+                request.Timed(_timing);
+                request.Retransmit(false);
+                Enqueue(request);
+                slot.Arm();
+                _pending.push_back(&slot);
+            }
+
+            _adminLock.Unlock();
+
+            // Either way the other lane might have room now.
+            Vacated();
+
+            if (result == Core::ERROR_NONE) {
+                _channel.Trigger();
+            }
+
+            return (result);
+        }
+        uint32_t Await(Slot& slot, const uint64_t deadline, Response& response)
         {
-            uint32_t result = Core::ERROR_NONE;
+            uint32_t result;
+
+            // Lock event until Completed() or Flush() signals this slot, sending the request again
+            // whenever the answer is overdue.
+            do {
+                const uint64_t next(((slot.Retransmission() != 0) && (slot.Retransmission() < deadline)) ? slot.Retransmission() : deadline);
 
-            TRACE(Trace::Information, ("Complete message Operation=0x%02X", message.Operation()));
+                result = slot.Wait(Remaining(next));
 
-            PrintMessage(message);
+                if ((result == Core::ERROR_TIMEDOUT) && (next != deadline)) {
+                    _adminLock.Lock();
 
-            if (_current != nullptr) {
-                *_current = message;
+                    const bool retransmitted((slot.Retransmission() <= Core::Time::Now().Ticks()) && (std::find(_pending.begin(), _pending.end(), &slot) != _pending.end()) && (Retransmit(slot, true) == true));
+
+                    _adminLock.Unlock();
+
+                    if (retransmitted == true) {
+                        _channel.Trigger();
+                    }
+                }
+            } while ((result == Core::ERROR_TIMEDOUT) && (Remaining(deadline) > 0));
+
+            _adminLock.Lock();
+
+            if (result == Core::ERROR_NONE) {
+                result = slot.Result();
+            }
+
+            if (result == Core::ERROR_NONE) {
+                response = slot.Reply();
+
+                ASSERT(response.IsValid() == true);
             }
 
-            _exchange.SetEvent();
+            // Garbled in either direction or lost, all signs of a bad line.
+            const bool failed = Account(slot, result, response);
+            const uint8_t failures = _failures;
+            const bool promoted = Promote();
+
+            _adminLock.Unlock();
+
+            Vacated();
+
+            if (promoted == true) {
+                _channel.Trigger();
+            }
+
+            Report(slot, result, failed, failures);
 
             return (result);
         }
+        // Expires the asynchronous requests that ran out of time.
+        void Dispatch()
+        {
+            const uint64_t now(Core::Time::Now().Ticks());
+            std::list<Slot*> expired;
+            uint64_t next(0);
+
+            _adminLock.Lock();
+
+            typename std::list<Slot*>::iterator waiting(_backlog.begin());
+
+            while (waiting != _backlog.end()) {
+                if ((*waiting)->Deadline() <= now) {
+                    expired.push_back(*waiting);
+                    waiting = _backlog.erase(waiting);
+                } else {
+                    const uint64_t due(Due(**waiting, now));
+
+                    next = ((next == 0) || (due < next)) ? due : next;
+                    ++waiting;
+                }
+            }
+
+            // Only the ones that made it onto the line say something about the line.
+            const std::vector<Slot*> pending(_pending);
+            std::vector<Protocol::OperationType> lost;
+            bool failed(false);
+            bool retransmitted(false);
+
+            for (Slot* slot : pending) {
+                if ((slot->IsAsynchronous() == true) && (slot->Deadline() <= now)) {
+                    uint32_t result(Core::ERROR_TIMEDOUT);
+
+                    failed = Account(*slot, result, Response()) || failed;
+                    lost.push_back(slot->Request().Operation());
+                    expired.push_back(slot);
+                } else if ((slot->IsAsynchronous() == true) && (slot->Retransmission() != 0) && (slot->Retransmission() <= now)) {
+                    retransmitted = Retransmit(*slot, true) || retransmitted;
+                }
+            }
+
+            const uint8_t failures = _failures;
+            const bool promoted = Promote();
+
+            for (const Slot* slot : _pending) {
+                if (slot->IsAsynchronous() == true) {
+                    const uint64_t due(Due(*slot, now));
+
+                    next = ((next == 0) || (due < next)) ? due : next;
+                }
+            }
+
+            _nextExpiry = next;
+
+            _adminLock.Unlock();
+
+            if (next != 0) {
+                _expiry.Reschedule(Core::Time::Now().Add(Remaining(next)));
+            }
+            if (expired.empty() == false) {
+                Vacated();
+            }
+            if ((promoted == true) || (retransmitted == true)) {
+                _channel.Trigger();
+            }
+
+            for (const Protocol::OperationType operation : lost) {
+                Expired(operation);
+            }
+
+            if (failed == true) {
+                Failed(failures);
+            }
+
+            for (Slot* slot : expired) {
+                slot->Notify(Core::ERROR_TIMEDOUT, Response());
+                delete slot;
+            }
+        }
+
+        // Must be called with the _adminLock taken.
+        void Completed(Slot& slot, Response& message)
+        {
+            TRACE(Trace::Information, ("Complete message Operation=0x%02X", message->Operation()));
+
+            if ((message->IsTimed() == true) && (message->IsValid() == true) && (message->PayloadLength() >= sizeof(Payload::Timing))) {
+                // Strip the trailer, so the payload is what the operation defines.
+                const uint8_t length = message->PayloadLength() - sizeof(Payload::Timing);
+                Payload::Timing timing;
+
+                ::memcpy(&timing, &(message->Payload()[length]), sizeof(timing));
+
+                slot.Timing(timing);
+
+                message->PayloadLength(length);
+                message->Timed(false);
+                message->Finalize();
+            }
+
+            typename std::vector<Slot*>::iterator index(std::find(_pending.begin(), _pending.end(), &slot));
+
+            if (index != _pending.end()) {
+                _pending.erase(index);
+            }
+
+            slot.Complete(message);
+        }
 
         uint16_t SendData(uint8_t* dataFrame, const uint16_t maxSendSize)
         {
@@ -245,61 +1833,170 @@ namespace SimpleSerial {
 
             _adminLock.Lock();
 
-            if (_current != nullptr) {
-                result = _current->Serialize(maxSendSize, dataFrame);
+            Drain();
 
-                TRACE(Doofah::DataExchangeFlow, ("Send %d bytes to %p", result, dataFrame));
+            // Pack as many queued frames as fit in the link buffer.
+            while (result < maxSendSize) {
+                if ((_sending == nullptr) && ((_sending = Next()) == nullptr)) {
+                    break;
+                }
 
-                if (result == 0) {
-                    Send(*_current);
+                uint16_t size = _sending->Serialize(maxSendSize - result, &dataFrame[result], _framing);
 
-                    if (_current->Operation() == Protocol::OperationType::EVENT) {
-                        _current = nullptr;
-                    }
+                if (size == 0) {
+                    _frames.Record(FrameLog::OUTBOUND, *_sending);
+                    Send(*_sending);
+                    Sent(*_sending);
+                    _sending = nullptr;
+                } else {
+                    result += size;
                 }
             }
 
+            TRACE(Doofah::DataExchangeFlow, ("Send %d bytes to %p", result, dataFrame));
+
+            if ((_capture != nullptr) && (result > 0)) {
+                _capture->Append(CaptureFile::TRANSMIT, _framing, _checksum, result, dataFrame);
+            }
+
             _adminLock.Unlock();
 
             return (result);
         }
         uint16_t ReceiveData(uint8_t* dataFrame, const uint16_t availableData)
         {
-            uint16_t consumedData(0);
+            TRACE(Doofah::DataExchangeFlow, ("Incoming %d bytes", availableData));
+
+            if (_capture != nullptr) {
+                _capture->Append(CaptureFile::RECEIVE, _framing, _checksum, availableData, dataFrame);
+            }
+
+            std::vector<std::pair<Slot*, uint32_t>> finished;
+            std::vector<Response> unsolicited;
+            bool failed(false);
+            bool retransmitted(false);
 
-            string data;
-            Core::ToHexString(dataFrame, availableData, data);
+            if (_sniffing == true) {
+                Protocol::Message* frame(&_sniffer);
 
-            // TRACE(Doofah::DataExchangeFlow, ("Incomming data=%s", data.c_str()));
+                if (_sniffer.Checksum() == _checksum) {
+                    _sniffer.Clear();
+                    _sniffer.Checksum((_checksum == Protocol::ChecksumType::CRC8) ? Protocol::ChecksumType::CRC32C : Protocol::ChecksumType::CRC8);
+                }
+
+                Protocol::Parse(frame, availableData, dataFrame, [this](Protocol::Message* message) {
+                    if (message->IsValid() == true) {
+                        _sniffed++;
+                    }
+                }, _framing);
+            }
 
             _adminLock.Lock();
 
-            while (consumedData < availableData) {
-                consumedData += _buffer.Deserialize(availableData - consumedData, &dataFrame[consumedData]);
+            Protocol::Parse(_buffer, availableData, dataFrame, [this, &finished, &unsolicited, &retransmitted](Response& frame) {
+                _frames.Record(FrameLog::INBOUND, *frame);
 
-                // TRACE(Doofah::DataExchangeFlow, ("consumedData data=%d", consumedData));
+                if (frame->IsValid() == false) {
+                    _statistics.resyncs++;
+                }
 
-                if (_buffer.IsComplete() == true) {
-                    if ((_current != nullptr) && (_current->Operation() == _buffer.Operation()) && (_current->Sequence() == _buffer.Sequence())) {
-                        Completed(_buffer); // this is an message we expected for
-                    } else {
-                        Received(_buffer);
-                    }
+                typename std::vector<Slot*>::iterator index(std::find_if(_pending.begin(), _pending.end(), [&frame](const Slot* slot) { return (slot->IsMatch(*frame)); }));
+
+                if ((index != _pending.end()) && ((frame->IsValid() == false) || (frame->Result() == Protocol::ResultType::CRC_INVALID)) && (Retransmit(**index, false) == true)) {
+                    // Garbled on the way in or out, no need to wait for the timeout to send it again.
+                    retransmitted = true;
+                } else if (index != _pending.end()) {
+                    Slot* slot(*index);
 
-                    _buffer.Clear();
+                    // This is a message we expected, hand over the frame and continue in a fresh one.
+                    Completed(*slot, frame);
+                    frame = _pool.Element();
+                    frame->Checksum(_checksum);
+
+                    if (slot->IsAsynchronous() == true) {
+                        finished.emplace_back(slot, Core::ERROR_NONE);
+                    }
+                } else {
+                    // Handed out once the _adminLock is released, the receiver may well send.
+                    unsolicited.push_back(frame);
+                    frame = _pool.Element();
+                    frame->Checksum(_checksum);
                 }
+            }, _framing);
+
+            for (std::pair<Slot*, uint32_t>& entry : finished) {
+                failed = Account(*entry.first, entry.second, entry.first->Reply()) || failed;
             }
+
+            const uint8_t failures = _failures;
+            const bool promoted = ((finished.empty() == false) && (Promote() == true));
+
             _adminLock.Unlock();
 
+            if (finished.empty() == false) {
+                Vacated();
+            }
+            if ((promoted == true) || (retransmitted == true)) {
+                _channel.Trigger();
+            }
+
+            if (failed == true) {
+                Failed(failures);
+            }
+
+            for (const Response& frame : unsolicited) {
+                Received(*frame);
+            }
+
+            for (std::pair<Slot*, uint32_t>& entry : finished) {
+                Report(*entry.first, entry.second, false, failures);
+
+                entry.first->Notify(entry.second, entry.first->Reply());
+                delete entry.first;
+            }
+
             return (availableData);
         }
 
     private:
-        Core::CriticalSection _adminLock;
+        mutable Core::CriticalSection _adminLock;
         Handler _channel;
-        Protocol::Message* _current;
-        Core::Event _exchange;
-        Protocol::Message _buffer;
+        uint8_t _window;
+        Protocol::FramingType _framing;
+        // Read without the _adminLock by Submit().
+        std::atomic<Protocol::ChecksumType> _checksum;
+        bool _timing;
+        uint8_t _retries;
+        uint8_t _failures;
+        Statistics _statistics;
+        std::atomic<Protocol::SequenceType> _sequence;
+        std::list<Protocol::Message*> _queue[Lanes];
+        // Synchronous requests waiting for room in the window.
+        uint32_t _waiting[Lanes];
+        // Background requests passed in a row, in the window and on the line.
+        uint8_t _passes;
+        uint8_t _overtakes;
+        std::vector<Slot*> _pending;
+        Protocol::Message* _sending;
+        Core::Event _interactiveSpace;
+        Core::Event _backgroundSpace;
+        // Copies of unacknowledged frames, until they are on the line.
+        Ring _submissions;
+        Core::Event _drained;
+        // Result new requests are refused with, while suspended.
+        std::atomic<uint32_t> _refusal;
+        // Asynchronous requests waiting for room in the window.
+        std::list<Slot*> _backlog;
+        Core::WorkerPool::JobType<DataExchange<LINK>&> _expiry;
+        uint64_t _nextExpiry;
+        Core::ProxyPoolType<Protocol::Message> _pool;
+        Response _buffer;
+        FrameLog _frames;
+        std::unique_ptr<CaptureFile> _capture;
+        std::atomic<bool> _sniffing;
+        std::atomic<uint32_t> _sniffed;
+        // Only touched from ReceiveData(), always on the checksum the link is not on.
+        Protocol::Message _sniffer;
     };
 } // namespace Plugin
 } // namespace Thunder
@@ -67,6 +67,169 @@ Protocol::ResultType Controller::Setup(const Protocol::DeviceAddressType address
     return Protocol::ResultType::OK;
 }
 
+Protocol::ResultType Controller::Sequence(const Protocol::DeviceAddressType address, const Protocol::SequenceType id, const uint8_t count, const Payload::SequenceStep steps[])
+{
+    Protocol::ResultType result(Protocol::ResultType::NOT_AVAILABLE);
+
+    TRACE("Address=0x%02X steps=%d", address, count);
+
+    if ((address < _deviceRegister.size()) && (_sequenceTimer != nullptr) && (_sequenceRunning == false) && (_sequenceCompleted == false)) {
+        if ((count == 0) || (count > Payload::MaxSequenceSteps)) {
+            result = Protocol::ResultType::PAYLOAD_INVALID;
+        } else {
+            // The request buffer is reused for the next frame, keep our own copy of the script.
+            memcpy(_sequenceSteps, steps, count * sizeof(Payload::SequenceStep));
+
+            _sequenceDevice = _deviceRegister[address];
+            _sequenceCount = count;
+            _sequenceIndex = 0;
+            _sequenceId = id;
+            _sequenceResult = Protocol::ResultType::OK;
+            _sequenceRunning = true;
+
+            SequenceStep();
+
+            result = Protocol::ResultType::OK;
+        }
+    }
+
+    return result;
+}
+
+bool Controller::SequenceCompleted(Protocol::SequenceType& id, Protocol::ResultType& result)
+{
+    // The devices are not thread safe, the steps run here, next to the keys from the host.
+    if (_sequenceDue == true) {
+        _sequenceDue = false;
+        SequenceStep();
+    }
+
+    bool completed(_sequenceCompleted);
+
+    if (completed == true) {
+        id = _sequenceId;
+        result = _sequenceResult;
+        _sequenceCompleted = false;
+    }
+
+    return completed;
+}
+
+void Controller::SequenceTimer(void* arg)
+{
+    static_cast<Controller*>(arg)->_sequenceDue = true;
+}
+
+void Controller::SequenceStep()
+{
+    bool waiting(false);
+
+    // Run all steps up to the next delay, the main loop brings us back once the timer expired.
+    while ((waiting == false) && (_sequenceIndex < _sequenceCount)) {
+        const Payload::SequenceStep& step(_sequenceSteps[_sequenceIndex++]);
+
+        if (step.action == Payload::SequenceAction::DELAY) {
+            if (step.value > 0) {
+                waiting = (esp_timer_start_once(_sequenceTimer, step.value) == ESP_OK);
+            }
+        } else {
+            Payload::KeyEvent event;
+
+            event.pressed = (step.action == Payload::SequenceAction::PRESS) ? Payload::Action::PRESSED : Payload::Action::RELEASED;
+            event.code = static_cast<uint16_t>(step.value);
+
+            Protocol::ResultType result(_sequenceDevice->KeyEvent(event));
+
+            if ((_sequenceResult == Protocol::ResultType::OK) && (result != Protocol::ResultType::OK)) {
+                _sequenceResult = result;
+            }
+        }
+    }
+
+    if (waiting == false) {
+        _sequenceRunning = false;
+        _sequenceCompleted = true;
+    }
+}
+
+Protocol::ResultType Controller::TransferBegin(const Protocol::DeviceAddressType address, const Payload::TransferBegin& begin, Payload::TransferState& state)
+{
+    Protocol::ResultType result(Protocol::ResultType::OK);
+
+    TRACE("Address=0x%02X size=%d crc=0x%08X", address, begin.size, begin.crc);
+
+    if (begin.size > _blob.Capacity()) {
+        result = Protocol::ResultType::NOT_AVAILABLE;
+    } else if ((address != _transferAddress) || (begin.size != _transferSize) || (begin.crc != _transferCrc)) {
+        // A new transfer, anything else resumes where the previous attempt left off.
+        _blob.Begin();
+
+        _transferAddress = address;
+        _transferSize = begin.size;
+        _transferCrc = begin.crc;
+        _transferOffset = 0;
+    }
+
+    state.offset = _transferOffset;
+
+    return result;
+}
+
+Protocol::ResultType Controller::TransferChunk(const Protocol::DeviceAddressType address, const uint32_t offset, const uint8_t length, const uint8_t data[], Payload::TransferState& state)
+{
+    Protocol::ResultType result(Protocol::ResultType::NOT_AVAILABLE);
+
+    if (address == _transferAddress) {
+        if ((offset != _transferOffset) || ((offset + length) > _transferSize)) {
+            // Out of order after a lost or corrupted chunk, the host rewinds to state.offset.
+            result = Protocol::ResultType::PAYLOAD_INVALID;
+        } else if (_blob.Write(offset, length, data) == true) {
+            _transferOffset += length;
+            result = Protocol::ResultType::OK;
+        } else {
+            result = Protocol::ResultType::TRANSMIT_FAILED;
+        }
+    }
+
+    state.offset = _transferOffset;
+
+    return result;
+}
+
+Protocol::ResultType Controller::TransferCommit(const Protocol::DeviceAddressType address, Payload::TransferState& state)
+{
+    Protocol::ResultType result(Protocol::ResultType::NOT_AVAILABLE);
+
+    if ((address == _transferAddress) && (_transferOffset == _transferSize)) {
+        uint8_t data[128];
+        uint32_t crc(0);
+        uint32_t offset(0);
+
+        // Verify what actually ended up in flash, not what we received.
+        while ((offset < _transferSize) && (_blob.Read(offset, std::min(uint32_t(sizeof(data)), _transferSize - offset), data) == true)) {
+            const uint16_t length(std::min(uint32_t(sizeof(data)), _transferSize - offset));
+            crc = Protocol::CRC32(crc, length, data);
+            offset += length;
+        }
+
+        if ((offset != _transferSize) || (crc != _transferCrc)) {
+            TRACE("Blob CRC mismatch 0x%08X != 0x%08X", crc, _transferCrc);
+            _transferOffset = 0;
+            _blob.Begin();
+            result = Protocol::ResultType::CRC_INVALID;
+        } else if (_blob.Commit(_transferSize, _transferCrc) == true) {
+            _transferAddress = Protocol::InvalidAddress;
+            result = Protocol::ResultType::OK;
+        } else {
+            result = Protocol::ResultType::TRANSMIT_FAILED;
+        }
+    }
+
+    state.offset = _transferOffset;
+
+    return result;
+}
+
 void Controller::Reset()
 {
     TRACE();
@@ -78,6 +241,18 @@ void Controller::StartDevices()
 
     TRACE("Starting %d devices", _deviceRegister.size());
 
+    if (_sequenceTimer == nullptr) {
+        esp_timer_create_args_t timer;
+
+        memset(&timer, 0, sizeof(timer));
+        timer.callback = &Controller::SequenceTimer;
+        timer.arg = this;
+        timer.dispatch_method = ESP_TIMER_TASK;
+        timer.name = "sequence";
+
+        esp_timer_create(&timer, &_sequenceTimer);
+    }
+
     for (auto& device : _deviceRegister) {
         device->Begin();
     }
@@ -85,6 +260,21 @@ void Controller::StartDevices()
 
 Controller::Controller()
     : _deviceRegister()
+    , _sequenceTimer(nullptr)
+    , _sequenceDevice(nullptr)
+    , _sequenceSteps()
+    , _sequenceCount(0)
+    , _sequenceIndex(0)
+    , _sequenceId(0)
+    , _sequenceResult(Protocol::ResultType::OK)
+    , _sequenceRunning(false)
+    , _sequenceDue(false)
+    , _sequenceCompleted(false)
+    , _blob()
+    , _transferAddress(Protocol::InvalidAddress)
+    , _transferSize(0)
+    , _transferCrc(0)
+    , _transferOffset(0)
 {}
 
 } // Controller namespace
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 #include <SimpleSerial.h>
+#include <esp_timer.h>
 #include <Storage.h>
 #include <vector>
 
@@ -37,6 +38,16 @@ public:
     Protocol::ResultType Reset(const Protocol::DeviceAddressType address);
     Protocol::ResultType Setup(const Protocol::DeviceAddressType address, const uint8_t length, const uint8_t data[]);
 
+    // Runs the steps on the device paced by an esp_timer, only one sequence can run at a time.
+    Protocol::ResultType Sequence(const Protocol::DeviceAddressType address, const Protocol::SequenceType id, const uint8_t count, const Payload::SequenceStep steps[]);
+    // Polled from the main loop, runs the steps that are due and returns true once for every finished sequence.
+    bool SequenceCompleted(Protocol::SequenceType& id, Protocol::ResultType& result);
+
+    // Bulk transfer into the blob storage, every call reports the offset the host should continue from.
+    Protocol::ResultType TransferBegin(const Protocol::DeviceAddressType address, const Payload::TransferBegin& begin, Payload::TransferState& state);
+    Protocol::ResultType TransferChunk(const Protocol::DeviceAddressType address, const uint32_t offset, const uint8_t length, const uint8_t data[], Payload::TransferState& state);
+    Protocol::ResultType TransferCommit(const Protocol::DeviceAddressType address, Payload::TransferState& state);
+
     ~Controller() = default;
 
     void Reset();
@@ -64,8 +75,28 @@ public:
 private:
     Controller();
 
+    static void SequenceTimer(void* arg);
+    void SequenceStep();
+
 private:
     DeviceList _deviceRegister;
+
+    esp_timer_handle_t _sequenceTimer;
+    IDevice* _sequenceDevice;
+    Payload::SequenceStep _sequenceSteps[Payload::MaxSequenceSteps];
+    uint8_t _sequenceCount;
+    uint8_t _sequenceIndex;
+    Protocol::SequenceType _sequenceId;
+    Protocol::ResultType _sequenceResult;
+    volatile bool _sequenceRunning;
+    volatile bool _sequenceDue;
+    volatile bool _sequenceCompleted;
+
+    Storage::Blob _blob;
+    Protocol::DeviceAddressType _transferAddress;
+    uint32_t _transferSize;
+    uint32_t _transferCrc;
+    uint32_t _transferOffset;
 }; // class Controller
 
 } // namespace
\ No newline at end of file
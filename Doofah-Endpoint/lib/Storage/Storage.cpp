@@ -103,6 +103,87 @@ void Storage::Reset()
     }
 }
 
+Storage::Blob::Blob()
+    : _partition(nullptr)
+    , _erased(0)
+{
+}
+
+const esp_partition_t* Storage::Blob::Partition() const
+{
+    // Looked up on first use, the blob can be constructed before the flash is accessible.
+    if (_partition == nullptr) {
+        _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, nullptr);
+
+        TRACE("Blob partition %s", (_partition != nullptr) ? _partition->label : "missing");
+    }
+
+    return _partition;
+}
+
+uint32_t Storage::Blob::Capacity() const
+{
+    return (Partition() != nullptr) ? (Partition()->size - DataOffset) : 0;
+}
+
+void Storage::Blob::Begin()
+{
+    // Sectors are erased lazily while the data comes in.
+    _erased = 0;
+}
+
+bool Storage::Blob::Write(const uint32_t offset, const uint16_t length, const uint8_t data[])
+{
+    bool result(false);
+
+    if ((offset + length) <= Capacity()) {
+        const uint32_t end(DataOffset + offset + length);
+
+        result = true;
+
+        while ((result == true) && (_erased < end)) {
+            result = (esp_partition_erase_range(Partition(), _erased, SPI_FLASH_SEC_SIZE) == ESP_OK);
+            _erased += SPI_FLASH_SEC_SIZE;
+        }
+
+        if (result == true) {
+            result = (esp_partition_write(Partition(), DataOffset + offset, data, length) == ESP_OK);
+        }
+    }
+
+    return result;
+}
+
+bool Storage::Blob::Read(const uint32_t offset, const uint16_t length, uint8_t data[]) const
+{
+    return ((offset + length) <= Capacity()) && (esp_partition_read(Partition(), DataOffset + offset, data, length) == ESP_OK);
+}
+
+bool Storage::Blob::Commit(const uint32_t size, const uint32_t crc)
+{
+    Header header = { size, crc };
+
+    bool result((Partition() != nullptr) && (_erased > 0) && (esp_partition_write(Partition(), 0, &header, sizeof(header)) == ESP_OK));
+
+    TRACE("Committed %d bytes: %s", size, result ? "OK" : "FAILED");
+
+    return result;
+}
+
+bool Storage::Blob::Committed(uint32_t& size, uint32_t& crc) const
+{
+    Header header;
+
+    bool result((Partition() != nullptr) && (esp_partition_read(Partition(), 0, &header, sizeof(header)) == ESP_OK) && (header.size <= Capacity()));
+
+    if (result == true) {
+        size = header.size;
+        crc = header.crc;
+    }
+
+    return result;
+}
+
 #ifdef __DEBUG__
 void Storage::DumpFlash()
 {
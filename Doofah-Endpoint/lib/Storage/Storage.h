@@ -1,6 +1,7 @@
 #pragma once
 
 #include <EEPROM.h>
+#include <esp_partition.h>
 
 namespace Doofhah {
 constexpr uint8_t FlashBaseAddress = 0x00;
@@ -50,6 +51,38 @@ public:
         uint16_t _address;
     }; // class Persistent
 
+    // Large data written straight to the raw data partition, a small header in
+    // front of the data marks it as committed.
+    class Blob {
+    public:
+        Blob(const Blob&) = delete;
+        Blob& operator=(const Blob&) = delete;
+
+        Blob();
+
+        uint32_t Capacity() const;
+
+        void Begin();
+        bool Write(const uint32_t offset, const uint16_t length, const uint8_t data[]);
+        bool Read(const uint32_t offset, const uint16_t length, uint8_t data[]) const;
+        bool Commit(const uint32_t size, const uint32_t crc);
+        bool Committed(uint32_t& size, uint32_t& crc) const;
+
+    private:
+        struct Header {
+            uint32_t size;
+            uint32_t crc;
+        };
+
+        static constexpr uint32_t DataOffset = 16;
+
+        const esp_partition_t* Partition() const;
+
+    private:
+        mutable const esp_partition_t* _partition;
+        uint32_t _erased;
+    }; // class Blob
+
 private:
     Storage();
 
@@ -10,6 +10,7 @@
 #include <OneButton.h>
 #include <SimpleSerial.h>
 
+#include <algorithm>
 #include <string>
 
 using namespace Thunder::SimpleSerial;
@@ -20,6 +21,66 @@ static Controller::Peripheral<IRKeyboardDevice> ir(IR_TX_PIN);
 
 Protocol::Message buffer;
 
+// Always start on the preamble framing and the CRC8, the host asks for anything else.
+Protocol::FramingType framing(Protocol::FramingType::PREAMBLE);
+Protocol::ChecksumType checksum(Protocol::ChecksumType::CRC8);
+
+constexpr uint8_t checksums = (1U << static_cast<uint8_t>(Protocol::ChecksumType::CRC8))
+    | (1U << static_cast<uint8_t>(Protocol::ChecksumType::CRC32C));
+
+// Always start at COM_BAUDRATE, the host moves us to one of these when its side can keep up.
+const uint32_t baudrates[] = { COM_BAUDRATES };
+uint32_t baudrate(COM_BAUDRATE);
+
+// If anything but valid frames arrived since the last valid one, and when the first of it did.
+bool noise = false;
+unsigned long noiseSince = 0;
+
+// Stamps of the request in Process(), for the timing trailer.
+Payload::Timing timing;
+
+constexpr uint32_t Supports(const Protocol::OperationType operation)
+{
+    return (1UL << static_cast<uint8_t>(operation));
+}
+
+constexpr uint32_t operations = Supports(Protocol::OperationType::RESET)
+    | Supports(Protocol::OperationType::KEY)
+    | Supports(Protocol::OperationType::SETTINGS)
+    | Supports(Protocol::OperationType::STATE)
+    | Supports(Protocol::OperationType::KEY_BATCH)
+    | Supports(Protocol::OperationType::SEQUENCE)
+    | Supports(Protocol::OperationType::TRANSFER_BEGIN)
+    | Supports(Protocol::OperationType::TRANSFER_CHUNK)
+    | Supports(Protocol::OperationType::TRANSFER_COMMIT)
+    | Supports(Protocol::OperationType::FRAMING)
+    | Supports(Protocol::OperationType::HELLO)
+    | Supports(Protocol::OperationType::BAUDRATE)
+    | Supports(Protocol::OperationType::KEY_NOACK)
+    | Supports(Protocol::OperationType::PING)
+    | Supports(Protocol::OperationType::CHECKSUM);
+
+// Operations with a side effect, a retransmission of one of these must not be handled twice.
+constexpr uint32_t remembered = Supports(Protocol::OperationType::RESET)
+    | Supports(Protocol::OperationType::KEY)
+    | Supports(Protocol::OperationType::SETTINGS)
+    | Supports(Protocol::OperationType::KEY_BATCH)
+    | Supports(Protocol::OperationType::SEQUENCE)
+    | Supports(Protocol::OperationType::TRANSFER_COMMIT);
+
+// The answers to the latest of those, newest at answers[(answerIndex - 1) % MaxAnswers].
+struct Answer {
+    Protocol::OperationType operation;
+    Protocol::SequenceType sequence;
+    uint32_t digest; // Over the address and payload of the request
+    Protocol::Message response;
+};
+
+constexpr uint8_t MaxAnswers = 8;
+Answer answers[MaxAnswers];
+uint8_t answerIndex = 0;
+uint8_t answerCount = 0;
+
 OneButton button = OneButton(
     BUTTON_PIN, // Input pin for the button
     true, // Button is active LOW
@@ -67,47 +128,250 @@ void PrintMessage(const std::string& prefix, const Protocol::Message& message)
     GLOBAL_TRACE("%s: message[%s]", prefix.c_str(), data.c_str());
 }
 
-void SendMessage(const Protocol::Message& message)
+void SendMessage(const Protocol::Message& message, const Protocol::FramingType type)
 {
     RgbColor color = led.GetPixelColor(0);
     Led(green);
 
-    uint8_t data(0);
+    uint8_t data[Protocol::COBS::MaxEncodedSize];
 
     GLOBAL_TRACE("Sending %d bytes with operation=0x%02X result=0x%02X...", message.Size(), message.Operation(), message.Result());
 
     PrintMessage(__FUNCTION__, message);
 
-    while (message.Serialize(sizeof(data), &data) != 0) {
-        Serial.write(data);
-    }
+    Serial.write(data, message.Serialize(sizeof(data), data, type));
+
     Led(color);
 }
 
+void Baudrate(const uint32_t rate)
+{
+    GLOBAL_TRACE("Switching from %d to %d baud", baudrate, rate);
+
+    // Let the last answer at the old speed leave first.
+    Serial.flush();
+    Serial.updateBaudRate(rate);
+
+    baudrate = rate;
+    noise = false;
+}
+
+// Hands a key to the device, stamping the first handover and the last return.
+Protocol::ResultType Dispatch(const Protocol::DeviceAddressType address, const Payload::KeyEvent& event)
+{
+    if (timing.dispatched == 0) {
+        timing.dispatched = micros();
+    }
+
+    const Protocol::ResultType result(Controller::Instance().KeyEvent(address, event));
+
+    timing.submitted = micros();
+
+    return (result);
+}
+
+uint32_t Digest(const Protocol::Message& message)
+{
+    const Protocol::DeviceAddressType address(message.Address());
+
+    return (Protocol::CRC32(Protocol::CRC32(0, sizeof(address), &address), message.PayloadLength(), message.Payload()));
+}
+
+void Remember(const Protocol::SequenceType sequence, const uint32_t digest, const Protocol::Message& response)
+{
+    Answer& entry(answers[answerIndex]);
+
+    entry.operation = response.Operation();
+    entry.sequence = sequence;
+    entry.digest = digest;
+    entry.response = response;
+
+    answerIndex = (answerIndex + 1) % MaxAnswers;
+    answerCount = std::min(static_cast<uint8_t>(answerCount + 1), MaxAnswers);
+}
+
+// Puts the answer given before in the message, if the request was handled before.
+bool Recall(Protocol::Message& message)
+{
+    const uint32_t digest(Digest(message));
+    bool found(false);
+
+    for (uint8_t age = 1; (age <= answerCount) && (found == false); age++) {
+        const Answer& entry(answers[(answerIndex + MaxAnswers - age) % MaxAnswers]);
+
+        if ((entry.operation == message.Operation()) && (entry.sequence == message.Sequence()) && (entry.digest == digest)) {
+            message = entry.response;
+            found = true;
+        }
+    }
+
+    return (found);
+}
+
+void ComposeEvent(Protocol::Message& message, const Payload::EventType type, const Protocol::SequenceType sequence = 0, const Protocol::ResultType result = Protocol::ResultType::OK)
+{
+    Payload::Event event;
+    event.type = type;
+
+    message.Clear();
+    message.Operation(Protocol::OperationType::EVENT);
+    message.Sequence(sequence);
+    message.Result(result);
+    message.Payload(sizeof(event), reinterpret_cast<const uint8_t*>(&event));
+
+    message.Checksum(checksum);
+    message.Finalize();
+}
+
 void Process(Protocol::Message& message)
 {
     bool reboot = false;
+    bool answer = true;
+    bool remember = false;
+    uint32_t digest = 0;
+    Protocol::FramingType next = framing;
+    Protocol::ChecksumType nextChecksum = checksum;
+    uint32_t nextBaudrate = baudrate;
 
     GLOBAL_TRACE("Processing %d bytes with operation=0x%02X device=0x%02X...", message.Size(), message.Operation(), message.Address());
 
     PrintMessage(__FUNCTION__, message);
 
+    timing.dispatched = 0;
+    timing.submitted = 0;
+
     if (message.IsValid() == false) {
         message.PayloadLength(0);
         message.Result(Protocol::ResultType::CRC_INVALID);
+        message.Timed(false);
+    } else if ((message.IsRetransmit() == true) && (Recall(message) == true)) {
+        GLOBAL_TRACE("Retransmission of sequence 0x%02X, handled before", message.Sequence());
+
+        noise = false;
     } else {
         Protocol::ResultType result = Protocol::ResultType::OPERATION_INVALID;
 
+        noise = false;
+
+        if ((remembered & Supports(message.Operation())) != 0) {
+            // Taken before the request is turned into its answer.
+            digest = Digest(message);
+            remember = true;
+        }
+
         switch (message.Operation()) {
         case Protocol::OperationType::KEY:
 
             GLOBAL_TRACE("KeyEvent of 0x%02X", message.Address());
             if ((message.Address() > 0x00) && (message.PayloadLength() == sizeof(Payload::KeyEvent))) {
-                result = Controller::Instance().KeyEvent(message.Address() - 1, *(reinterpret_cast<const Payload::KeyEvent*>(message.Payload())));
+                result = Dispatch(message.Address() - 1, *(reinterpret_cast<const Payload::KeyEvent*>(message.Payload())));
+            }
+            message.PayloadLength(0);
+            break;
+
+        case Protocol::OperationType::KEY_NOACK: {
+            Payload::KeyError failure;
+
+            GLOBAL_TRACE("Unacknowledged KeyEvent of 0x%02X", message.Address());
+
+            failure.address = message.Address();
+
+            if ((message.Address() > 0x00) && (message.PayloadLength() == sizeof(Payload::KeyEvent))) {
+                memcpy(&failure.event, message.Payload(), sizeof(failure.event));
+                result = Dispatch(message.Address() - 1, failure.event);
+            } else {
+                memset(&failure.event, 0, sizeof(failure.event));
+                result = Protocol::ResultType::PAYLOAD_INVALID;
+            }
+
+            if (result == Protocol::ResultType::OK) {
+                answer = false;
+            } else {
+                // Nobody waits for an answer, the failure goes out as an event under the same sequence.
+                uint8_t payload[sizeof(Payload::Event) + sizeof(Payload::KeyError)];
+                const Protocol::SequenceType sequence(message.Sequence());
+
+                ComposeEvent(message, Payload::EventType::KEY_ERROR, sequence, result);
+
+                memcpy(payload, message.Payload(), sizeof(Payload::Event));
+                memcpy(&payload[sizeof(Payload::Event)], &failure, sizeof(failure));
+
+                message.Payload(sizeof(payload), payload);
+            }
+            break;
+        }
+
+        case Protocol::OperationType::PING:
+            // The payload goes back as it came in.
+            result = Protocol::ResultType::OK;
+            break;
+
+        case Protocol::OperationType::KEY_BATCH: {
+            const uint8_t count(message.PayloadLength() / sizeof(Payload::KeyBatchEvent));
+
+            GLOBAL_TRACE("KeyEvent batch of %d events", count);
+
+            if ((count > 0) && (message.PayloadLength() == (count * sizeof(Payload::KeyBatchEvent)))) {
+                Protocol::ResultType results[Payload::MaxKeyBatch];
+                const Payload::KeyBatchEvent* events(reinterpret_cast<const Payload::KeyBatchEvent*>(message.Payload()));
+
+                result = Protocol::ResultType::OK;
+
+                for (uint8_t i = 0; i < count; i++) {
+                    results[i] = (events[i].address > 0x00) ? Dispatch(events[i].address - 1, events[i].event) : Protocol::ResultType::NOT_AVAILABLE;
+
+                    if ((result == Protocol::ResultType::OK) && (results[i] != Protocol::ResultType::OK)) {
+                        result = results[i];
+                    }
+                }
+
+                message.Payload(count * sizeof(Protocol::ResultType), reinterpret_cast<const uint8_t*>(results));
+            } else {
+                result = Protocol::ResultType::PAYLOAD_INVALID;
+                message.PayloadLength(0);
+            }
+            break;
+        }
+
+        case Protocol::OperationType::SEQUENCE:
+            GLOBAL_TRACE("Sequence of %d bytes on 0x%02X", message.PayloadLength(), message.Address());
+            if ((message.Address() > 0x00) && (message.PayloadLength() > 0) && ((message.PayloadLength() % sizeof(Payload::SequenceStep)) == 0)) {
+                result = Controller::Instance().Sequence(message.Address() - 1, message.Sequence(), message.PayloadLength() / sizeof(Payload::SequenceStep), reinterpret_cast<const Payload::SequenceStep*>(message.Payload()));
+            } else {
+                result = Protocol::ResultType::PAYLOAD_INVALID;
             }
             message.PayloadLength(0);
             break;
 
+        case Protocol::OperationType::TRANSFER_BEGIN:
+        case Protocol::OperationType::TRANSFER_CHUNK:
+        case Protocol::OperationType::TRANSFER_COMMIT: {
+            Payload::TransferState state;
+            state.offset = 0;
+
+            if (message.Operation() == Protocol::OperationType::TRANSFER_BEGIN) {
+                if (message.PayloadLength() == sizeof(Payload::TransferBegin)) {
+                    result = Controller::Instance().TransferBegin(message.Address(), *(reinterpret_cast<const Payload::TransferBegin*>(message.Payload())), state);
+                } else {
+                    result = Protocol::ResultType::PAYLOAD_INVALID;
+                }
+            } else if (message.Operation() == Protocol::OperationType::TRANSFER_CHUNK) {
+                if (message.PayloadLength() > sizeof(Payload::TransferChunk)) {
+                    const Payload::TransferChunk* chunk(reinterpret_cast<const Payload::TransferChunk*>(message.Payload()));
+                    result = Controller::Instance().TransferChunk(message.Address(), chunk->offset, message.PayloadLength() - sizeof(Payload::TransferChunk), message.Payload() + sizeof(Payload::TransferChunk), state);
+                } else {
+                    result = Protocol::ResultType::PAYLOAD_INVALID;
+                }
+            } else {
+                result = Controller::Instance().TransferCommit(message.Address(), state);
+            }
+
+            GLOBAL_TRACE("Transfer operation=0x%02X result=0x%02X offset=%d", message.Operation(), result, state.offset);
+
+            message.Payload(sizeof(state), reinterpret_cast<const uint8_t*>(&state));
+            break;
+        }
+
         case Protocol::OperationType::RESET:
             GLOBAL_TRACE("Reset settings of 0x%02X", message.Address());
             if (message.Address() == 0x00) {
@@ -136,11 +400,12 @@ void Process(Protocol::Message& message)
 
             std::vector<Payload::Device> payload;
 
-            payload.push_back({ 0x00, Payload::Peripheral::ROOT });
+            payload.push_back({ 0x00, Payload::PeripheralState::AVAILABLE, Payload::Peripheral::ROOT });
 
             for (const auto& dev : devices) {
                 Payload::Device device;
                 device.address = (offset / sizeof(Payload::Device)) + 1;
+                device.state = Payload::PeripheralState::AVAILABLE;
                 device.peripheral = dev->Type();
                 payload.push_back(device);
 
@@ -155,6 +420,81 @@ void Process(Protocol::Message& message)
             break;
         }
 
+        case Protocol::OperationType::FRAMING:
+            if (message.PayloadLength() == sizeof(Payload::Framing)) {
+                const Payload::Framing* request(reinterpret_cast<const Payload::Framing*>(message.Payload()));
+
+                GLOBAL_TRACE("Framing 0x%02X requested", request->type);
+
+                if ((request->type == Protocol::FramingType::PREAMBLE) || (request->type == Protocol::FramingType::COBS)) {
+                    next = request->type;
+                    result = Protocol::ResultType::OK;
+                } else {
+                    result = Protocol::ResultType::UNSUPPORTED;
+                }
+            } else {
+                result = Protocol::ResultType::PAYLOAD_INVALID;
+            }
+            message.PayloadLength(0);
+            break;
+
+        case Protocol::OperationType::CHECKSUM:
+            if (message.PayloadLength() == sizeof(Payload::Checksum)) {
+                const Payload::Checksum* request(reinterpret_cast<const Payload::Checksum*>(message.Payload()));
+
+                GLOBAL_TRACE("Checksum 0x%02X requested", request->type);
+
+                if ((static_cast<uint8_t>(request->type) < 8) && ((checksums & (1U << static_cast<uint8_t>(request->type))) != 0)) {
+                    nextChecksum = request->type;
+                    result = Protocol::ResultType::OK;
+                } else {
+                    result = Protocol::ResultType::UNSUPPORTED;
+                }
+            } else {
+                result = Protocol::ResultType::PAYLOAD_INVALID;
+            }
+            message.PayloadLength(0);
+            break;
+
+        case Protocol::OperationType::HELLO: {
+            uint8_t payload[Protocol::MaxPayloadSize];
+            Payload::Hello& hello(*reinterpret_cast<Payload::Hello*>(payload));
+            const uint8_t count = std::min(sizeof(baudrates) / sizeof(baudrates[0]), static_cast<size_t>(Payload::MaxBaudrates));
+
+            GLOBAL_TRACE("Hello");
+
+            hello.version = Protocol::Version;
+            hello.payload = Protocol::MaxPayloadSize;
+            hello.operations = operations;
+            strncpy(hello.build, __TIMESTAMP__, sizeof(hello.build));
+            hello.baudrates = count;
+
+            memcpy(&payload[sizeof(Payload::Hello)], baudrates, count * sizeof(uint32_t));
+            payload[sizeof(Payload::Hello) + (count * sizeof(uint32_t))] = checksums;
+
+            message.Payload(sizeof(Payload::Hello) + (count * sizeof(uint32_t)) + sizeof(checksums), payload);
+            result = Protocol::ResultType::OK;
+            break;
+        }
+
+        case Protocol::OperationType::BAUDRATE:
+            if (message.PayloadLength() == sizeof(Payload::Baudrate)) {
+                const Payload::Baudrate* request(reinterpret_cast<const Payload::Baudrate*>(message.Payload()));
+
+                GLOBAL_TRACE("Baud rate %d requested", request->rate);
+
+                if ((request->rate == COM_BAUDRATE) || (std::find(std::begin(baudrates), std::end(baudrates), request->rate) != std::end(baudrates))) {
+                    nextBaudrate = request->rate;
+                    result = Protocol::ResultType::OK;
+                } else {
+                    result = Protocol::ResultType::UNSUPPORTED;
+                }
+            } else {
+                result = Protocol::ResultType::PAYLOAD_INVALID;
+            }
+            message.PayloadLength(0);
+            break;
+
             // case Protocol::OperationType::EVENT:
             //     ASSERT(false); // We should be generating this...
             //     break;
@@ -165,36 +505,60 @@ void Process(Protocol::Message& message)
         }
 
         message.Result(result);
+
+        if (message.IsTimed() == true) {
+            // Requests that never reach a device are stamped when handled.
+            if (timing.dispatched == 0) {
+                timing.dispatched = micros();
+                timing.submitted = timing.dispatched;
+            }
+
+            message.Timed(message.Extend(sizeof(timing), reinterpret_cast<const uint8_t*>(&timing)) == sizeof(timing));
+        }
     }
 
+    // An answer recalled from the cache may be from before a switch of the checksum.
+    message.Checksum(checksum);
     message.Finalize();
 
-    SendMessage(message);
+    if (remember == true) {
+        Remember(message.Sequence(), digest, message);
+    }
+
+    // The answer still goes out in the framing and under the checksum the question came in.
+    if (answer == true) {
+        SendMessage(message, framing);
+    }
+
+    framing = next;
+    checksum = nextChecksum;
+
+    if (nextBaudrate != baudrate) {
+        Baudrate(nextBaudrate);
+    }
 
     if (reboot == true) {
         ESP.restart();
     }
 
     message.Clear();
+    message.Checksum(checksum);
 }
 
-void SendEvent()
+void SendEvent(const Payload::EventType type, const Protocol::SequenceType sequence = 0, const Protocol::ResultType result = Protocol::ResultType::OK)
 {
     Protocol::Message message;
-    message.Clear();
-    message.Operation(Protocol::OperationType::EVENT);
-    message.PayloadLength(0);
 
-    message.Finalize();
+    ComposeEvent(message, type, sequence, result);
 
-    SendMessage(message);
+    SendMessage(message, framing);
 }
 
 // button callbacks
 void SingleClick()
 {
     // poke the plugin
-    SendEvent();
+    SendEvent(Payload::EventType::BUTTON);
 }
 void PressStart()
 {
@@ -237,27 +601,72 @@ void setup()
 
     Controller::Instance().StartDevices();
 
+    // Room for a full window of pipelined requests from the host.
+    Serial.setRxBufferSize(COM_RX_BUFFER_SIZE);
     Serial.begin(COM_BAUDRATE);
 
     GLOBAL_TRACE("Starting endpoint build %s", __TIMESTAMP__);
 
-    SendEvent();
+    // Announce in every framing and under every checksum, a host that switched us before this
+    // restart only understands what it switched us to. The CRC8 preamble one goes last, that is
+    // what we are on now.
+    Protocol::Message started;
+    ComposeEvent(started, Payload::EventType::STARTED);
+
+    for (const Protocol::ChecksumType type : { Protocol::ChecksumType::CRC32C, Protocol::ChecksumType::CRC8 }) {
+        started.Checksum(type);
+        started.Finalize();
+        SendMessage(started, Protocol::FramingType::COBS);
+        started.Finalize();
+        SendMessage(started, Protocol::FramingType::PREAMBLE);
+    }
+
     Led(off);
 }
 
 void loop()
 {
+    Protocol::SequenceType sequence;
+    Protocol::ResultType result;
+
     button.tick();
-    while (Serial.available() > 0) {
+
+    if (Controller::Instance().SequenceCompleted(sequence, result) == true) {
+        SendEvent(Payload::EventType::SEQUENCE_COMPLETED, sequence, result);
+    }
+
+    int available = Serial.available();
+
+    if (available > 0) {
+        uint8_t data[COM_RX_CHUNK_SIZE];
+        Protocol::Message* frame(&buffer);
+
         Led(blue);
 
-        uint8_t byte = Serial.read();
-        buffer.Deserialize(sizeof(byte), &byte);
+        // A frame on its way in counts from its first byte, it is not noise before it had time to complete.
+        if (noise == false) {
+            noise = true;
+            noiseSince = millis();
+        }
+
+        // Drain what the UART collected in one go, a chunk may hold several frames.
+        while (available > 0) {
+            const size_t length = Serial.read(data, std::min(static_cast<size_t>(available), sizeof(data)));
 
-        if (buffer.IsComplete()) {
-            GLOBAL_TRACE("Received a complete message!");
-            Process(buffer);
-            Led(off);
+            Protocol::Parse(frame, length, data, [](Protocol::Message*& message) {
+                timing.received = micros();
+                GLOBAL_TRACE("Received a complete message!");
+                Process(*message);
+            }, framing);
+
+            available = Serial.available();
         }
+
+        Led(off);
+    }
+
+    // Bytes, but nothing valid for as long, at a raised speed: the host is not talking at this speed (anymore).
+    if ((baudrate != COM_BAUDRATE) && (noise == true) && ((millis() - noiseSince) > Protocol::BaudrateConfirmTime)) {
+        Baudrate(COM_BAUDRATE);
     }
 }
@@ -0,0 +1,143 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include <SimpleSerial.h>
+
+#include <stdio.h>
+
+using namespace Thunder::SimpleSerial;
+
+// Runs on the endpoint with "pio test -e m5stack-atom -f test_checksum". Checks both frame
+// checksums against their published check values and times them per frame, next to the
+// bit by bit CRC8 the lookup table replaced. The CPU has no CRC instructions, so this is
+// the cost of the CRC32C an endpoint pays for every frame in and out once the host asks for it.
+
+static const uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+
+// Frame sizes without the checksum: a KEY, a KEY_BATCH of 8, a TRANSFER_CHUNK and the largest frame.
+static const uint8_t sizes[] = { Protocol::HeaderSize + sizeof(Payload::KeyEvent), Protocol::HeaderSize + (8 * sizeof(Payload::KeyBatchEvent)), 128, Protocol::HeaderSize + Protocol::MaxPayloadSize };
+
+constexpr uint16_t Rounds = 2000;
+
+static uint8_t bytes[Protocol::MaxDataSize];
+
+static uint8_t BitwiseCRC8(const uint8_t length, const uint8_t data[])
+{
+    uint8_t crc(~0);
+
+    for (uint8_t i = 0; i < length; i++) {
+        crc ^= data[i];
+
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = ((crc & 0x80) != 0) ? ((crc << 1) ^ 0x31) : (crc << 1);
+        }
+    }
+
+    return (crc);
+}
+
+// Nanoseconds per frame, the result is folded into sink so the loop is not optimized away.
+template <typename FUNCTION>
+static uint32_t Measure(const uint8_t length, FUNCTION&& function, uint32_t& sink)
+{
+    const uint32_t start(micros());
+
+    for (uint16_t round = 0; round < Rounds; round++) {
+        bytes[0] = static_cast<uint8_t>(round);
+        sink += function(length, bytes);
+    }
+
+    return (((micros() - start) * 1000UL) / Rounds);
+}
+
+void test_crc8_check_value()
+{
+    TEST_ASSERT_EQUAL_HEX8(0xF7, Protocol::Checksum::CRC8::Calculate(sizeof(check), check));
+    TEST_ASSERT_EQUAL_HEX8(BitwiseCRC8(sizeof(check), check), Protocol::Checksum::CRC8::Calculate(sizeof(check), check));
+}
+
+void test_crc32c_check_value()
+{
+    TEST_ASSERT_EQUAL_HEX32(0xE3069283, Protocol::Checksum::CRC32C::Calculate(sizeof(check), check));
+}
+
+// A frame only holds up under the checksum it was finalized with.
+void test_frame_checksum()
+{
+    const Protocol::ChecksumType types[] = { Protocol::ChecksumType::CRC8, Protocol::ChecksumType::CRC32C };
+
+    for (const Protocol::ChecksumType type : types) {
+        Protocol::Message message;
+        Protocol::Message received;
+        Protocol::Message other;
+        Protocol::Message* frame;
+        uint8_t data[Protocol::COBS::MaxEncodedSize];
+        uint8_t valid(0);
+        uint8_t misread(0);
+
+        message.Clear();
+        message.Checksum(type);
+        message.Operation(Protocol::OperationType::PING);
+        message.Sequence(1);
+        message.Address(0);
+        message.Payload(sizeof(check), check);
+        message.Finalize();
+
+        TEST_ASSERT_EQUAL_UINT8(Protocol::HeaderSize + sizeof(check) + Protocol::Checksum::Size(type), message.Size());
+
+        const uint16_t length = message.Serialize(sizeof(data), data);
+
+        received.Clear();
+        received.Checksum(type);
+        frame = &received;
+        Protocol::Parse(frame, length, data, [&valid](Protocol::Message* parsed) { valid += (parsed->IsValid() == true) ? 1 : 0; });
+
+        other.Clear();
+        other.Checksum((type == Protocol::ChecksumType::CRC8) ? Protocol::ChecksumType::CRC32C : Protocol::ChecksumType::CRC8);
+        frame = &other;
+        Protocol::Parse(frame, length, data, [&misread](Protocol::Message* parsed) { misread += (parsed->IsValid() == true) ? 1 : 0; });
+
+        TEST_ASSERT_EQUAL_UINT8(1, valid);
+        TEST_ASSERT_EQUAL_UINT8(0, misread);
+    }
+}
+
+void test_checksum_cost()
+{
+    uint32_t sink(0);
+    char line[96];
+
+    for (uint16_t i = 0; i < sizeof(bytes); i++) {
+        bytes[i] = static_cast<uint8_t>(i * 7);
+    }
+
+    for (const uint8_t length : sizes) {
+        const uint32_t bitwise = Measure(length, BitwiseCRC8, sink);
+        const uint32_t crc8 = Measure(length, Protocol::Checksum::CRC8::Calculate, sink);
+        const uint32_t crc32c = Measure(length, Protocol::Checksum::CRC32C::Calculate, sink);
+
+        snprintf(line, sizeof(line), "%3d bytes: CRC8 bitwise %6lu ns, CRC8 %6lu ns, CRC32C %6lu ns", length,
+            static_cast<unsigned long>(bitwise), static_cast<unsigned long>(crc8), static_cast<unsigned long>(crc32c));
+        TEST_MESSAGE(line);
+    }
+
+    // Only there to keep the loops.
+    TEST_ASSERT_NOT_EQUAL(0, sink | 1);
+}
+
+void setup()
+{
+    // Room for the test runner to open the port after the reset.
+    delay(2000);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_crc8_check_value);
+    RUN_TEST(test_crc32c_check_value);
+    RUN_TEST(test_frame_checksum);
+    RUN_TEST(test_checksum_cost);
+    UNITY_END();
+}
+
+void loop()
+{
+}
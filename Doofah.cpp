@@ -28,6 +28,41 @@ ENUM_CONVERSION_BEGIN(SimpleSerial::Payload::Peripheral) { SimpleSerial::Payload
     { SimpleSerial::Payload::Peripheral::IR, _TXT("ir") },
     ENUM_CONVERSION_END(SimpleSerial::Payload::Peripheral);
 
+ENUM_CONVERSION_BEGIN(SimpleSerial::Payload::SequenceAction) { SimpleSerial::Payload::SequenceAction::PRESS, _TXT("press") },
+    { SimpleSerial::Payload::SequenceAction::RELEASE, _TXT("release") },
+    { SimpleSerial::Payload::SequenceAction::DELAY, _TXT("delay") },
+    ENUM_CONVERSION_END(SimpleSerial::Payload::SequenceAction);
+
+ENUM_CONVERSION_BEGIN(SimpleSerial::Protocol::ResultType) { SimpleSerial::Protocol::ResultType::OK, _TXT("ok") },
+    { SimpleSerial::Protocol::ResultType::NOT_CONNECTED, _TXT("not_connected") },
+    { SimpleSerial::Protocol::ResultType::UNSUPPORTED, _TXT("unsupported") },
+    { SimpleSerial::Protocol::ResultType::NOT_AVAILABLE, _TXT("not_available") },
+    { SimpleSerial::Protocol::ResultType::TRANSMIT_FAILED, _TXT("transmit_failed") },
+    { SimpleSerial::Protocol::ResultType::CRC_INVALID, _TXT("crc_invalid") },
+    { SimpleSerial::Protocol::ResultType::OPERATION_INVALID, _TXT("operation_invalid") },
+    { SimpleSerial::Protocol::ResultType::PAYLOAD_INVALID, _TXT("payload_invalid") },
+    ENUM_CONVERSION_END(SimpleSerial::Protocol::ResultType);
+
+ENUM_CONVERSION_BEGIN(SimpleSerial::Protocol::OperationType) { SimpleSerial::Protocol::OperationType::RESET, _TXT("reset") },
+    { SimpleSerial::Protocol::OperationType::ALLOCATE, _TXT("allocate") },
+    { SimpleSerial::Protocol::OperationType::FREE, _TXT("free") },
+    { SimpleSerial::Protocol::OperationType::KEY, _TXT("key") },
+    { SimpleSerial::Protocol::OperationType::SETTINGS, _TXT("settings") },
+    { SimpleSerial::Protocol::OperationType::STATE, _TXT("state") },
+    { SimpleSerial::Protocol::OperationType::KEY_BATCH, _TXT("key_batch") },
+    { SimpleSerial::Protocol::OperationType::SEQUENCE, _TXT("sequence") },
+    { SimpleSerial::Protocol::OperationType::TRANSFER_BEGIN, _TXT("transfer_begin") },
+    { SimpleSerial::Protocol::OperationType::TRANSFER_CHUNK, _TXT("transfer_chunk") },
+    { SimpleSerial::Protocol::OperationType::TRANSFER_COMMIT, _TXT("transfer_commit") },
+    { SimpleSerial::Protocol::OperationType::FRAMING, _TXT("framing") },
+    { SimpleSerial::Protocol::OperationType::HELLO, _TXT("hello") },
+    { SimpleSerial::Protocol::OperationType::BAUDRATE, _TXT("baudrate") },
+    { SimpleSerial::Protocol::OperationType::KEY_NOACK, _TXT("key_noack") },
+    { SimpleSerial::Protocol::OperationType::PING, _TXT("ping") },
+    { SimpleSerial::Protocol::OperationType::CHECKSUM, _TXT("checksum") },
+    { SimpleSerial::Protocol::OperationType::EVENT, _TXT("event") },
+    ENUM_CONVERSION_END(SimpleSerial::Protocol::OperationType);
+
 namespace Plugin {
     static Core::ProxyPoolType<Web::TextBody> _textBodies(2);
     namespace {
@@ -59,23 +94,55 @@ namespace Plugin {
 
         JSONRPCRegister();
 
-        _communicator.Callback(&_sink);
-
-        uint32_t result = _communicator.Initialize(config.Connector.Value());
+        std::vector<string> connectors;
 
-        if (result == Core::ERROR_NONE) {
-            result = _communicator.Reset(0x00); // reset the endpoint
+        if (config.Connectors.IsSet() == true) {
+            auto index(config.Connectors.Elements());
 
-            if (result != Core::ERROR_NONE) {
-                TRACE(Trace::Error, ("Reset Failed 0x%04X", result));
-                message = "Could not reset the end-point";
+            while (index.Next() == true) {
+                connectors.push_back(index.Current().Value());
             }
         } else {
-            TRACE(Trace::Error, ("Initialize Failed 0x%04X", result));
-            message = "Could not setup communication channel";
+            connectors.push_back(config.Connector.Value());
+        }
+
+        uint8_t started(0);
+        uint8_t waiting(0);
+
+        // An endpoint that does not come up keeps its place, so the others keep their index.
+        for (const string& connector : connectors) {
+            const uint8_t index = static_cast<uint8_t>(_endpoints.size());
+
+            _endpoints.emplace_back(new Endpoint(*this, index));
+
+            Endpoint& endpoint(*_endpoints.back());
+
+            endpoint.Communicator().Register(&(endpoint.Callback()));
+
+            uint32_t result = endpoint.Communicator().Initialize(connector);
+
+            if (result == Core::ERROR_NONE) {
+                result = endpoint.Communicator().Reset(0x00); // reset the endpoint
+
+                if (result != Core::ERROR_NONE) {
+                    TRACE(Trace::Error, ("Reset of end-point %d Failed 0x%04X", index, result));
+                    message = "Could not reset the end-point";
+                } else {
+                    started++;
+                }
+            } else if (result != Core::ERROR_INCOMPLETE_CONFIG) {
+                // The communicator keeps reopening the port, the endpoint starts when it shows up.
+                TRACE(Trace::Error, ("End-point %d not available yet 0x%04X", index, result));
+                waiting++;
+            } else {
+                TRACE(Trace::Error, ("Initialize of end-point %d Failed 0x%04X", index, result));
+                message = "Could not setup communication channel";
+            }
         }
 
-        if (message.empty() == false) {
+        if ((started + waiting) > 0) {
+            message.clear();
+        } else {
             Deinitialize(service);
         }
 
@@ -86,8 +153,12 @@ namespace Plugin {
     {
         JSONRPCUnregister();
 
-        _communicator.Callback(nullptr);
-        _communicator.Deinitialize();
+        for (std::unique_ptr<Endpoint>& endpoint : _endpoints) {
+            endpoint->Communicator().Unregister(&(endpoint->Callback()));
+            endpoint->Communicator().Deinitialize();
+        }
+
+        _endpoints.clear();
 
         ASSERT(_service == service);
         _service = nullptr;
@@ -95,15 +166,34 @@ namespace Plugin {
 
     /* virtual */ string Doofah::Information() const
     {
-        // No additional info to report.
-        return (string());
+        string result;
+
+        // A single endpoint is described as it always was, several as a list in connector order.
+        for (const std::unique_ptr<Endpoint>& endpoint : _endpoints) {
+            EndpointInfo info;
+            string text;
+
+            info.Set(endpoint->Communicator().Endpoint());
+            info.Keys.Set(endpoint->Communicator().Keys());
+            info.ToString(text);
+
+            result += (result.empty() == true) ? text : (_T(",") + text);
+        }
+
+        if (_endpoints.size() > 1) {
+            result = _T("[") + result + _T("]");
+        }
+
+        return (result);
     }
 
-    bool Doofah::ParseSetupBody(const Web::Request& request, Protocol::DeviceAddressType& address, string& setup)
+    bool Doofah::ParseSetupBody(const Web::Request& request, uint8_t& endpoint, Protocol::DeviceAddressType& address, string& setup, uint32_t& deadline)
     {
         bool parsed = false;
 
+        endpoint = 0;
         address = Protocol::InvalidAddress;
+        deadline = 0;
 
         const string payload = ((request.HasBody() == true) ? string(*request.Body<const Web::TextBody>()) : "");
 
@@ -112,8 +202,10 @@ namespace Plugin {
             data.FromString(payload);
 
             if ((data.Device.IsSet() == true) && (data.Configuration.IsSet() == true)) {
+                endpoint = data.Endpoint.Value();
                 address = data.Device.Value();
                 setup = data.Configuration.Value();
+                deadline = data.Deadline.Value();
                 parsed = true;
             }
         }
@@ -123,11 +215,13 @@ namespace Plugin {
         return parsed;
     }
 
-    bool Doofah::ParseKeyCodeBody(const Web::Request& request, Protocol::DeviceAddressType& address, uint32_t& code)
+    bool Doofah::ParseKeyCodeBody(const Web::Request& request, uint8_t& endpoint, Protocol::DeviceAddressType& address, uint32_t& code, uint32_t& deadline)
     {
         bool parsed = false;
 
+        endpoint = 0;
         address = Protocol::InvalidAddress;
+        deadline = 0;
 
         const string payload = ((request.HasBody() == true) ? string(*request.Body<const Web::TextBody>()) : "");
 
@@ -137,7 +231,9 @@ namespace Plugin {
 
             if ((data.Code.IsSet() == true) && (data.Device.IsSet() == true)) {
                 code = data.Code.Value();
+                endpoint = data.Endpoint.Value();
                 address = data.Device.Value();
+                deadline = data.Deadline.Value();
             }
             parsed = true;
         }
@@ -147,11 +243,13 @@ namespace Plugin {
         return parsed;
     }
 
-    bool Doofah::ParseDeviceAddressBody(const Web::Request& request, Protocol::DeviceAddressType& address)
+    bool Doofah::ParseDeviceAddressBody(const Web::Request& request, uint8_t& endpoint, Protocol::DeviceAddressType& address, uint32_t& deadline)
     {
         bool parsed = false;
 
+        endpoint = 0;
         address = Protocol::InvalidAddress;
+        deadline = 0;
 
         const string payload = ((request.HasBody() == true) ? string(*request.Body<const Web::TextBody>()) : "");
 
@@ -160,7 +258,9 @@ namespace Plugin {
             data.FromString(payload);
 
             if (data.Device.IsSet() == true) {
+                endpoint = data.Endpoint.Value();
                 address = data.Device.Value();
+                deadline = data.Deadline.Value();
             }
             parsed = true;
         }
@@ -183,12 +283,14 @@ namespace Plugin {
             result->ErrorCode = Web::STATUS_NOT_IMPLEMENTED;
             result->Message = string(_T("TODO: return config for a specific device."));
         } else {
-            // GET .../Doofah : Get all devices provided by an end-point
-            Thunder::Doofah::SerialCommunicator::DeviceIterator list = _communicator.Devices();
-
+            // GET .../Doofah : Get all devices provided by the end-points
             Core::ProxyType<Web::JSONBodyType<Doofah::DeviceList>> devices(jsonResponseFactoryDevicesList.Element());
 
-            devices->Set(list);
+            for (uint8_t endpoint = 0; endpoint < _endpoints.size(); endpoint++) {
+                Thunder::Doofah::SerialCommunicator::DeviceIterator list = _endpoints[endpoint]->Communicator().Devices();
+
+                devices->Add(endpoint, list);
+            }
 
             result->ErrorCode = Web::STATUS_ACCEPTED;
             result->Message = string((_T("Returned Devices")));
@@ -210,14 +312,17 @@ namespace Plugin {
 
         if (index.IsValid() == true && index.Next() == true) {
             bool pressed = false;
+            uint8_t endpoint = 0;
             Protocol::DeviceAddressType address(Protocol::InvalidAddress);
+            uint32_t deadline = 0;
+            Thunder::Doofah::SerialCommunicator* communicator = nullptr;
     
             // PUT .../Doofah/Press|Release : send a code to the end point
             if (((pressed = (index.Current() == _T("Press"))) == true) || (index.Current() == _T("Release"))) {
                 uint32_t code = 0;
 
-                if (ParseKeyCodeBody(request, address, code) == true) {
-                    if ((address != Protocol::InvalidAddress) && (code != 0) && (commResult = _communicator.KeyEvent(address, pressed, code) == Core::ERROR_NONE)) {
+                if (ParseKeyCodeBody(request, endpoint, address, code, deadline) == true) {
+                    if ((address != Protocol::InvalidAddress) && (code != 0) && ((communicator = Communicator(endpoint)) != nullptr) && (commResult = communicator->KeyEvent(address, pressed, code, true, deadline) == Core::ERROR_NONE)) {
                         result->ErrorCode = Web::STATUS_ACCEPTED;
                         result->Message = string((_T("key is sent")));
                     } else {
@@ -230,8 +335,8 @@ namespace Plugin {
                 }
             } else if (index.Current() == _T("Setup")) {
                 string config;
-                if (ParseSetupBody(request, address, config) == true) {
-                    if ((address != Protocol::InvalidAddress) && (commResult = _communicator.Setup(address, config) == Core::ERROR_NONE)) {
+                if (ParseSetupBody(request, endpoint, address, config, deadline) == true) {
+                    if ((address != Protocol::InvalidAddress) && ((communicator = Communicator(endpoint)) != nullptr) && (commResult = communicator->Setup(address, config, deadline) == Core::ERROR_NONE)) {
                         result->ErrorCode = Web::STATUS_ACCEPTED;
                         result->Message = string((_T("setup ok")));
                     } else {
@@ -243,8 +348,8 @@ namespace Plugin {
                     result->Message = string(_T("No config or/and device address in body"));
                 }
             } else if (index.Current() == _T("Reset")) {
-                if (ParseDeviceAddressBody(request, address) == true) {
-                    if ((address != Protocol::InvalidAddress) && (commResult = _communicator.Reset(address) == Core::ERROR_NONE)) {
+                if (ParseDeviceAddressBody(request, endpoint, address, deadline) == true) {
+                    if ((address != Protocol::InvalidAddress) && ((communicator = Communicator(endpoint)) != nullptr) && (commResult = communicator->Reset(address, deadline) == Core::ERROR_NONE)) {
                         result->ErrorCode = Web::STATUS_ACCEPTED;
                         result->Message = string((_T("reset ok")));
                     } else {
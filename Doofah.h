@@ -39,8 +39,7 @@ namespace Plugin {
 
         Doofah()
             : _skipURL(0)
-            , _communicator()
-            , _sink(*this)
+            , _endpoints()
             , _service(nullptr)
         {
         }
@@ -56,9 +55,9 @@ namespace Plugin {
         END_INTERFACE_MAP
 
     private:
-        bool ParseSetupBody(const Web::Request& request, Protocol::DeviceAddressType& address, string& setup);
-        bool ParseKeyCodeBody(const Web::Request& request, Protocol::DeviceAddressType& address, uint32_t& code);
-        bool ParseDeviceAddressBody(const Web::Request& request, Protocol::DeviceAddressType& address);
+        bool ParseSetupBody(const Web::Request& request, uint8_t& endpoint, Protocol::DeviceAddressType& address, string& setup, uint32_t& deadline);
+        bool ParseKeyCodeBody(const Web::Request& request, uint8_t& endpoint, Protocol::DeviceAddressType& address, uint32_t& code, uint32_t& deadline);
+        bool ParseDeviceAddressBody(const Web::Request& request, uint8_t& endpoint, Protocol::DeviceAddressType& address, uint32_t& deadline);
 
         Core::ProxyType<Web::Response> GetMethod(Core::TextSegmentIterator& index);
         Core::ProxyType<Web::Response> PutMethod(Core::TextSegmentIterator& index, const Web::Request& request);
@@ -70,19 +69,62 @@ namespace Plugin {
             Sink() = delete;
 
         public:
-            Sink(Doofah& parent)
+            Sink(Doofah& parent, const uint8_t endpoint)
                 : _parent(parent)
+                , _endpoint(endpoint)
             {
             }
 
-            void Started()
+            void Started() override
             {
-                TRACE(Trace::Information, ("End-point started!"));
-                _parent.EventStarted();
+                TRACE(Trace::Information, ("End-point %d started!", _endpoint));
+                _parent.EventStarted(_endpoint);
+            }
+            void KeyError(const Protocol::DeviceAddressType address, const uint16_t code, const bool pressed, const Protocol::ResultType result) override
+            {
+                TRACE(Trace::Error, ("Key 0x%04X on device 0x%02X of end-point %d failed", code, address, _endpoint));
+                _parent.EventKeyError(_endpoint, address, code, pressed, result);
+            }
+            void Button() override
+            {
+                TRACE(Trace::Information, ("Button of end-point %d clicked", _endpoint));
+                _parent.EventButton(_endpoint);
             }
 
         private:
             Doofah& _parent;
+            const uint8_t _endpoint;
+        };
+
+        // The link to one endpoint, it does its own I/O and keeps its own device table, so
+        // nothing is shared with the other endpoints.
+        class Endpoint {
+        private:
+            Endpoint() = delete;
+            Endpoint(const Endpoint&) = delete;
+            Endpoint& operator=(const Endpoint&) = delete;
+
+        public:
+            Endpoint(Doofah& parent, const uint8_t index)
+                : _communicator()
+                , _sink(parent, index)
+            {
+            }
+            ~Endpoint() = default;
+
+        public:
+            inline Thunder::Doofah::SerialCommunicator& Communicator()
+            {
+                return (_communicator);
+            }
+            inline Sink& Callback()
+            {
+                return (_sink);
+            }
+
+        private:
+            Thunder::Doofah::SerialCommunicator _communicator;
+            Sink _sink;
         };
 
     public:
@@ -95,8 +137,10 @@ namespace Plugin {
             Config()
                 : Core::JSON::Container()
                 , Connector()
+                , Connectors()
             {
                 Add(_T("connector"), &Connector);
+                Add(_T("connectors"), &Connectors);
             }
             ~Config()
             {
@@ -104,10 +148,412 @@ namespace Plugin {
 
         public:
             Core::JSON::String Connector;
+            // One per endpoint, the endpoints are addressed by their index in here. Wins over connector.
+            Core::JSON::ArrayType<Core::JSON::String> Connectors;
+        };
+
+        class KeyStatistics : public Core::JSON::Container {
+        public:
+            KeyStatistics(const KeyStatistics&) = delete;
+            KeyStatistics& operator=(const KeyStatistics&) = delete;
+
+        public:
+            KeyStatistics()
+                : Core::JSON::Container()
+                , Sent()
+                , Failed()
+                , Dropped()
+            {
+                Add(_T("sent"), &Sent);
+                Add(_T("failed"), &Failed);
+                Add(_T("dropped"), &Dropped);
+            }
+
+            ~KeyStatistics() override = default;
+
+        public:
+            void Set(const Thunder::Doofah::SerialCommunicator::KeyCounters& counters)
+            {
+                Sent = counters.sent;
+                Failed = counters.failed;
+                Dropped = counters.dropped;
+            }
+
+            Core::JSON::DecUInt32 Sent;
+            Core::JSON::DecUInt32 Failed;
+            Core::JSON::DecUInt32 Dropped;
         };
 
-        static void FillDeviceInfo(const Payload::Device& info, DeviceEntry& entry)
+        class EndpointInfo : public Core::JSON::Container {
+        public:
+            EndpointInfo(const EndpointInfo&) = delete;
+            EndpointInfo& operator=(const EndpointInfo&) = delete;
+
+        public:
+            EndpointInfo()
+                : Core::JSON::Container()
+                , Version()
+                , Build()
+                , MaxPayload()
+                , Operations()
+                , Baudrates()
+                , Baudrate()
+                , Framing()
+                , Checksums()
+                , Checksum()
+                , Keys()
+            {
+                Add(_T("version"), &Version);
+                Add(_T("build"), &Build);
+                Add(_T("maxpayload"), &MaxPayload);
+                Add(_T("operations"), &Operations);
+                Add(_T("baudrates"), &Baudrates);
+                Add(_T("baudrate"), &Baudrate);
+                Add(_T("framing"), &Framing);
+                Add(_T("checksums"), &Checksums);
+                Add(_T("checksum"), &Checksum);
+                Add(_T("keys"), &Keys);
+            }
+
+            ~EndpointInfo() override = default;
+
+        public:
+            void Set(const Thunder::Doofah::SerialCommunicator::Capabilities& capabilities)
+            {
+                Baudrate = capabilities.baudrate;
+                Framing = capabilities.framing;
+                Checksum = capabilities.checksum;
+
+                if (capabilities.version > 0) {
+                    Version = capabilities.version;
+                    Build = capabilities.build;
+                    MaxPayload = capabilities.payload;
+
+                    for (uint8_t operation = 0; operation < 32; operation++) {
+                        if (capabilities.IsSupported(static_cast<Protocol::OperationType>(operation)) == true) {
+                            Operations.Add() = static_cast<Protocol::OperationType>(operation);
+                        }
+                    }
+                    for (const uint32_t rate : capabilities.baudrates) {
+                        Baudrates.Add() = rate;
+                    }
+                    for (const Protocol::ChecksumType type : { Protocol::ChecksumType::CRC8, Protocol::ChecksumType::CRC32C }) {
+                        if (capabilities.IsSupported(type) == true) {
+                            Checksums.Add() = type;
+                        }
+                    }
+                }
+            }
+
+            Core::JSON::DecUInt8 Version;
+            Core::JSON::String Build;
+            Core::JSON::DecUInt8 MaxPayload;
+            Core::JSON::ArrayType<Core::JSON::EnumType<Protocol::OperationType>> Operations;
+            Core::JSON::ArrayType<Core::JSON::DecUInt32> Baudrates;
+            Core::JSON::DecUInt32 Baudrate;
+            Core::JSON::EnumType<Protocol::FramingType> Framing;
+            Core::JSON::ArrayType<Core::JSON::EnumType<Protocol::ChecksumType>> Checksums;
+            Core::JSON::EnumType<Protocol::ChecksumType> Checksum;
+            KeyStatistics Keys;
+        };
+
+        class HistogramInfo : public Core::JSON::Container {
+        public:
+            HistogramInfo()
+                : Core::JSON::Container()
+            {
+                Init();
+            }
+            HistogramInfo(const HistogramInfo& copy)
+                : Core::JSON::Container()
+                , Count(copy.Count)
+                , Average(copy.Average)
+                , Max(copy.Max)
+                , P50(copy.P50)
+                , P99(copy.P99)
+                , Buckets(copy.Buckets)
+            {
+                Init();
+            }
+            HistogramInfo& operator=(const HistogramInfo& rhs)
+            {
+                Count = rhs.Count;
+                Average = rhs.Average;
+                Max = rhs.Max;
+                P50 = rhs.P50;
+                P99 = rhs.P99;
+                Buckets = rhs.Buckets;
+                return (*this);
+            }
+
+            ~HistogramInfo() override = default;
+
+        private:
+            void Init()
+            {
+                Add(_T("count"), &Count);
+                Add(_T("average"), &Average);
+                Add(_T("max"), &Max);
+                Add(_T("p50"), &P50);
+                Add(_T("p99"), &P99);
+                Add(_T("buckets"), &Buckets);
+            }
+
+        public:
+            void Set(const Thunder::Doofah::SerialCommunicator::Histogram& histogram)
+            {
+                Count = histogram.Count();
+                Average = histogram.Average();
+                Max = histogram.Max();
+                P50 = histogram.Percentile(50);
+                P99 = histogram.Percentile(99);
+
+                // Up to the last bucket in use, bucket n counts durations below 2^(n+1) microseconds.
+                uint8_t used = Thunder::Doofah::SerialCommunicator::Histogram::Buckets;
+
+                while ((used > 0) && (histogram.Bucket(used - 1) == 0)) {
+                    used--;
+                }
+                for (uint8_t index = 0; index < used; index++) {
+                    Buckets.Add() = histogram.Bucket(index);
+                }
+            }
+
+            Core::JSON::DecUInt32 Count;
+            Core::JSON::DecUInt32 Average;
+            Core::JSON::DecUInt32 Max;
+            Core::JSON::DecUInt32 P50;
+            Core::JSON::DecUInt32 P99;
+            Core::JSON::ArrayType<Core::JSON::DecUInt32> Buckets;
+        };
+
+        class LatencyEntry : public Core::JSON::Container {
+        public:
+            LatencyEntry()
+                : Core::JSON::Container()
+            {
+                Init();
+            }
+            LatencyEntry(const LatencyEntry& copy)
+                : Core::JSON::Container()
+                , Operation(copy.Operation)
+                , Device(copy.Device)
+                , Queued(copy.Queued)
+                , Line(copy.Line)
+                , Endpoint(copy.Endpoint)
+                , Handover(copy.Handover)
+                , Total(copy.Total)
+            {
+                Init();
+            }
+            LatencyEntry& operator=(const LatencyEntry& rhs)
+            {
+                Operation = rhs.Operation;
+                Device = rhs.Device;
+                Queued = rhs.Queued;
+                Line = rhs.Line;
+                Endpoint = rhs.Endpoint;
+                Handover = rhs.Handover;
+                Total = rhs.Total;
+                return (*this);
+            }
+
+            ~LatencyEntry() override = default;
+
+        private:
+            void Init()
+            {
+                Add(_T("operation"), &Operation);
+                Add(_T("device"), &Device);
+                Add(_T("queued"), &Queued);
+                Add(_T("line"), &Line);
+                Add(_T("endpoint"), &Endpoint);
+                Add(_T("handover"), &Handover);
+                Add(_T("total"), &Total);
+            }
+
+        public:
+            void Set(const Thunder::Doofah::SerialCommunicator::Breakdown& breakdown)
+            {
+                Queued.Set(breakdown.queued);
+                Line.Set(breakdown.line);
+                Endpoint.Set(breakdown.endpoint);
+                Handover.Set(breakdown.device);
+                Total.Set(breakdown.total);
+            }
+
+            Core::JSON::EnumType<Protocol::OperationType> Operation;
+            Core::JSON::HexUInt8 Device;
+            HistogramInfo Queued;
+            HistogramInfo Line;
+            HistogramInfo Endpoint;
+            HistogramInfo Handover; // Time spent in the device
+            HistogramInfo Total;
+        };
+
+        class LatencyInfo : public Core::JSON::Container {
+        public:
+            LatencyInfo(const LatencyInfo&) = delete;
+            LatencyInfo& operator=(const LatencyInfo&) = delete;
+
+        public:
+            LatencyInfo()
+                : Core::JSON::Container()
+                , Operations()
+                , Devices()
+            {
+                Add(_T("operations"), &Operations);
+                Add(_T("devices"), &Devices);
+            }
+
+            ~LatencyInfo() override = default;
+
+        public:
+            void Set(const Thunder::Doofah::SerialCommunicator::OperationLatencies& operations, const Thunder::Doofah::SerialCommunicator::DeviceLatencies& devices)
+            {
+                for (const auto& entry : operations) {
+                    LatencyEntry& element(Operations.Add());
+
+                    element.Operation = entry.first;
+                    element.Set(entry.second);
+                }
+                for (const auto& entry : devices) {
+                    LatencyEntry& element(Devices.Add());
+
+                    element.Device = entry.first;
+                    element.Set(entry.second);
+                }
+            }
+
+            Core::JSON::ArrayType<LatencyEntry> Operations;
+            Core::JSON::ArrayType<LatencyEntry> Devices;
+        };
+
+        class LaneInfo : public Core::JSON::Container {
+        public:
+            LaneInfo(const LaneInfo&) = delete;
+            LaneInfo& operator=(const LaneInfo&) = delete;
+
+        public:
+            LaneInfo()
+                : Core::JSON::Container()
+                , Depth()
+                , Peak()
+                , Frames()
+                , Passed()
+            {
+                Add(_T("depth"), &Depth);
+                Add(_T("peak"), &Peak);
+                Add(_T("frames"), &Frames);
+                Add(_T("passed"), &Passed);
+            }
+
+            ~LaneInfo() override = default;
+
+        public:
+            void Set(const Thunder::Doofah::SerialCommunicator::LaneStatistics& lane)
+            {
+                Depth = lane.depth;
+                Peak = lane.peak;
+                Frames = lane.frames;
+                Passed = lane.passed;
+            }
+
+            Core::JSON::DecUInt32 Depth; // Requests waiting for the window or the line
+            Core::JSON::DecUInt32 Peak;
+            Core::JSON::DecUInt32 Frames;
+            Core::JSON::DecUInt32 Passed; // Times a waiting request was passed by the other lane
+        };
+
+        class LinkInfo : public Core::JSON::Container {
+        public:
+            LinkInfo(const LinkInfo&) = delete;
+            LinkInfo& operator=(const LinkInfo&) = delete;
+
+        public:
+            LinkInfo()
+                : Core::JSON::Container()
+                , RoundTrip()
+                , RoundTripP99()
+                , Samples()
+                , Pings()
+                , LostPings()
+                , Exchanges()
+                , Timeouts()
+                , Corrupted()
+                , Resyncs()
+                , Retransmits()
+                , Recovered()
+                , Interactive()
+                , Background()
+                , TimeoutRate()
+                , ErrorRate()
+            {
+                Add(_T("roundtrip"), &RoundTrip);
+                Add(_T("roundtripp99"), &RoundTripP99);
+                Add(_T("samples"), &Samples);
+                Add(_T("pings"), &Pings);
+                Add(_T("lostpings"), &LostPings);
+                Add(_T("exchanges"), &Exchanges);
+                Add(_T("timeouts"), &Timeouts);
+                Add(_T("corrupted"), &Corrupted);
+                Add(_T("resyncs"), &Resyncs);
+                Add(_T("retransmits"), &Retransmits);
+                Add(_T("recovered"), &Recovered);
+                Add(_T("interactive"), &Interactive);
+                Add(_T("background"), &Background);
+                Add(_T("timeoutrate"), &TimeoutRate);
+                Add(_T("errorrate"), &ErrorRate);
+            }
+
+            ~LinkInfo() override = default;
+
+        public:
+            void Set(const Thunder::Doofah::SerialCommunicator::LinkStatistics& link)
+            {
+                RoundTrip = link.roundTripMean;
+                RoundTripP99 = link.roundTripP99;
+                Samples = link.samples;
+                Pings = link.pings;
+                LostPings = link.lostPings;
+                Exchanges = link.exchanges.exchanges;
+                Timeouts = link.exchanges.timeouts;
+                Corrupted = link.exchanges.corrupted;
+                Resyncs = link.exchanges.resyncs;
+                Retransmits = link.exchanges.retransmits;
+                Recovered = link.exchanges.recovered;
+                Interactive.Set(link.exchanges.lanes[SimpleSerial::DataExchange<Thunder::Doofah::SerialLink>::INTERACTIVE]);
+                Background.Set(link.exchanges.lanes[SimpleSerial::DataExchange<Thunder::Doofah::SerialLink>::BACKGROUND]);
+
+                if (link.exchanges.exchanges > 0) {
+                    TimeoutRate = (100.0f * link.exchanges.timeouts) / link.exchanges.exchanges;
+                    ErrorRate = (100.0f * link.exchanges.corrupted) / link.exchanges.exchanges;
+                } else {
+                    TimeoutRate = 0.0f;
+                    ErrorRate = 0.0f;
+                }
+            }
+
+            Core::JSON::DecUInt32 RoundTrip; // Mean of the recent pings, in microseconds
+            Core::JSON::DecUInt32 RoundTripP99;
+            Core::JSON::DecUInt32 Samples;
+            Core::JSON::DecUInt32 Pings;
+            Core::JSON::DecUInt32 LostPings;
+            Core::JSON::DecUInt32 Exchanges;
+            Core::JSON::DecUInt32 Timeouts;
+            Core::JSON::DecUInt32 Corrupted;
+            Core::JSON::DecUInt32 Resyncs;
+            Core::JSON::DecUInt32 Retransmits; // Requests sent again
+            Core::JSON::DecUInt32 Recovered; // Exchanges saved by a retransmission
+            LaneInfo Interactive; // Key actions
+            LaneInfo Background; // Configuration, discovery and link control
+            Core::JSON::Float TimeoutRate; // Percentage of the exchanges
+            Core::JSON::Float ErrorRate; // Percentage of the exchanges
+        };
+
+        static void FillDeviceInfo(const uint8_t endpoint, const Payload::Device& info, DeviceEntry& entry)
         {
+            entry.Endpoint = endpoint;
             entry.Device = info.address;
             entry.Peripheral = info.peripheral;
         }
@@ -128,14 +574,14 @@ namespace Plugin {
             ~DeviceList() override = default;
 
         public:
-            void Set(Thunder::Doofah::SerialCommunicator::DeviceIterator& list)
+            void Add(const uint8_t endpoint, Thunder::Doofah::SerialCommunicator::DeviceIterator& list)
             {
                 list.Reset(0);
 
                 while (list.Next() == true) {
                     DeviceEntry device;
 
-                    Doofah::FillDeviceInfo(list.Current(), device);
+                    Doofah::FillDeviceInfo(endpoint, list.Current(), device);
 
                     Devices.Add(device);
                 }
@@ -161,22 +607,104 @@ namespace Plugin {
         void JSONRPCRegister();
         void JSONRPCUnregister();
 
-        uint32_t JSONRPCDevices(Core::JSON::ArrayType<DeviceEntry>& response) const;
+        // The index of these properties is the endpoint, the first one without.
+        uint32_t JSONRPCLatency(const string& index, LatencyInfo& response) const;
+        uint32_t JSONRPCLink(const string& index, LinkInfo& response) const;
 
-        uint32_t JSONRPCSetup(const SetupInfo& params);
-        uint32_t JSONRPCReset(const DeviceInfo& params);
+        // These answer through Response() once the endpoint did, no worker thread waits for it.
+        uint32_t JSONRPCDevices(const Core::JSONRPC::Context& context);
+        uint32_t JSONRPCLinkTest(const Core::JSONRPC::Context& context, const LinkTestInfo& params);
+        uint32_t JSONRPCTransfer(const Core::JSONRPC::Context& context, const TransferInfo& params);
+        uint32_t JSONRPCReplay(const Core::JSONRPC::Context& context, const ReplayInfo& params);
+        uint32_t JSONRPCSetup(const Core::JSONRPC::Context& context, const SetupInfo& params);
+        uint32_t JSONRPCReset(const Core::JSONRPC::Context& context, const DeviceInfo& params);
 
-        uint32_t JSONRPCKeyPress(const KeyInfo& params);
-        uint32_t JSONRPCKeyRelease(const KeyInfo& params);
+        uint32_t JSONRPCKeyPress(const Core::JSONRPC::Context& context, const KeyInfo& params);
+        uint32_t JSONRPCKeyRelease(const Core::JSONRPC::Context& context, const KeyInfo& params);
+        uint32_t JSONRPCSequence(const Core::JSONRPC::Context& context, const SequenceInfo& params);
+        uint32_t JSONRPCKeyBatch(const Core::JSONRPC::Context& context, const KeyBatchInfo& params);
 
         void EventKeyPressed(const string& id, const bool& pressed);
 
-        void EventStarted();
+        uint32_t KeyAction(const Core::JSONRPC::Context& context, const KeyInfo& params, const bool pressed);
+        void Respond(const Core::JSONRPC::Context& context, const uint32_t result);
+
+        void EventKeyError(const uint8_t endpoint, const Protocol::DeviceAddressType address, const uint16_t code, const bool pressed, const Protocol::ResultType result);
+
+        void EventStarted(const uint8_t endpoint);
+
+        void EventButton(const uint8_t endpoint);
 
     private:
+        // Tells Thunder not to answer a handler, the answer follows through Response().
+        static constexpr uint32_t AsyncResponse = ~0;
+
+        // The device tables of all endpoints, collected as the endpoints answer.
+        class DeviceTables {
+        public:
+            DeviceTables() = delete;
+            DeviceTables(const DeviceTables&) = delete;
+            DeviceTables& operator=(const DeviceTables&) = delete;
+
+            DeviceTables(const uint8_t endpoints)
+                : _lock()
+                , _tables(endpoints)
+                , _pending(endpoints)
+            {
+            }
+            ~DeviceTables() = default;
+
+        public:
+            // True for the table that completes the set.
+            bool Add(const uint8_t endpoint, Thunder::Doofah::SerialCommunicator::DeviceIterator& table)
+            {
+                _lock.Lock();
+
+                _tables[endpoint] = std::move(table);
+                const bool complete = (--_pending == 0);
+
+                _lock.Unlock();
+
+                return (complete);
+            }
+            std::vector<Thunder::Doofah::SerialCommunicator::DeviceIterator>& Tables()
+            {
+                return (_tables);
+            }
+
+        private:
+            Core::CriticalSection _lock;
+            std::vector<Thunder::Doofah::SerialCommunicator::DeviceIterator> _tables;
+            uint8_t _pending;
+        };
+
+        // Null for an endpoint the plugin does not have.
+        Thunder::Doofah::SerialCommunicator* Communicator(const uint8_t endpoint) const
+        {
+            return ((endpoint < _endpoints.size()) ? &(_endpoints[endpoint]->Communicator()) : nullptr);
+        }
+        // The endpoint in the index of a property, the first one without.
+        Thunder::Doofah::SerialCommunicator* Communicator(const string& index) const
+        {
+            Thunder::Doofah::SerialCommunicator* result(nullptr);
+
+            if (index.empty() == true) {
+                result = Communicator(0);
+            } else {
+                char* end(nullptr);
+                const unsigned long endpoint(std::strtoul(index.c_str(), &end, 10));
+
+                if ((*end == '\0') && (endpoint < _endpoints.size())) {
+                    result = Communicator(static_cast<uint8_t>(endpoint));
+                }
+            }
+
+            return (result);
+        }
+
         uint8_t _skipURL;
-        Thunder::Doofah::SerialCommunicator _communicator;
-        Sink _sink;
+        // Only changes in Initialize() and Deinitialize(), the endpoints are used without a lock.
+        std::vector<std::unique_ptr<Endpoint>> _endpoints;
         PluginHost::IShell* _service;
     };
 } // namespace Plugin
@@ -30,39 +30,136 @@ namespace Plugin {
     // Registration
     void Doofah::JSONRPCRegister()
     {
-        Property<Core::JSON::ArrayType<DeviceEntry>>(_T("devices"), &Doofah::JSONRPCDevices, nullptr, this);
+        Register<void, void>(_T("devices"), &Doofah::JSONRPCDevices, this);
+        Property<LatencyInfo>(_T("latency"), &Doofah::JSONRPCLatency, nullptr, this);
+        Property<LinkInfo>(_T("link"), &Doofah::JSONRPCLink, nullptr, this);
         Register<SetupInfo, void>(_T("setup"), &Doofah::JSONRPCSetup, this);
         Register<DeviceInfo, void>(_T("reset"), &Doofah::JSONRPCReset, this);
         Register<KeyInfo, void>(_T("press"), &Doofah::JSONRPCKeyPress, this);
         Register<KeyInfo, void>(_T("release"), &Doofah::JSONRPCKeyRelease, this);
+        Register<SequenceInfo, void>(_T("sequence"), &Doofah::JSONRPCSequence, this);
+        Register<TransferInfo, void>(_T("transfer"), &Doofah::JSONRPCTransfer, this);
+        Register<LinkTestInfo, void>(_T("linktest"), &Doofah::JSONRPCLinkTest, this);
+        Register<ReplayInfo, void>(_T("replay"), &Doofah::JSONRPCReplay, this);
+        Register<KeyBatchInfo, void>(_T("pressbatch"), &Doofah::JSONRPCKeyBatch, this);
     }
     void Doofah::JSONRPCUnregister()
     {
         Unregister(_T("devices"));
+        Unregister(_T("latency"));
+        Unregister(_T("link"));
+        Unregister(_T("linktest"));
         Unregister(_T("setup"));
         Unregister(_T("reset"));
         Unregister(_T("release"));
+        Unregister(_T("replay"));
         Unregister(_T("press"));
+        Unregister(_T("pressbatch"));
+        Unregister(_T("sequence"));
+        Unregister(_T("transfer"));
     }
 
-    uint32_t Doofah::JSONRPCKeyPress(const KeyInfo& params)
+    uint32_t Doofah::JSONRPCKeyPress(const Core::JSONRPC::Context& context, const KeyInfo& params)
+    {
+        return KeyAction(context, params, true);
+    }
+
+    uint32_t Doofah::JSONRPCKeyRelease(const Core::JSONRPC::Context& context, const KeyInfo& params)
+    {
+        return KeyAction(context, params, false);
+    }
+
+    uint32_t Doofah::KeyAction(const Core::JSONRPC::Context& context, const KeyInfo& params, const bool pressed)
     {
         uint32_t result = Core::ERROR_NONE;
+        Thunder::Doofah::SerialCommunicator* communicator(Communicator(params.Endpoint.Value()));
 
-        if ((params.Device.IsSet() == true) && (params.Code.IsSet() == true)) {
-            result = _communicator.KeyEvent(params.Device.Value(), true, params.Code.Value());
+        if ((params.Device.IsSet() == false) || (params.Code.IsSet() == false)) {
+            result = Core::ERROR_BAD_REQUEST;
+        } else if (communicator == nullptr) {
+            result = Core::ERROR_UNKNOWN_KEY;
+        } else if ((params.Acknowledge.IsSet() == true) && (params.Acknowledge.Value() == false)) {
+            result = communicator->KeyEvent(params.Device.Value(), pressed, params.Code.Value(), false, params.Deadline.Value());
+        } else {
+            result = communicator->KeyEvent(params.Device.Value(), pressed, params.Code.Value(), [this, context](const uint32_t outcome) {
+                Respond(context, outcome);
+            }, params.Deadline.Value());
+
+            if (result == Core::ERROR_NONE) {
+                result = AsyncResponse;
+            }
+        }
+
+        return result;
+    }
+
+    uint32_t Doofah::JSONRPCSequence(const Core::JSONRPC::Context& context, const SequenceInfo& params)
+    {
+        uint32_t result = Core::ERROR_NONE;
+
+        std::vector<Payload::SequenceStep> steps;
+
+        auto index(params.Steps.Elements());
+
+        while ((result == Core::ERROR_NONE) && (index.Next() == true)) {
+            const SequenceStepEntry& entry(index.Current());
+
+            if ((entry.Action.IsSet() == false) || ((entry.Action.Value() == Payload::SequenceAction::DELAY) ? (entry.Duration.IsSet() == false) : (entry.Code.IsSet() == false))) {
+                result = Core::ERROR_BAD_REQUEST;
+            } else {
+                Payload::SequenceStep step;
+
+                step.action = entry.Action.Value();
+                step.value = (step.action == Payload::SequenceAction::DELAY) ? entry.Duration.Value() : entry.Code.Value();
+
+                steps.push_back(step);
+            }
+        }
+
+        Thunder::Doofah::SerialCommunicator* communicator(Communicator(params.Endpoint.Value()));
+
+        if ((result == Core::ERROR_NONE) && (params.Device.IsSet() == true) && (steps.empty() == false)) {
+            result = (communicator != nullptr) ? communicator->Sequence(params.Device.Value(), steps, [this, context](const uint32_t outcome) {
+                Respond(context, outcome);
+            }, params.Deadline.Value()) : Core::ERROR_UNKNOWN_KEY;
+
+            if (result == Core::ERROR_NONE) {
+                result = AsyncResponse;
+            }
         } else {
             result = Core::ERROR_BAD_REQUEST;
         }
+
         return result;
     }
 
-    uint32_t Doofah::JSONRPCKeyRelease(const KeyInfo& params)
+    uint32_t Doofah::JSONRPCTransfer(const Core::JSONRPC::Context& context, const TransferInfo& params)
     {
         uint32_t result = Core::ERROR_NONE;
+        Thunder::Doofah::SerialCommunicator* communicator(Communicator(params.Endpoint.Value()));
+
+        if (communicator == nullptr) {
+            result = Core::ERROR_UNKNOWN_KEY;
+        } else if ((params.Device.IsSet() == true) && (params.File.IsSet() == true)) {
+            result = communicator->Transfer(params.Device.Value(), params.File.Value(), [this, context](const uint32_t outcome, const Thunder::Doofah::SerialCommunicator::TransferReport& report) {
+                if (outcome == Core::ERROR_NONE) {
+                    TransferResultData response;
 
-        if ((params.Device.IsSet() == true) && (params.Code.IsSet() == true)) {
-            result = _communicator.KeyEvent(params.Device.Value(), false, params.Code.Value());
+                    response.Size = report.size;
+                    response.Sent = report.sent;
+                    response.Resumes = report.resumes;
+                    response.Duration = report.duration;
+                    response.Throughput = report.Throughput();
+
+                    Response(context, response);
+                } else {
+                    Respond(context, outcome);
+                }
+            });
+
+            if (result == Core::ERROR_NONE) {
+                result = AsyncResponse;
+            }
         } else {
             result = Core::ERROR_BAD_REQUEST;
         }
@@ -70,12 +167,147 @@ namespace Plugin {
         return result;
     }
 
-    uint32_t Doofah::JSONRPCSetup(const SetupInfo& params)
+    uint32_t Doofah::JSONRPCLinkTest(const Core::JSONRPC::Context& context, const LinkTestInfo& params)
+    {
+        uint32_t result = Core::ERROR_NONE;
+        Thunder::Doofah::SerialCommunicator* communicator(Communicator(params.Endpoint.Value()));
+
+        if (communicator == nullptr) {
+            result = Core::ERROR_UNKNOWN_KEY;
+        } else {
+            result = communicator->LinkTest(params.Length.Value(), params.Size.Value(), [this, context](const uint32_t outcome, const Thunder::Doofah::SerialCommunicator::LinkTestReport& report) {
+                if (outcome == Core::ERROR_NONE) {
+                    LinkTestResultData response;
+
+                    response.Frames = report.frames;
+                    response.Failed = report.failed;
+                    response.Bytes = report.bytes;
+                    response.Duration = report.duration;
+                    response.Throughput = report.Throughput();
+
+                    Response(context, response);
+                } else {
+                    Respond(context, outcome);
+                }
+            });
+
+            if (result == Core::ERROR_NONE) {
+                result = AsyncResponse;
+            }
+        }
+
+        return result;
+    }
+
+    uint32_t Doofah::JSONRPCReplay(const Core::JSONRPC::Context& context, const ReplayInfo& params)
+    {
+        uint32_t result = Core::ERROR_NONE;
+        Thunder::Doofah::SerialCommunicator* communicator(Communicator(params.Endpoint.Value()));
+
+        if (communicator == nullptr) {
+            result = Core::ERROR_UNKNOWN_KEY;
+        } else if (params.File.IsSet() == true) {
+            result = communicator->Replay(params.File.Value(), params.Speed.Value(), [this, context](const uint32_t outcome, const Thunder::Doofah::SerialCommunicator::ReplayReport& report) {
+                if (outcome == Core::ERROR_NONE) {
+                    ReplayResultData response;
+
+                    response.Received = report.received;
+                    response.Posted = report.posted;
+                    response.Retransmitted = report.retransmitted;
+                    response.Answered = report.answered;
+                    response.Unanswered = report.unanswered;
+                    response.Diverged = report.diverged;
+                    response.Duration = report.duration;
+
+                    Response(context, response);
+                } else {
+                    Respond(context, outcome);
+                }
+            });
+
+            if (result == Core::ERROR_NONE) {
+                result = AsyncResponse;
+            }
+        } else {
+            result = Core::ERROR_BAD_REQUEST;
+        }
+
+        return result;
+    }
+
+    uint32_t Doofah::JSONRPCKeyBatch(const Core::JSONRPC::Context& context, const KeyBatchInfo& params)
+    {
+        uint32_t result = Core::ERROR_NONE;
+
+        std::vector<Payload::KeyBatchEvent> events;
+
+        auto index(params.Keys.Elements());
+
+        while ((result == Core::ERROR_NONE) && (index.Next() == true)) {
+            const KeyBatchEntry& entry(index.Current());
+
+            if ((entry.Device.IsSet() == true) && (entry.Code.IsSet() == true)) {
+                Payload::KeyBatchEvent event;
+
+                event.address = entry.Device.Value();
+                event.event.pressed = ((entry.Pressed.IsSet() == false) || (entry.Pressed.Value() == true)) ? Payload::Action::PRESSED : Payload::Action::RELEASED;
+                event.event.code = static_cast<uint16_t>(entry.Code.Value());
+
+                events.push_back(event);
+            } else {
+                result = Core::ERROR_BAD_REQUEST;
+            }
+        }
+
+        Thunder::Doofah::SerialCommunicator* communicator(Communicator(params.Endpoint.Value()));
+
+        if ((result == Core::ERROR_NONE) && (events.empty() == true)) {
+            result = Core::ERROR_BAD_REQUEST;
+        } else if ((result == Core::ERROR_NONE) && (communicator == nullptr)) {
+            result = Core::ERROR_UNKNOWN_KEY;
+        }
+
+        if (result == Core::ERROR_NONE) {
+            const size_t count = events.size();
+
+            result = communicator->KeyEvents(events, [this, context, count](const uint32_t outcome, const std::vector<Protocol::ResultType>& results) {
+                // Per key failures are reported in the response, only link failures fail the call.
+                if (((outcome == Core::ERROR_NONE) || (outcome == Core::ERROR_GENERAL)) && (results.size() == count)) {
+                    Core::JSON::ArrayType<Core::JSON::EnumType<Protocol::ResultType>> response;
+
+                    for (const Protocol::ResultType& entry : results) {
+                        response.Add() = entry;
+                    }
+
+                    Response(context, response);
+                } else {
+                    Respond(context, outcome);
+                }
+            }, params.Deadline.Value());
+
+            if (result == Core::ERROR_NONE) {
+                result = AsyncResponse;
+            }
+        }
+
+        return result;
+    }
+
+    uint32_t Doofah::JSONRPCSetup(const Core::JSONRPC::Context& context, const SetupInfo& params)
     {
         uint32_t result = Core::ERROR_NONE;
+        Thunder::Doofah::SerialCommunicator* communicator(Communicator(params.Endpoint.Value()));
+
+        if (communicator == nullptr) {
+            result = Core::ERROR_UNKNOWN_KEY;
+        } else if ((params.Device.IsSet() == true) && (params.Configuration.IsSet() == true)) {
+            result = communicator->Setup(params.Device.Value(), params.Configuration.Value(), [this, context](const uint32_t outcome) {
+                Respond(context, outcome);
+            }, params.Deadline.Value());
 
-        if ((params.Device.IsSet() == true) && (params.Configuration.IsSet() == true)) {
-            result = _communicator.Setup(params.Device.Value(), params.Configuration.Value());
+            if (result == Core::ERROR_NONE) {
+                result = AsyncResponse;
+            }
         } else {
             result = Core::ERROR_BAD_REQUEST;
         }
@@ -83,12 +315,21 @@ namespace Plugin {
         return result;
     }
 
-    uint32_t Doofah::JSONRPCReset(const DeviceInfo& params)
+    uint32_t Doofah::JSONRPCReset(const Core::JSONRPC::Context& context, const DeviceInfo& params)
     {
         uint32_t result = Core::ERROR_NONE;
+        Thunder::Doofah::SerialCommunicator* communicator(Communicator(params.Endpoint.Value()));
 
-        if (params.Device.IsSet() == true) {
-            result = _communicator.Reset(params.Device.Value());
+        if (communicator == nullptr) {
+            result = Core::ERROR_UNKNOWN_KEY;
+        } else if (params.Device.IsSet() == true) {
+            result = communicator->Reset(params.Device.Value(), [this, context](const uint32_t outcome) {
+                Respond(context, outcome);
+            }, params.Deadline.Value());
+
+            if (result == Core::ERROR_NONE) {
+                result = AsyncResponse;
+            }
         } else {
             result = Core::ERROR_BAD_REQUEST;
         }
@@ -96,20 +337,98 @@ namespace Plugin {
         return result;
     }
 
-    // Property: devices - Available devices
+    // Answer of a handler that returned AsyncResponse, called from the link.
+    void Doofah::Respond(const Core::JSONRPC::Context& context, const uint32_t result)
+    {
+        if (result == Core::ERROR_NONE) {
+            Core::JSON::String nothing;
+            nothing.Null(true);
+
+            Response(context, nothing);
+        } else {
+            Core::JSONRPC::Error error;
+            error.SetError(result);
+
+            Response(context, error);
+        }
+    }
+
+    // Method: devices - Available devices, of all endpoints
     // Return codes:
     //  - ERROR_NONE: Success
-    uint32_t Doofah::JSONRPCDevices(Core::JSON::ArrayType<DeviceEntry>& response) const
+    uint32_t Doofah::JSONRPCDevices(const Core::JSONRPC::Context& context)
     {
-        Thunder::Doofah::SerialCommunicator::DeviceIterator list = _communicator.Devices();
+        ASSERT(_endpoints.empty() == false);
+
+        std::shared_ptr<DeviceTables> tables(std::make_shared<DeviceTables>(static_cast<uint8_t>(_endpoints.size())));
+
+        // Tables at hand answer right away, the others once their endpoint did.
+        for (uint8_t endpoint = 0; endpoint < _endpoints.size(); endpoint++) {
+            _endpoints[endpoint]->Communicator().Devices([this, context, tables, endpoint](const uint32_t result, Thunder::Doofah::SerialCommunicator::DeviceIterator& list) {
+                if (result != Core::ERROR_NONE) {
+                    TRACE(Trace::Error, ("Reading the devices of endpoint %d failed: %d", endpoint, result));
+                }
+
+                if (tables->Add(endpoint, list) == true) {
+                    Core::JSON::ArrayType<DeviceEntry> response;
+
+                    for (uint8_t index = 0; index < tables->Tables().size(); index++) {
+                        Thunder::Doofah::SerialCommunicator::DeviceIterator& table(tables->Tables()[index]);
+
+                        while (table.Next() == true) {
+                            DeviceEntry info;
+                            Doofah::FillDeviceInfo(index, table.Current(), info);
+                            response.Add(info);
+                        }
+                    }
 
-        while (list.Next() == true) {
-            DeviceEntry info;
-            Doofah::FillDeviceInfo(list.Current(), info);
-            response.Add(info);
+                    Response(context, response);
+                }
+            });
         }
 
-        return Core::ERROR_NONE;
+        return (AsyncResponse);
+    }
+
+    // Property: latency@endpoint - Time spent per stage of the exchanges, per operation and per device
+    // Return codes:
+    //  - ERROR_NONE: Success
+    //  - ERROR_UNKNOWN_KEY: No such endpoint
+    uint32_t Doofah::JSONRPCLatency(const string& index, LatencyInfo& response) const
+    {
+        const Thunder::Doofah::SerialCommunicator* communicator(Communicator(index));
+        uint32_t result(Core::ERROR_UNKNOWN_KEY);
+
+        if (communicator != nullptr) {
+            Thunder::Doofah::SerialCommunicator::OperationLatencies operations;
+            Thunder::Doofah::SerialCommunicator::DeviceLatencies devices;
+
+            communicator->Latencies(operations, devices);
+
+            response.Set(operations, devices);
+
+            result = Core::ERROR_NONE;
+        }
+
+        return (result);
+    }
+
+    // Property: link@endpoint - Health of the serial link
+    // Return codes:
+    //  - ERROR_NONE: Success
+    //  - ERROR_UNKNOWN_KEY: No such endpoint
+    uint32_t Doofah::JSONRPCLink(const string& index, LinkInfo& response) const
+    {
+        const Thunder::Doofah::SerialCommunicator* communicator(Communicator(index));
+        uint32_t result(Core::ERROR_UNKNOWN_KEY);
+
+        if (communicator != nullptr) {
+            response.Set(communicator->Link());
+
+            result = Core::ERROR_NONE;
+        }
+
+        return (result);
     }
 
     // Event: keypressed - Notifies of a key press/release action
@@ -124,15 +443,40 @@ namespace Plugin {
         });
     }
 
-    // Event: started - Notifies when the endpoint is ready after a (re)start.
-    void Doofah::EventStarted()
+    // Event: keyerror - Notifies of a failed unacknowledged key press/release action
+    void Doofah::EventKeyError(const uint8_t endpoint, const Protocol::DeviceAddressType address, const uint16_t code, const bool pressed, const Protocol::ResultType result)
     {
-        string message("{ \"event\": \"started\" }");
+        KeyerrorParamsData params;
+        params.Endpoint = endpoint;
+        params.Device = address;
+        params.Code = code;
+        params.Pressed = pressed;
+        params.Result = result;
+
+        Notify(_T("keyerror"), params);
+    }
+
+    // Event: started - Notifies when an endpoint is ready after a (re)start.
+    void Doofah::EventStarted(const uint8_t endpoint)
+    {
+        string message("{ \"event\": \"started\", \"endpoint\": " + std::to_string(endpoint) + " }");
         if (_service != nullptr) {
             _service->Notify(message);
         }
 
-        Notify(_T("started"));
+        StartedParamsData params;
+        params.Endpoint = endpoint;
+
+        Notify(_T("started"), params);
+    }
+
+    // Event: button - Notifies when the button on an endpoint is clicked.
+    void Doofah::EventButton(const uint8_t endpoint)
+    {
+        ButtonParamsData params;
+        params.Endpoint = endpoint;
+
+        Notify(_T("button"), params);
     }
 } // namespace Plugin
 } // namespace Thunder
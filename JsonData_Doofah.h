@@ -32,31 +32,292 @@ namespace JsonData {
             KeyInfo()
                 : Core::JSON::Container()
             {
+                Add(_T("endpoint"), &Endpoint);
                 Add(_T("device"), &Device);
                 Add(_T("code"), &Code);
+                Add(_T("acknowledge"), &Acknowledge);
+                Add(_T("deadline"), &Deadline);
             }
 
             KeyInfo(const KeyInfo&) = delete;
             KeyInfo& operator=(const KeyInfo&) = delete;
 
         public:
+            Core::JSON::DecUInt8 Endpoint; // Index of the endpoint in the connectors of the plugin (default: 0)
             Core::JSON::HexUInt8 Device; // Device address
             Core::JSON::DecUInt32 Code; // Key code
+            Core::JSON::Boolean Acknowledge; // Wait for the endpoint to confirm the key (default: true)
+            Core::JSON::DecUInt32 Deadline; // Time allowed in milliseconds, overrides the measured timeout (optional)
         }; // class KeyInfo
 
+        class KeyBatchEntry : public Core::JSON::Container {
+        public:
+            inline KeyBatchEntry()
+                : Core::JSON::Container()
+            {
+                Init();
+            }
+            inline KeyBatchEntry(const KeyBatchEntry& copy)
+                : Core::JSON::Container()
+                , Device(copy.Device)
+                , Code(copy.Code)
+                , Pressed(copy.Pressed)
+            {
+                Init();
+            }
+            KeyBatchEntry& operator=(const KeyBatchEntry& rhs)
+            {
+                Device = rhs.Device;
+                Code = rhs.Code;
+                Pressed = rhs.Pressed;
+                return (*this);
+            }
+
+            ~KeyBatchEntry() override = default;
+
+        private:
+            void Init()
+            {
+                Add(_T("device"), &Device);
+                Add(_T("code"), &Code);
+                Add(_T("pressed"), &Pressed);
+            }
+
+        public:
+            Core::JSON::HexUInt8 Device; // Device address
+            Core::JSON::DecUInt32 Code; // Key code
+            Core::JSON::Boolean Pressed; // Press (true) or release (false) the key
+        }; // class KeyBatchEntry
+
+        class KeyBatchInfo : public Core::JSON::Container {
+        public:
+            KeyBatchInfo()
+                : Core::JSON::Container()
+            {
+                Add(_T("endpoint"), &Endpoint);
+                Add(_T("keys"), &Keys);
+                Add(_T("deadline"), &Deadline);
+            }
+
+            KeyBatchInfo(const KeyBatchInfo&) = delete;
+            KeyBatchInfo& operator=(const KeyBatchInfo&) = delete;
+
+        public:
+            Core::JSON::DecUInt8 Endpoint; // Index of the endpoint in the connectors of the plugin (default: 0)
+            Core::JSON::ArrayType<KeyBatchEntry> Keys; // Key actions, applied in order
+            Core::JSON::DecUInt32 Deadline; // Time allowed for all keys in milliseconds, overrides the measured timeout (optional)
+        }; // class KeyBatchInfo
+
+        class SequenceStepEntry : public Core::JSON::Container {
+        public:
+            inline SequenceStepEntry()
+                : Core::JSON::Container()
+            {
+                Init();
+            }
+            inline SequenceStepEntry(const SequenceStepEntry& copy)
+                : Core::JSON::Container()
+                , Action(copy.Action)
+                , Code(copy.Code)
+                , Duration(copy.Duration)
+            {
+                Init();
+            }
+            SequenceStepEntry& operator=(const SequenceStepEntry& rhs)
+            {
+                Action = rhs.Action;
+                Code = rhs.Code;
+                Duration = rhs.Duration;
+                return (*this);
+            }
+
+            ~SequenceStepEntry() override = default;
+
+        private:
+            void Init()
+            {
+                Add(_T("action"), &Action);
+                Add(_T("code"), &Code);
+                Add(_T("duration"), &Duration);
+            }
+
+        public:
+            Core::JSON::EnumType<SimpleSerial::Payload::SequenceAction> Action; // press, release or delay
+            Core::JSON::DecUInt32 Code; // Key code of a press or release
+            Core::JSON::DecUInt32 Duration; // Duration of a delay in microseconds
+        }; // class SequenceStepEntry
+
+        class SequenceInfo : public Core::JSON::Container {
+        public:
+            SequenceInfo()
+                : Core::JSON::Container()
+            {
+                Add(_T("endpoint"), &Endpoint);
+                Add(_T("device"), &Device);
+                Add(_T("steps"), &Steps);
+                Add(_T("deadline"), &Deadline);
+            }
+
+            SequenceInfo(const SequenceInfo&) = delete;
+            SequenceInfo& operator=(const SequenceInfo&) = delete;
+
+        public:
+            Core::JSON::DecUInt8 Endpoint; // Index of the endpoint in the connectors of the plugin (default: 0)
+            Core::JSON::HexUInt8 Device; // Device address
+            Core::JSON::ArrayType<SequenceStepEntry> Steps; // Steps, timed by the endpoint
+            Core::JSON::DecUInt32 Deadline; // Time allowed including the steps in milliseconds, overrides the measured timeout (optional)
+        }; // class SequenceInfo
+
+        class TransferInfo : public Core::JSON::Container {
+        public:
+            TransferInfo()
+                : Core::JSON::Container()
+            {
+                Add(_T("endpoint"), &Endpoint);
+                Add(_T("device"), &Device);
+                Add(_T("file"), &File);
+            }
+
+            TransferInfo(const TransferInfo&) = delete;
+            TransferInfo& operator=(const TransferInfo&) = delete;
+
+        public:
+            Core::JSON::DecUInt8 Endpoint; // Index of the endpoint in the connectors of the plugin (default: 0)
+            Core::JSON::HexUInt8 Device; // Device address the blob is meant for
+            Core::JSON::String File; // Path of the file to upload
+        }; // class TransferInfo
+
+        class TransferResultData : public Core::JSON::Container {
+        public:
+            TransferResultData()
+                : Core::JSON::Container()
+            {
+                Add(_T("size"), &Size);
+                Add(_T("sent"), &Sent);
+                Add(_T("resumes"), &Resumes);
+                Add(_T("duration"), &Duration);
+                Add(_T("throughput"), &Throughput);
+            }
+
+            TransferResultData(const TransferResultData&) = delete;
+            TransferResultData& operator=(const TransferResultData&) = delete;
+
+        public:
+            Core::JSON::DecUInt32 Size; // Bytes in the blob
+            Core::JSON::DecUInt32 Sent; // Bytes sent, including resent chunks
+            Core::JSON::DecUInt32 Resumes; // Times the transfer resumed from the endpoint offset
+            Core::JSON::DecUInt64 Duration; // Duration in microseconds
+            Core::JSON::DecUInt32 Throughput; // Achieved bytes per second
+        }; // class TransferResultData
+
+        class LinkTestInfo : public Core::JSON::Container {
+        public:
+            LinkTestInfo()
+                : Core::JSON::Container()
+                , Length(65536)
+                , Size(SimpleSerial::Protocol::MaxPayloadSize)
+            {
+                Add(_T("endpoint"), &Endpoint);
+                Add(_T("length"), &Length);
+                Add(_T("size"), &Size);
+            }
+
+            LinkTestInfo(const LinkTestInfo&) = delete;
+            LinkTestInfo& operator=(const LinkTestInfo&) = delete;
+
+        public:
+            Core::JSON::DecUInt8 Endpoint; // Index of the endpoint in the connectors of the plugin (default: 0)
+            Core::JSON::DecUInt32 Length; // Bytes to echo
+            Core::JSON::DecUInt8 Size; // Payload bytes per frame
+        }; // class LinkTestInfo
+
+        class LinkTestResultData : public Core::JSON::Container {
+        public:
+            LinkTestResultData()
+                : Core::JSON::Container()
+            {
+                Add(_T("frames"), &Frames);
+                Add(_T("failed"), &Failed);
+                Add(_T("bytes"), &Bytes);
+                Add(_T("duration"), &Duration);
+                Add(_T("throughput"), &Throughput);
+            }
+
+            LinkTestResultData(const LinkTestResultData&) = delete;
+            LinkTestResultData& operator=(const LinkTestResultData&) = delete;
+
+        public:
+            Core::JSON::DecUInt32 Frames; // Frames sent
+            Core::JSON::DecUInt32 Failed; // Frames that did not come back unaltered
+            Core::JSON::DecUInt32 Bytes; // Bytes that came back unaltered
+            Core::JSON::DecUInt64 Duration; // Duration in microseconds
+            Core::JSON::DecUInt32 Throughput; // Achieved bytes per second
+        }; // class LinkTestResultData
+
+        class ReplayInfo : public Core::JSON::Container {
+        public:
+            ReplayInfo()
+                : Core::JSON::Container()
+                , Speed(1)
+            {
+                Add(_T("endpoint"), &Endpoint);
+                Add(_T("file"), &File);
+                Add(_T("speed"), &Speed);
+            }
+
+            ReplayInfo(const ReplayInfo&) = delete;
+            ReplayInfo& operator=(const ReplayInfo&) = delete;
+
+        public:
+            Core::JSON::DecUInt8 Endpoint; // Index of the endpoint in the connectors of the plugin (default: 0)
+            Core::JSON::String File; // Path of the capture to play back
+            Core::JSON::DecUInt8 Speed; // Divides the original pace, 0 plays as fast as possible (default: 1)
+        }; // class ReplayInfo
+
+        class ReplayResultData : public Core::JSON::Container {
+        public:
+            ReplayResultData()
+                : Core::JSON::Container()
+            {
+                Add(_T("received"), &Received);
+                Add(_T("posted"), &Posted);
+                Add(_T("retransmitted"), &Retransmitted);
+                Add(_T("answered"), &Answered);
+                Add(_T("unanswered"), &Unanswered);
+                Add(_T("diverged"), &Diverged);
+                Add(_T("duration"), &Duration);
+            }
+
+            ReplayResultData(const ReplayResultData&) = delete;
+            ReplayResultData& operator=(const ReplayResultData&) = delete;
+
+        public:
+            Core::JSON::DecUInt32 Received; // Received spans played back
+            Core::JSON::DecUInt32 Posted; // Captured requests sent again
+            Core::JSON::DecUInt32 Retransmitted; // Captured retransmissions, covered by the request they repeat
+            Core::JSON::DecUInt32 Answered; // Requests a captured response completed
+            Core::JSON::DecUInt32 Unanswered; // Requests that got no response in time
+            Core::JSON::DecUInt32 Diverged; // Frames sent other than captured, or captured and not sent
+            Core::JSON::DecUInt32 Duration; // Duration in milliseconds
+        }; // class ReplayResultData
+
         class DeviceInfo : public Core::JSON::Container {
         public:
             DeviceInfo()
                 : Core::JSON::Container()
             {
+                Add(_T("endpoint"), &Endpoint);
                 Add(_T("device"), &Device);
+                Add(_T("deadline"), &Deadline);
             }
 
             DeviceInfo(const DeviceInfo&) = delete;
             DeviceInfo& operator=(const DeviceInfo&) = delete;
 
         public:
+            Core::JSON::DecUInt8 Endpoint; // Index of the endpoint in the connectors of the plugin (default: 0)
             Core::JSON::HexUInt8 Device; // Device 
+            Core::JSON::DecUInt32 Deadline; // Time allowed in milliseconds, overrides the measured timeout (optional)
         }; // class DeviceInfo
 
         class SetupInfo : public Core::JSON::Container {
@@ -64,16 +325,20 @@ namespace JsonData {
             SetupInfo()
                 : Core::JSON::Container()
             {
+                Add(_T("endpoint"), &Endpoint);
                 Add(_T("device"), &Device);
                 Add(_T("configuration"), &Configuration);
+                Add(_T("deadline"), &Deadline);
             }
 
             SetupInfo(const SetupInfo&) = delete;
             SetupInfo& operator=(const SetupInfo&) = delete;
 
         public:
+            Core::JSON::DecUInt8 Endpoint; // Index of the endpoint in the connectors of the plugin (default: 0)
             Core::JSON::HexUInt8 Device; // Device address
             Core::JSON::String Configuration; // Configuration string
+            Core::JSON::DecUInt32 Deadline; // Time allowed in milliseconds, overrides the measured timeout (optional)
         }; // class SetupInfo
 
         class KeypressedParamsData : public Core::JSON::Container {
@@ -91,6 +356,59 @@ namespace JsonData {
             Core::JSON::Boolean Pressed; // Denotes if the key was pressed (true) or released (false)
         }; // class KeypressedParamsData
 
+        class KeyerrorParamsData : public Core::JSON::Container {
+        public:
+            KeyerrorParamsData()
+                : Core::JSON::Container()
+            {
+                Add(_T("endpoint"), &Endpoint);
+                Add(_T("device"), &Device);
+                Add(_T("code"), &Code);
+                Add(_T("pressed"), &Pressed);
+                Add(_T("result"), &Result);
+            }
+
+            KeyerrorParamsData(const KeyerrorParamsData&) = delete;
+            KeyerrorParamsData& operator=(const KeyerrorParamsData&) = delete;
+
+        public:
+            Core::JSON::DecUInt8 Endpoint; // Index of the endpoint in the connectors of the plugin
+            Core::JSON::HexUInt8 Device; // Device address
+            Core::JSON::DecUInt32 Code; // Key code
+            Core::JSON::Boolean Pressed; // Denotes if the key was pressed (true) or released (false)
+            Core::JSON::EnumType<SimpleSerial::Protocol::ResultType> Result; // Reason the endpoint gave for the failure
+        }; // class KeyerrorParamsData
+
+        class StartedParamsData : public Core::JSON::Container {
+        public:
+            StartedParamsData()
+                : Core::JSON::Container()
+            {
+                Add(_T("endpoint"), &Endpoint);
+            }
+
+            StartedParamsData(const StartedParamsData&) = delete;
+            StartedParamsData& operator=(const StartedParamsData&) = delete;
+
+        public:
+            Core::JSON::DecUInt8 Endpoint; // Index of the endpoint in the connectors of the plugin
+        }; // class StartedParamsData
+
+        class ButtonParamsData : public Core::JSON::Container {
+        public:
+            ButtonParamsData()
+                : Core::JSON::Container()
+            {
+                Add(_T("endpoint"), &Endpoint);
+            }
+
+            ButtonParamsData(const ButtonParamsData&) = delete;
+            ButtonParamsData& operator=(const ButtonParamsData&) = delete;
+
+        public:
+            Core::JSON::DecUInt8 Endpoint; // Index of the endpoint in the connectors of the plugin
+        }; // class ButtonParamsData
+
         class ConnectedParamsData : public Core::JSON::Container {
         public:
             ConnectedParamsData()
@@ -115,6 +433,7 @@ namespace JsonData {
             }
             inline DeviceEntry(const DeviceEntry& copy)
                 : Core::JSON::Container()
+                , Endpoint(copy.Endpoint)
                 , Device(copy.Device)
                 , Peripheral(copy.Peripheral)
             {
@@ -122,6 +441,7 @@ namespace JsonData {
             }
             DeviceEntry& operator=(const DeviceEntry& rhs)
             {
+                Endpoint = rhs.Endpoint;
                 Device = rhs.Device;
                 Peripheral = rhs.Peripheral;
                 return (*this);
@@ -132,11 +452,13 @@ namespace JsonData {
         private:
             void Init()
             {
+                Add(_T("endpoint"), &Endpoint);
                 Add(_T("device"), &Device);
                 Add(_T("peripheral"), &Peripheral);
             }
 
         public:
+            Core::JSON::DecUInt8 Endpoint;
             Core::JSON::HexUInt16 Device;
             Core::JSON::EnumType<SimpleSerial::Payload::Peripheral> Peripheral;
         }; // class DeviceEntry
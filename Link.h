@@ -0,0 +1,153 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2022 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "Module.h"
+
+#include "Reactor.h"
+
+namespace Thunder {
+namespace SimpleSerial {
+    // The LINK of a DataExchange that is either a serial port or a stream socket, depending on
+    // the port it is configured with. Addresses ReactorStream::IsAddress() accepts go to the
+    // socket, anything else is taken as a tty for the SERIAL link.
+    template <typename SERIAL>
+    class LinkType {
+    private:
+        template <typename BASE>
+        class Handler : public BASE {
+        public:
+            Handler() = delete;
+            Handler(const Handler<BASE>&) = delete;
+            Handler<BASE>& operator=(const Handler<BASE>&) = delete;
+
+            Handler(LinkType<SERIAL>& parent)
+                : BASE()
+                , _parent(parent)
+            {
+            }
+            ~Handler() override = default;
+
+        protected:
+            void StateChange() override
+            {
+                _parent.StateChange();
+            }
+            uint16_t SendData(uint8_t* dataFrame, const uint16_t maxSendSize) override
+            {
+                return (_parent.SendData(dataFrame, maxSendSize));
+            }
+            uint16_t ReceiveData(uint8_t* dataFrame, const uint16_t receivedSize) override
+            {
+                return (_parent.ReceiveData(dataFrame, receivedSize));
+            }
+
+        private:
+            LinkType<SERIAL>& _parent;
+        };
+
+    public:
+        typedef typename SERIAL::BaudRate BaudRate;
+        typedef typename SERIAL::Parity Parity;
+        typedef typename SERIAL::DataBits DataBits;
+        typedef typename SERIAL::StopBits StopBits;
+        typedef typename SERIAL::FlowControl FlowControl;
+
+        LinkType(const LinkType<SERIAL>&) = delete;
+        LinkType<SERIAL>& operator=(const LinkType<SERIAL>&) = delete;
+
+        LinkType()
+            : _stream(false)
+            , _serialLink(*this)
+            , _streamLink(*this)
+        {
+        }
+        virtual ~LinkType() = default;
+
+    public:
+        // Only to be changed while closed.
+        uint32_t Configuration(const string& port, const BaudRate baudRate, const Parity parity, const DataBits dataBits, const StopBits stopBits, const FlowControl flowControl)
+        {
+            ASSERT(IsOpen() == false);
+
+            _stream = ReactorStream::IsAddress(port);
+
+            return (_stream == true ? _streamLink.Configuration(port) : _serialLink.Configuration(port, baudRate, parity, dataBits, stopBits, flowControl));
+        }
+        // A socket has no line speed of its own, whatever sits on the other end owns it.
+        bool IsStream() const
+        {
+            return (_stream);
+        }
+        uint32_t SetBaudRate(const BaudRate baudRate)
+        {
+            uint32_t result = Core::ERROR_NOT_SUPPORTED;
+
+            if (_stream == false) {
+                result = _serialLink.SetBaudRate(baudRate);
+            }
+
+            return (result);
+        }
+        string RemoteId() const
+        {
+            return (_stream == true ? _streamLink.RemoteId() : _serialLink.RemoteId());
+        }
+        bool IsOpen() const
+        {
+            return (_stream == true ? _streamLink.IsOpen() : _serialLink.IsOpen());
+        }
+        uint32_t Open(const uint32_t waitTime)
+        {
+            return (_stream == true ? _streamLink.Open(waitTime) : _serialLink.Open(waitTime));
+        }
+        uint32_t Close(const uint32_t waitTime)
+        {
+            return (_stream == true ? _streamLink.Close(waitTime) : _serialLink.Close(waitTime));
+        }
+        void Flush()
+        {
+            if (_stream == true) {
+                _streamLink.Flush();
+            } else {
+                _serialLink.Flush();
+            }
+        }
+        void Trigger()
+        {
+            if (_stream == true) {
+                _streamLink.Trigger();
+            } else {
+                _serialLink.Trigger();
+            }
+        }
+
+    protected:
+        virtual void StateChange() = 0;
+        virtual uint16_t SendData(uint8_t* dataFrame, const uint16_t maxSendSize) = 0;
+        virtual uint16_t ReceiveData(uint8_t* dataFrame, const uint16_t receivedSize) = 0;
+
+    private:
+        bool _stream;
+        Handler<SERIAL> _serialLink;
+        Handler<ReactorStream> _streamLink;
+    };
+
+} // namespace SimpleSerial
+} // namespace Thunder
@@ -0,0 +1,722 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2022 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <set>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "Module.h"
+
+#ifndef SIMPLESERIAL_REACTOR_SHARDS
+#define SIMPLESERIAL_REACTOR_SHARDS 2
+#endif
+
+namespace Thunder {
+namespace SimpleSerial {
+    // One thread waiting in epoll for all the links handed to it. Links are spread round robin
+    // over a small, fixed pool of these, so hundreds of links cost a handful of threads.
+    class Reactor : public Core::Thread {
+    public:
+        struct IHandler {
+            virtual ~IHandler() = default;
+
+            // Called on the reactor thread with the epoll events of the registered descriptor.
+            virtual void Handle(const uint32_t events) = 0;
+        };
+
+        static constexpr uint8_t Shards = SIMPLESERIAL_REACTOR_SHARDS;
+        static constexpr uint8_t MaxEvents = 64;
+
+        Reactor(const Reactor&) = delete;
+        Reactor& operator=(const Reactor&) = delete;
+
+        Reactor()
+            : Core::Thread(Core::Thread::DefaultStackSize(), _T("SerialReactor"))
+            , _adminLock()
+            , _dispatchLock()
+            , _epoll(::epoll_create1(EPOLL_CLOEXEC))
+            , _wakeup(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+            , _handlers()
+        {
+            ASSERT(_epoll != -1);
+            ASSERT(_wakeup != -1);
+
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.ptr = nullptr;
+            ::epoll_ctl(_epoll, EPOLL_CTL_ADD, _wakeup, &event);
+
+            Run();
+        }
+        ~Reactor() override
+        {
+            Block();
+
+            const uint64_t value(1);
+            VARIABLE_IS_NOT_USED ssize_t written = ::write(_wakeup, &value, sizeof(value));
+
+            Wait(Core::Thread::BLOCKED | Core::Thread::STOPPED, Core::infinite);
+
+            ::close(_wakeup);
+            ::close(_epoll);
+        }
+
+    public:
+        static Reactor& Instance()
+        {
+            static Reactor pool[Shards];
+            static std::atomic<uint32_t> next(0);
+
+            return (pool[next++ % Shards]);
+        }
+        // The reactor whose thread is the caller, if any.
+        static Reactor*& Current()
+        {
+            static thread_local Reactor* current = nullptr;
+            return (current);
+        }
+
+        uint32_t Register(const int descriptor, IHandler* handler, const uint32_t events)
+        {
+            uint32_t result = Core::ERROR_NONE;
+
+            struct epoll_event event;
+            event.events = events;
+            event.data.ptr = handler;
+
+            _adminLock.Lock();
+
+            if (::epoll_ctl(_epoll, EPOLL_CTL_ADD, descriptor, &event) == 0) {
+                _handlers.insert(handler);
+            } else {
+                result = Core::ERROR_GENERAL;
+            }
+
+            _adminLock.Unlock();
+
+            return (result);
+        }
+        void Modify(const int descriptor, IHandler* handler, const uint32_t events)
+        {
+            struct epoll_event event;
+            event.events = events;
+            event.data.ptr = handler;
+
+            ::epoll_ctl(_epoll, EPOLL_CTL_MOD, descriptor, &event);
+        }
+        // Once this returns the handler is not called anymore, not even with events already
+        // collected in the running batch. Off the reactor thread it waits for a running Handle().
+        void Unregister(const int descriptor, IHandler* handler)
+        {
+            _adminLock.Lock();
+            ::epoll_ctl(_epoll, EPOLL_CTL_DEL, descriptor, nullptr);
+            _handlers.erase(handler);
+            _adminLock.Unlock();
+
+            if (Current() != this) {
+                _dispatchLock.Lock();
+                _dispatchLock.Unlock();
+            }
+        }
+
+    private:
+        uint32_t Worker() override
+        {
+            struct epoll_event events[MaxEvents];
+
+            Current() = this;
+
+            const int count = ::epoll_wait(_epoll, events, MaxEvents, -1);
+
+            for (int index = 0; index < count; index++) {
+                IHandler* handler = static_cast<IHandler*>(events[index].data.ptr);
+
+                if (handler == nullptr) {
+                    uint64_t value;
+                    VARIABLE_IS_NOT_USED ssize_t drained = ::read(_wakeup, &value, sizeof(value));
+                } else {
+                    _dispatchLock.Lock();
+
+                    _adminLock.Lock();
+                    const bool registered = (_handlers.find(handler) != _handlers.end());
+                    _adminLock.Unlock();
+
+                    if (registered == true) {
+                        handler->Handle(events[index].events);
+                    }
+
+                    _dispatchLock.Unlock();
+                }
+            }
+
+            return (0);
+        }
+
+    private:
+        Core::CriticalSection _adminLock;
+        Core::CriticalSection _dispatchLock;
+        int _epoll;
+        int _wakeup;
+        std::set<IHandler*> _handlers;
+    };
+
+    // The descriptor side of a link served by a Reactor. Reads are batched into the receive
+    // buffer and parsed on the reactor thread, writes are pulled from SendData() while the
+    // descriptor takes them, as many frames per write as fit in the send buffer.
+    class ReactorLink : public Reactor::IHandler {
+    public:
+        static constexpr uint16_t ReceiveBufferSize = 2048;
+        static constexpr uint16_t SendBufferSize = 1024;
+
+        ReactorLink(const ReactorLink&) = delete;
+        ReactorLink& operator=(const ReactorLink&) = delete;
+
+        ReactorLink()
+            : _adminLock()
+            , _reactor(nullptr)
+            , _descriptor(-1)
+            , _triggered(false)
+            , _handling(false)
+            , _received(0)
+            , _sendOffset(0)
+            , _sendSize(0)
+        {
+        }
+        virtual ~ReactorLink()
+        {
+            Detach();
+        }
+
+    public:
+        bool IsOpen() const
+        {
+            return (_descriptor != -1);
+        }
+        int Descriptor() const
+        {
+            return (_descriptor);
+        }
+        void Trigger()
+        {
+            _triggered = true;
+
+            // From within our own Handle() it is picked up before that returns.
+            if ((Reactor::Current() != _reactor) || (_handling == false)) {
+                _adminLock.Lock();
+
+                if (_descriptor != -1) {
+                    _reactor->Modify(_descriptor, this, EPOLLIN | EPOLLRDHUP | EPOLLOUT);
+                }
+
+                _adminLock.Unlock();
+            }
+        }
+
+    protected:
+        virtual void StateChange() = 0;
+        virtual uint16_t SendData(uint8_t* dataFrame, const uint16_t maxSendSize) = 0;
+        virtual uint16_t ReceiveData(uint8_t* dataFrame, const uint16_t receivedSize) = 0;
+
+        // The descriptor hung up or failed, by default the link is closed.
+        virtual void Lost()
+        {
+            if (Detach() == true) {
+                StateChange();
+            }
+        }
+
+        // Hands an opened, non blocking descriptor to a reactor, it is closed if that fails.
+        uint32_t Attach(const int descriptor)
+        {
+            uint32_t result = Core::ERROR_ILLEGAL_STATE;
+
+            _adminLock.Lock();
+
+            if (_descriptor == -1) {
+                _received = 0;
+                _sendOffset = 0;
+                _sendSize = 0;
+                _triggered = false;
+                _reactor = &Reactor::Instance();
+                _descriptor = descriptor;
+
+                if (_reactor->Register(descriptor, this, EPOLLIN | EPOLLRDHUP) == Core::ERROR_NONE) {
+                    result = Core::ERROR_NONE;
+                } else {
+                    _descriptor = -1;
+                    result = Core::ERROR_GENERAL;
+                }
+            }
+
+            _adminLock.Unlock();
+
+            if (result != Core::ERROR_NONE) {
+                ::close(descriptor);
+            }
+
+            return (result);
+        }
+        // Whoever takes the descriptor away closes it, returns false if it was closed already.
+        bool Detach()
+        {
+            _adminLock.Lock();
+            const int descriptor = _descriptor;
+            _descriptor = -1;
+            _adminLock.Unlock();
+
+            if (descriptor != -1) {
+                _reactor->Unregister(descriptor, this);
+                ::close(descriptor);
+            }
+
+            return (descriptor != -1);
+        }
+
+    private:
+        void Handle(const uint32_t events) override
+        {
+            const int descriptor = _descriptor;
+
+            if (descriptor != -1) {
+                _handling = true;
+
+                if ((events & EPOLLIN) != 0) {
+                    Receive(descriptor);
+                }
+
+                if ((events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) != 0) {
+                    _handling = false;
+                    Lost();
+                } else {
+                    if (((events & EPOLLOUT) != 0) || (_triggered == true)) {
+                        Transmit(descriptor);
+                    }
+                    _handling = false;
+                }
+            }
+        }
+        void Receive(const int descriptor)
+        {
+            ssize_t size;
+
+            // Take whatever is there, as much as fits, and parse it in one go.
+            while ((size = ::read(descriptor, &_receive[_received], sizeof(_receive) - _received)) > 0) {
+                _received += static_cast<uint16_t>(size);
+
+                const uint16_t handled = ReceiveData(_receive, _received);
+
+                if ((handled >= _received) || ((handled == 0) && (_received == sizeof(_receive)))) {
+                    _received = 0;
+                } else if (handled > 0) {
+                    ::memmove(_receive, &_receive[handled], _received - handled);
+                    _received -= handled;
+                }
+            }
+        }
+        void Transmit(const int descriptor)
+        {
+            while (true) {
+                if (_sendOffset == _sendSize) {
+                    _triggered = false;
+                    _sendOffset = 0;
+                    _sendSize = SendData(_send, sizeof(_send));
+
+                    if (_sendSize == 0) {
+                        // Disarm first, so a Trigger() from now on either shows here or arms again.
+                        _reactor->Modify(descriptor, this, EPOLLIN | EPOLLRDHUP);
+
+                        if (_triggered == false) {
+                            break;
+                        }
+                        continue;
+                    }
+                }
+
+                const ssize_t written = ::write(descriptor, &_send[_sendOffset], _sendSize - _sendOffset);
+
+                if (written > 0) {
+                    _sendOffset += static_cast<uint16_t>(written);
+                } else {
+                    if ((written == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+                        _reactor->Modify(descriptor, this, EPOLLIN | EPOLLRDHUP | EPOLLOUT);
+                    }
+                    break;
+                }
+            }
+        }
+
+    private:
+        Core::CriticalSection _adminLock;
+        Reactor* _reactor;
+        std::atomic<int> _descriptor;
+        std::atomic<bool> _triggered;
+        bool _handling;
+        uint16_t _received;
+        uint16_t _sendOffset;
+        uint16_t _sendSize;
+        uint8_t _receive[ReceiveBufferSize];
+        uint8_t _send[SendBufferSize];
+    };
+
+    // Stands in for Core::SerialPort as the LINK of a DataExchange, on a tty served by a Reactor
+    // instead of the ResourceMonitor.
+    class ReactorPort : public ReactorLink {
+    public:
+        typedef Core::SerialPort::BaudRate BaudRate;
+        typedef Core::SerialPort::Parity Parity;
+        typedef Core::SerialPort::DataBits DataBits;
+        typedef Core::SerialPort::StopBits StopBits;
+        typedef Core::SerialPort::FlowControl FlowControl;
+
+        ReactorPort(const ReactorPort&) = delete;
+        ReactorPort& operator=(const ReactorPort&) = delete;
+
+        ReactorPort()
+            : ReactorLink()
+            , _adminLock()
+            , _port()
+            , _baudRate(Core::SerialPort::Convert(115200))
+            , _parity(Core::SerialPort::NONE)
+            , _dataBits(Core::SerialPort::BITS_8)
+            , _stopBits(Core::SerialPort::BITS_1)
+            , _flowControl(Core::SerialPort::OFF)
+        {
+        }
+        ~ReactorPort() override = default;
+
+    public:
+        static BaudRate Convert(const uint32_t baudRate)
+        {
+            return (Core::SerialPort::Convert(baudRate));
+        }
+
+        uint32_t Configuration(const string& port, const BaudRate baudRate, const Parity parity, const DataBits dataBits, const StopBits stopBits, const FlowControl flowControl)
+        {
+            _adminLock.Lock();
+
+            _port = port;
+            _baudRate = baudRate;
+            _parity = parity;
+            _dataBits = dataBits;
+            _stopBits = stopBits;
+            _flowControl = flowControl;
+
+            _adminLock.Unlock();
+
+            return (port.empty() == true ? Core::ERROR_INCOMPLETE_CONFIG : Core::ERROR_NONE);
+        }
+        uint32_t SetBaudRate(const BaudRate baudRate)
+        {
+            uint32_t result = Core::ERROR_NONE;
+
+            _adminLock.Lock();
+
+            _baudRate = baudRate;
+
+            const int descriptor = Descriptor();
+
+            if (descriptor != -1) {
+                struct termios options;
+
+                if ((::tcgetattr(descriptor, &options) != 0)
+                    || (::cfsetispeed(&options, _baudRate) != 0)
+                    || (::cfsetospeed(&options, _baudRate) != 0)
+                    || (::tcsetattr(descriptor, TCSANOW, &options) != 0)) {
+                    result = Core::ERROR_GENERAL;
+                }
+            }
+
+            _adminLock.Unlock();
+
+            return (result);
+        }
+        string RemoteId() const
+        {
+            return (_port);
+        }
+        uint32_t Open(const uint32_t waitTime VARIABLE_IS_NOT_USED)
+        {
+            uint32_t result = Core::ERROR_ILLEGAL_STATE;
+
+            _adminLock.Lock();
+
+            if (IsOpen() == false) {
+                const int descriptor = ::open(_port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+
+                if (descriptor == -1) {
+                    result = Core::ERROR_UNAVAILABLE;
+                } else if (Setup(descriptor) == false) {
+                    ::close(descriptor);
+                    result = Core::ERROR_GENERAL;
+                } else {
+                    result = Attach(descriptor);
+                }
+            }
+
+            _adminLock.Unlock();
+
+            if (result == Core::ERROR_NONE) {
+                StateChange();
+            }
+
+            return (result);
+        }
+        uint32_t Close(const uint32_t waitTime VARIABLE_IS_NOT_USED)
+        {
+            if (Detach() == true) {
+                StateChange();
+            }
+
+            return (Core::ERROR_NONE);
+        }
+        void Flush()
+        {
+            const int descriptor = Descriptor();
+
+            if (descriptor != -1) {
+                ::tcflush(descriptor, TCIOFLUSH);
+            }
+        }
+
+    private:
+        bool Setup(const int descriptor) const
+        {
+            struct termios options;
+
+            bool result = (::tcgetattr(descriptor, &options) == 0);
+
+            if (result == true) {
+                ::cfmakeraw(&options);
+
+                options.c_cflag &= ~(CSIZE | CSTOPB | PARENB | PARODD | CRTSCTS);
+                options.c_cflag |= (CLOCAL | CREAD | _dataBits | _stopBits);
+                options.c_iflag &= ~(IXON | IXOFF | IXANY);
+
+                if (_parity != Core::SerialPort::NONE) {
+                    options.c_cflag |= (_parity == Core::SerialPort::ODD ? (PARENB | PARODD) : PARENB);
+                }
+                if (_flowControl == Core::SerialPort::HARDWARE) {
+                    options.c_cflag |= CRTSCTS;
+                } else if (_flowControl == Core::SerialPort::SOFTWARE) {
+                    options.c_iflag |= (IXON | IXOFF);
+                }
+
+                options.c_cc[VMIN] = 0;
+                options.c_cc[VTIME] = 0;
+
+                result = (::cfsetispeed(&options, _baudRate) == 0)
+                    && (::cfsetospeed(&options, _baudRate) == 0)
+                    && (::tcsetattr(descriptor, TCSANOW, &options) == 0);
+            }
+
+            return (result);
+        }
+
+    private:
+        Core::CriticalSection _adminLock;
+        string _port;
+        BaudRate _baudRate;
+        Parity _parity;
+        DataBits _dataBits;
+        StopBits _stopBits;
+        FlowControl _flowControl;
+    };
+
+    // A stream socket to an endpoint, e.g. behind ser2net or attached over WiFi. The address is
+    // "tcp://host:port" or "unix:///path/to/socket". A connection that drops is closed, like a
+    // tty that went away, whoever owns the link connects again through Open().
+    class ReactorStream : public ReactorLink {
+    public:
+        ReactorStream(const ReactorStream&) = delete;
+        ReactorStream& operator=(const ReactorStream&) = delete;
+
+        ReactorStream()
+            : ReactorLink()
+            , _adminLock()
+            , _address()
+        {
+        }
+        ~ReactorStream() override = default;
+
+    public:
+        static bool IsAddress(const string& address)
+        {
+            return ((address.compare(0, 6, _T("tcp://")) == 0) || (address.compare(0, 7, _T("unix://")) == 0));
+        }
+
+        uint32_t Configuration(const string& address)
+        {
+            _adminLock.Lock();
+            _address = address;
+            _adminLock.Unlock();
+
+            return (IsAddress(address) == true ? Core::ERROR_NONE : Core::ERROR_INCOMPLETE_CONFIG);
+        }
+        string RemoteId() const
+        {
+            return (_address);
+        }
+        uint32_t Open(const uint32_t waitTime)
+        {
+            uint32_t result = Core::ERROR_ILLEGAL_STATE;
+
+            if (IsOpen() == false) {
+                if ((result = Connect(waitTime)) == Core::ERROR_NONE) {
+                    StateChange();
+                }
+            }
+
+            return (result);
+        }
+        uint32_t Close(const uint32_t waitTime VARIABLE_IS_NOT_USED)
+        {
+            if (Detach() == true) {
+                StateChange();
+            }
+
+            return (Core::ERROR_NONE);
+        }
+        void Flush()
+        {
+            // Nothing is kept below us, unlike the buffers of a tty.
+        }
+
+    protected:
+        void Lost() override
+        {
+            TRACE(Trace::Error, ("Lost connection to %s", RemoteId().c_str()));
+
+            ReactorLink::Lost();
+        }
+
+    private:
+        uint32_t Connect(const uint32_t waitTime)
+        {
+            uint32_t result = Core::ERROR_UNAVAILABLE;
+
+            _adminLock.Lock();
+            const string address(_address);
+            _adminLock.Unlock();
+
+            struct sockaddr_storage node;
+            socklen_t length = 0;
+            int descriptor = -1;
+
+            ::memset(&node, 0, sizeof(node));
+
+            if (address.compare(0, 7, _T("unix://")) == 0) {
+                struct sockaddr_un& domain = reinterpret_cast<struct sockaddr_un&>(node);
+                const string path(address.substr(7));
+
+                if ((path.empty() == false) && (path.length() < sizeof(domain.sun_path))) {
+                    domain.sun_family = AF_UNIX;
+                    ::strncpy(domain.sun_path, path.c_str(), sizeof(domain.sun_path) - 1);
+                    length = sizeof(domain);
+                }
+            } else {
+                const string hostPort(address.substr(6));
+                const size_t colon = hostPort.rfind(':');
+
+                if ((colon != string::npos) && (colon > 0)) {
+                    string host(hostPort.substr(0, colon));
+                    const string port(hostPort.substr(colon + 1));
+
+                    if ((host.length() > 2) && (host.front() == '[') && (host.back() == ']')) {
+                        host = host.substr(1, host.length() - 2);
+                    }
+
+                    struct addrinfo hints;
+                    struct addrinfo* info = nullptr;
+
+                    ::memset(&hints, 0, sizeof(hints));
+                    hints.ai_family = AF_UNSPEC;
+                    hints.ai_socktype = SOCK_STREAM;
+
+                    if ((::getaddrinfo(host.c_str(), port.c_str(), &hints, &info) == 0) && (info != nullptr)) {
+                        ::memcpy(&node, info->ai_addr, info->ai_addrlen);
+                        length = info->ai_addrlen;
+                    }
+                    if (info != nullptr) {
+                        ::freeaddrinfo(info);
+                    }
+                }
+            }
+
+            if (length == 0) {
+                result = Core::ERROR_INCOMPLETE_CONFIG;
+            } else if ((descriptor = ::socket(node.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) != -1) {
+                if (node.ss_family != AF_UNIX) {
+                    // Frames are small and every one of them is waited for, do not hold them back.
+                    const int enabled = 1;
+                    ::setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+                }
+
+                bool connected = (::connect(descriptor, reinterpret_cast<const struct sockaddr*>(&node), length) == 0);
+
+                if ((connected == false) && (errno == EINPROGRESS)) {
+                    struct pollfd pending;
+                    pending.fd = descriptor;
+                    pending.events = POLLOUT;
+                    pending.revents = 0;
+
+                    int error = 0;
+                    socklen_t size = sizeof(error);
+
+                    connected = (::poll(&pending, 1, (waitTime == Core::infinite) ? -1 : static_cast<int>(waitTime)) == 1)
+                        && (::getsockopt(descriptor, SOL_SOCKET, SO_ERROR, &error, &size) == 0)
+                        && (error == 0);
+
+                    if ((connected == false) && (error == 0)) {
+                        result = Core::ERROR_TIMEDOUT;
+                    }
+                }
+
+                if (connected == true) {
+                    result = Attach(descriptor);
+                } else {
+                    ::close(descriptor);
+                }
+            }
+
+            return (result);
+        }
+
+    private:
+        Core::CriticalSection _adminLock;
+        string _address;
+    };
+
+} // namespace SimpleSerial
+} // namespace Thunder
@@ -22,6 +22,14 @@
 #include "DataExchange.h"
 #include "SimpleSerial.h"
 
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <functional>
+#include <iterator>
+
 namespace Thunder {
 
 ENUM_CONVERSION_BEGIN(Core::SerialPort::FlowControl) { Core::SerialPort::OFF, _TXT("off") },
@@ -29,13 +37,127 @@ ENUM_CONVERSION_BEGIN(Core::SerialPort::FlowControl) { Core::SerialPort::OFF, _T
     { Core::SerialPort::SOFTWARE, _TXT("software") },
     ENUM_CONVERSION_END(Core::SerialPort::FlowControl);
 
+ENUM_CONVERSION_BEGIN(SimpleSerial::Protocol::FramingType) { SimpleSerial::Protocol::FramingType::PREAMBLE, _TXT("preamble") },
+    { SimpleSerial::Protocol::FramingType::COBS, _TXT("cobs") },
+    ENUM_CONVERSION_END(SimpleSerial::Protocol::FramingType);
+
+ENUM_CONVERSION_BEGIN(SimpleSerial::Protocol::ChecksumType) { SimpleSerial::Protocol::ChecksumType::CRC8, _TXT("crc8") },
+    { SimpleSerial::Protocol::ChecksumType::CRC32C, _TXT("crc32c") },
+    ENUM_CONVERSION_END(SimpleSerial::Protocol::ChecksumType);
+
 namespace Doofah {
-    void SerialCommunicator::Callback(ICallback* callback)
+    namespace {
+        // Speeds this side can run the link at.
+        const uint32_t Baudrates[] = { 115200, 230400, 460800, 500000, 576000, 921600, 1000000, 1500000, 2000000 };
+        // Requests in a row without a usable answer, before the link is slowed down.
+        constexpr uint8_t MaxFailures = 3;
+
+        // Limits to the measured timeout in milliseconds, the ceiling also holds as long as
+        // nothing was measured yet.
+        struct TimeoutBounds {
+            SimpleSerial::Protocol::OperationType operation;
+            uint16_t floor;
+            uint16_t ceiling;
+        };
+        const TimeoutBounds Timeouts[] = {
+            { SimpleSerial::Protocol::OperationType::RESET, 100, 3000 },
+            { SimpleSerial::Protocol::OperationType::SETTINGS, 500, 5000 },
+            { SimpleSerial::Protocol::OperationType::TRANSFER_BEGIN, 50, 2000 },
+            { SimpleSerial::Protocol::OperationType::TRANSFER_CHUNK, 50, 2000 },
+            // Checks the whole blob before it is stored.
+            { SimpleSerial::Protocol::OperationType::TRANSFER_COMMIT, 1000, 10000 },
+        };
+        // All other operations are answered right away.
+        constexpr uint16_t TimeoutFloor = 20;
+        constexpr uint16_t TimeoutCeiling = 1000;
+
+        // Milliseconds between the attempts to reopen a lost port, doubling up to the maximum.
+        constexpr uint32_t ReopenMin = 100;
+        constexpr uint32_t ReopenMax = 5000;
+
+        // Notifications that can wait for the callbacks, newer ones are dropped.
+        constexpr uint8_t MaxNotifications = 32;
+
+        // Where udev keeps names for the serial ports that survive re-enumeration.
+        constexpr char SerialById[] = "/dev/serial/by-id/";
+
+        string Resolve(const string& port)
+        {
+            char resolved[PATH_MAX];
+
+            return ((::realpath(port.c_str(), resolved) != nullptr) ? string(resolved) : string());
+        }
+    }
+
+    void SerialCommunicator::Register(ICallback* callback)
     {
-        _adminLock.Lock();
-        ASSERT((callback == nullptr) ^ (_callback == nullptr));
-        _callback = callback;
-        _adminLock.Unlock();
+        ASSERT(callback != nullptr);
+
+        _callbackLock.Lock();
+        ASSERT(std::find(_callbacks.begin(), _callbacks.end(), callback) == _callbacks.end());
+        _callbacks.push_back(callback);
+        _callbackLock.Unlock();
+    }
+
+    void SerialCommunicator::Unregister(ICallback* callback)
+    {
+        _callbackLock.Lock();
+        _callbacks.remove(callback);
+        _callbackLock.Unlock();
+    }
+
+    // Called on the thread reading the link, it only queues.
+    void SerialCommunicator::Publish(const Notification& notification)
+    {
+        _notificationLock.Lock();
+
+        const bool queued = (_notifications.size() < MaxNotifications);
+
+        if (queued == true) {
+            _notifications.push_back(notification);
+        }
+
+        _notificationLock.Unlock();
+
+        if (queued == true) {
+            _notify.Submit();
+        } else {
+            TRACE(Trace::Error, ("Notification %d dropped, callbacks are not keeping up", notification.kind));
+        }
+    }
+
+    void SerialCommunicator::Deliver()
+    {
+        _notificationLock.Lock();
+
+        while (_notifications.empty() == false) {
+            const Notification notification(_notifications.front());
+            _notifications.pop_front();
+
+            _notificationLock.Unlock();
+
+            _callbackLock.Lock();
+
+            for (ICallback* callback : _callbacks) {
+                switch (notification.kind) {
+                case Notification::STARTED:
+                    callback->Started();
+                    break;
+                case Notification::BUTTON:
+                    callback->Button();
+                    break;
+                case Notification::KEY_ERROR:
+                    callback->KeyError(notification.address, notification.code, notification.pressed, notification.result);
+                    break;
+                }
+            }
+
+            _callbackLock.Unlock();
+
+            _notificationLock.Lock();
+        }
+
+        _notificationLock.Unlock();
     }
 
     uint32_t SerialCommunicator::Initialize(const string& configuration)
@@ -46,13 +168,31 @@ namespace Doofah {
 
         config.FromString(configuration);
 
+        _channel.Window(config.Window.Value());
+
+        if (config.Capture.Value().empty() == false) {
+            _channel.Capture(config.Capture.Value(), config.CaptureSize.Value() * 1024);
+        }
+
+        _port = config.Port.Value();
+        _flowControl = config.FlowControl.Value();
+        _framing = config.Framing.Value();
+        _checksum = config.Checksum.Value();
+        _baseBaudRate = config.BaudRate.Value();
+        _maxBaudRate = config.MaxBaudRate.Value();
+        _timing = config.Timing.Value();
+        _retries = config.Retries.Value();
+
+        _monitorInterval = config.Monitor.Value();
+        _pingSize = config.PingSize.Value();
+
         if (_channel.Link().Configuration(
-                config.Port.Value(),
-                Core::SerialPort::Convert(config.BaudRate.Value()),
+                _port,
+                Core::SerialPort::Convert(_baseBaudRate),
                 Core::SerialPort::NONE,
                 Core::SerialPort::BITS_8,
                 Core::SerialPort::BITS_1,
-                config.FlowControl.Value())
+                _flowControl)
             == Core::ERROR_NONE) {
             result = _channel.Open(1000);
         } else {
@@ -60,7 +200,29 @@ namespace Doofah {
         }
 
         if (_channel.IsOpen() == true) {
-            _channel.Flush();
+            // Reopened by a name that survives a replug, /dev/ttyUSB0 may well be another adapter by then.
+            if (_channel.Link().IsStream() == false) {
+                _port = Stable(_port);
+
+                _adminLock.Lock();
+                _device = Resolve(_port);
+                _adminLock.Unlock();
+            }
+
+            Handshake();
+        }
+
+        if (result != Core::ERROR_INCOMPLETE_CONFIG) {
+            _active = true;
+
+            // Not plugged in yet is no different from unplugged, callers fail fast until it shows up.
+            if (_channel.IsOpen() == false) {
+                Lost();
+            }
+
+            if (_monitorInterval > 0) {
+                _probe.Reschedule(Core::Time::Now().Add(_monitorInterval * 1000));
+            }
         }
 
         TRACE(Trace::Information, ("Configured SerialCommunicator[%s]: %s", _channel.RemoteId().c_str(), _channel.IsOpen() ? "succesful" : "failed"));
@@ -70,21 +232,100 @@ namespace Doofah {
 
     void SerialCommunicator::Deinitialize()
     {
+        _active = false;
+        _monitorInterval = 0;
+        _probe.Revoke();
+        _job.Revoke();
+
+        _lost = false;
+        _channel.Resume();
+
+        // Also ends the asynchronous requests still waiting for a closed link.
+        _channel.Flush();
+
+        _expire.Revoke();
+        Abandon(Core::ERROR_ASYNC_ABORTED);
+
+        // The run in progress ends at its next exchange, the ones behind it do not start.
+        _run.Revoke();
+
+        std::list<Task> tasks;
+
+        _adminLock.Lock();
+        tasks.swap(_tasks);
+        _adminLock.Unlock();
+
+        for (Task& task : tasks) {
+            task(true);
+        }
+
+        Invalidate();
+
         if (_channel.IsOpen() == true) {
-            _channel.Flush();
             _channel.Close(1000);
         }
+
+        _channel.Capture(string(), 0);
+
+        // Nothing comes in anymore, what is still queued is of no interest.
+        _notify.Revoke();
+
+        _notificationLock.Lock();
+        _notifications.clear();
+        _notificationLock.Unlock();
     }
 
-    uint32_t SerialCommunicator::KeyEvent(const SimpleSerial::Protocol::DeviceAddressType address, const bool pressed, const uint16_t code) const
+    uint32_t SerialCommunicator::KeyEvent(const SimpleSerial::Protocol::DeviceAddressType address, const bool pressed, const uint16_t code, const bool acknowledge, const uint32_t deadline) const
     {
-        KeyMessage message(address, code, pressed);
+        uint32_t result = Core::ERROR_NONE;
+        KeyMessage message(address, code, pressed, acknowledge);
+
+        if (acknowledge == false) {
+            if ((result = _channel.Post(message, Timeout(message.Operation(), deadline))) == Core::ERROR_NONE) {
+                _keysSent++;
+            }
+        } else {
+            Channel::Response response;
 
-        uint32_t result = _channel.Post(message, 1000);
+            result = _channel.Post(message, Timeout(message.Operation(), deadline), response);
 
-        if ((result == Core::ERROR_NONE) && (message.Result() != SimpleSerial::Protocol::ResultType::OK)) {
-            TRACE(Trace::Error, ("Exchange Failed: %d", static_cast<uint8_t>(message.Result())));
-            result = Core::ERROR_GENERAL;
+            if ((result == Core::ERROR_NONE) && (response->Result() != SimpleSerial::Protocol::ResultType::OK)) {
+                TRACE(Trace::Error, ("Exchange Failed: %d", static_cast<uint8_t>(response->Result())));
+                result = Core::ERROR_GENERAL;
+            }
+        }
+
+        return result;
+    }
+
+    SerialCommunicator::KeyCounters SerialCommunicator::Keys() const
+    {
+        KeyCounters counters;
+
+        counters.sent = _keysSent.load();
+        counters.failed = _keysFailed.load();
+        counters.dropped = _keysDropped.load();
+
+        return (counters);
+    }
+
+    uint32_t SerialCommunicator::KeyEvents(const std::vector<SimpleSerial::Payload::KeyBatchEvent>& events, std::vector<SimpleSerial::Protocol::ResultType>& results, const uint32_t deadline) const
+    {
+        uint32_t outcome(Core::ERROR_NONE);
+        Core::Event done(false, true);
+
+        results.clear();
+
+        uint32_t result = KeyEvents(events, [&outcome, &results, &done](const uint32_t result, const std::vector<SimpleSerial::Protocol::ResultType>& list) {
+            outcome = result;
+            results = list;
+            done.SetEvent();
+        }, deadline);
+
+        // Every frame of the batch completes, without an answer it expires.
+        if (result == Core::ERROR_NONE) {
+            done.Lock(Core::infinite);
+            result = outcome;
         }
 
         return result;
@@ -92,94 +333,1449 @@ namespace Doofah {
 
     SerialCommunicator::DeviceIterator SerialCommunicator::Devices() const
     {
-        std::list<SimpleSerial::Payload::Device> devices;
+        DeviceIterator list;
+        Core::Event done(false, true);
+
+        Devices([&list, &done](const uint32_t result, DeviceIterator& devices) {
+            if (result != Core::ERROR_NONE) {
+                TRACE_GLOBAL(Trace::Error, ("Reading the devices failed: %d", result));
+            }
+
+            list = std::move(devices);
+            done.SetEvent();
+        });
+
+        // The query always completes, without an answer it expires.
+        done.Lock(Core::infinite);
+
+        return (list);
+    }
+
+    void SerialCommunicator::Invalidate() const
+    {
+        _adminLock.Lock();
+        _devices.Release();
+        _generation++;
+        _adminLock.Unlock();
+    }
+
+    uint32_t SerialCommunicator::Sequence(const SimpleSerial::Protocol::DeviceAddressType address, const std::vector<SimpleSerial::Payload::SequenceStep>& steps, const uint32_t deadline) const
+    {
+        uint32_t outcome(Core::ERROR_NONE);
+        Core::Event done(false, true);
+
+        uint32_t result = Sequence(address, steps, [&outcome, &done](const uint32_t result) {
+            outcome = result;
+            done.SetEvent();
+        }, deadline);
+
+        // The sequence always completes, without the end of it reported it expires.
+        if (result == Core::ERROR_NONE) {
+            done.Lock(Core::infinite);
+            result = outcome;
+        }
+
+        return result;
+    }
+
+    uint32_t SerialCommunicator::Transfer(const SimpleSerial::Protocol::DeviceAddressType address, const uint32_t length, const uint8_t data[], TransferReport& report) const
+    {
+        // Rounds in a row without progress before we give up.
+        static constexpr uint8_t MaxStalls = 3;
+
+        const uint64_t start = Core::Time::Now().Ticks();
 
-        StateMessage message(static_cast<SimpleSerial::Protocol::DeviceAddressType>(SimpleSerial::Payload::Peripheral::ROOT));
+        uint32_t offset = 0;
+        uint8_t stalls = 0;
 
-        uint32_t result = _channel.Post(message, 1000);
+        report.size = length;
+        report.sent = 0;
+        report.resumes = 0;
+        report.duration = 0;
 
-        if (result != Core::ERROR_NONE) {
-            TRACE(Trace::Error, ("Post Failed: %d", result));
-        } else if ((result == Core::ERROR_NONE) && (message.Result() != SimpleSerial::Protocol::ResultType::OK)) {
-            TRACE(Trace::Error, ("Exchange Failed: %d", static_cast<uint8_t>(message.Result())));
+        TransferBeginMessage begin(address, length, SimpleSerial::Protocol::CRC32(0, length, data));
+
+        uint32_t result = _channel.Post(begin, Timeout(begin.Operation()));
+
+        if ((result == Core::ERROR_NONE) && ((begin.Result() != SimpleSerial::Protocol::ResultType::OK) || (begin.State(offset) == false) || (offset > length))) {
+            TRACE(Trace::Error, ("Transfer begin failed: %d", static_cast<uint8_t>(begin.Result())));
             result = Core::ERROR_GENERAL;
-        } else {
-            message.Reset();
+        }
+
+        // Ends at the next round once the communicator goes down.
+        while ((result == Core::ERROR_NONE) && (offset < length) && (_active == true)) {
+            std::vector<std::unique_ptr<TransferChunkMessage>> chunks;
+            std::vector<SimpleSerial::Protocol::Message*> requests;
+            uint32_t position = offset;
+            uint32_t next = offset;
+            bool reported = false;
+
+            // Fill the lane's share of the window, the chunks are acknowledged while the next ones are on the wire.
+            while ((chunks.size() < _channel.Window(SimpleSerial::Protocol::OperationType::TRANSFER_CHUNK)) && (position < length)) {
+                const uint8_t size = static_cast<uint8_t>(std::min(static_cast<uint32_t>(SimpleSerial::Payload::MaxTransferChunk), length - position));
+
+                chunks.emplace_back(new TransferChunkMessage(address, position, size, &data[position]));
+                requests.push_back(chunks.back().get());
+
+                position += size;
+                report.sent += size;
+            }
+
+            _channel.Post(static_cast<uint8_t>(requests.size()), requests.data(), Timeout(SimpleSerial::Protocol::OperationType::TRANSFER_CHUNK) * Rounds(SimpleSerial::Protocol::OperationType::TRANSFER_CHUNK, requests.size()));
+
+            // The last response tells where the endpoint stands after all chunks it saw.
+            for (const std::unique_ptr<TransferChunkMessage>& chunk : chunks) {
+                uint32_t state;
+
+                if (chunk->State(state) == true) {
+                    next = state;
+                    reported = true;
+                }
+            }
+
+            if (reported == false) {
+                // Nothing came back intact, ask the endpoint where to resume.
+                TransferBeginMessage resume(address, length, SimpleSerial::Protocol::CRC32(0, length, data));
+
+                if ((_channel.Post(resume, Timeout(resume.Operation())) == Core::ERROR_NONE) && (resume.Result() == SimpleSerial::Protocol::ResultType::OK)) {
+                    reported = resume.State(next);
+                }
+            }
 
-            while ((message.Next() == true) && (message.Current() != nullptr)) {
-                SimpleSerial::Payload::Device device;
+            if ((reported == true) && (next != position)) {
+                report.resumes++;
+            }
+
+            if ((reported == true) && (next > offset) && (next <= length)) {
+                offset = next;
+                stalls = 0;
+            } else if (++stalls >= MaxStalls) {
+                TRACE(Trace::Error, ("Transfer stalled at offset %d", offset));
+                result = Core::ERROR_TIMEDOUT;
+            } else if ((reported == true) && (next <= length)) {
+                offset = next;
+            }
+        }
 
-                device.address = message.Current()->address;
-                device.peripheral = message.Current()->peripheral;
+        if ((result == Core::ERROR_NONE) && (offset < length)) {
+            result = Core::ERROR_ASYNC_ABORTED;
+        }
+
+        if (result == Core::ERROR_NONE) {
+            TransferCommitMessage commit(address);
 
-                devices.push_back(device);
+            result = _channel.Post(commit, Timeout(commit.Operation()));
+
+            if ((result == Core::ERROR_NONE) && (commit.Result() != SimpleSerial::Protocol::ResultType::OK)) {
+                TRACE(Trace::Error, ("Transfer commit failed: %d", static_cast<uint8_t>(commit.Result())));
+                result = Core::ERROR_GENERAL;
             }
+        }
+
+        report.duration = Core::Time::Now().Ticks() - start;
+
+        TRACE(Trace::Information, ("Transferred %d bytes in %llu us, %d bytes/s", report.size, report.duration, report.Throughput()));
+
+        return result;
+    }
+
+    uint32_t SerialCommunicator::Transfer(const SimpleSerial::Protocol::DeviceAddressType address, const string& fileName, TransferReport& report) const
+    {
+        uint32_t result = Core::ERROR_UNAVAILABLE;
+
+        std::ifstream file(fileName, std::ios::in | std::ios::binary);
 
-            TRACE(Trace::Information, ("Got %d devices", devices.size()));
+        if (file.is_open() == true) {
+            const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+            result = Transfer(address, static_cast<uint32_t>(data.size()), data.data(), report);
+        } else {
+            TRACE(Trace::Error, ("Could not open %s", fileName.c_str()));
         }
 
-        return DeviceIterator(std::move(devices));
+        return result;
     }
 
     void SerialCommunicator::Received(const SimpleSerial::Protocol::Message& message)
     {
         TRACE(Trace::Information, ("Received message: 0x%02X", message.Operation()));
-        SimpleSerial::PrintMessage(message);
+
+        if ((message.Operation() == SimpleSerial::Protocol::OperationType::EVENT) && (message.IsValid() == true) && (message.PayloadLength() >= sizeof(SimpleSerial::Payload::Event))) {
+            const SimpleSerial::Payload::Event* event(reinterpret_cast<const SimpleSerial::Payload::Event*>(message.Payload()));
+
+            if (event->type == SimpleSerial::Payload::EventType::SEQUENCE_COMPLETED) {
+                Completion completion;
+
+                _adminLock.Lock();
+
+                std::map<SimpleSerial::Protocol::SequenceType, std::pair<uint64_t, Completion>>::iterator index(_running.find(message.Sequence()));
+
+                if (index != _running.end()) {
+                    completion = std::move(index->second.second);
+                    _running.erase(index);
+                } else {
+                    // The EVENT overtook the response to the SEQUENCE, Follow() picks it up.
+                    _sequences[message.Sequence()] = std::make_pair(message.Result(), Core::Time::Now().Ticks());
+                }
+
+                _adminLock.Unlock();
+
+                if (completion != nullptr) {
+                    completion((message.Result() == SimpleSerial::Protocol::ResultType::OK) ? Core::ERROR_NONE : Core::ERROR_GENERAL);
+                }
+            } else if (event->type == SimpleSerial::Payload::EventType::STARTED) {
+                // A restarted endpoint is back on the preamble framing and the CRC8, it announces
+                // that in every framing and under every checksum.
+                if (_channel.Framing() != SimpleSerial::Protocol::FramingType::PREAMBLE) {
+                    _channel.Framing(SimpleSerial::Protocol::FramingType::PREAMBLE);
+                }
+                if (_channel.Checksum() != SimpleSerial::Protocol::ChecksumType::CRC8) {
+                    _channel.Checksum(SimpleSerial::Protocol::ChecksumType::CRC8);
+                }
+
+                // The devices are set up anew after a restart.
+                Invalidate();
+
+                _adminLock.Lock();
+                _endpoint.framing = SimpleSerial::Protocol::FramingType::PREAMBLE;
+                _endpoint.checksum = SimpleSerial::Protocol::ChecksumType::CRC8;
+                _adminLock.Unlock();
+
+                Publish(Notification(Notification::STARTED));
+
+                _job.Submit();
+            } else if (event->type == SimpleSerial::Payload::EventType::BUTTON) {
+                Publish(Notification(Notification::BUTTON));
+            } else if ((event->type == SimpleSerial::Payload::EventType::KEY_ERROR) && (message.PayloadLength() >= (sizeof(SimpleSerial::Payload::Event) + sizeof(SimpleSerial::Payload::KeyError)))) {
+                SimpleSerial::Payload::KeyError failure;
+
+                ::memcpy(&failure, &(message.Payload()[sizeof(SimpleSerial::Payload::Event)]), sizeof(failure));
+
+                _keysFailed++;
+
+                TRACE(Trace::Error, ("Key 0x%04X on device 0x%02X failed: %d", failure.event.code, failure.address, static_cast<uint8_t>(message.Result())));
+
+                Publish(Notification(failure.address, failure.event.code, (failure.event.pressed == SimpleSerial::Payload::Action::PRESSED), message.Result()));
+            }
+        } else if ((message.IsValid() == true) && (message.Operation() == SimpleSerial::Protocol::OperationType::KEY_NOACK)) {
+            // Only a frame the endpoint could not take in gets answered, there is nobody waiting for it.
+            // A garbled frame only looks like one, it is counted as a resync already.
+            _keysDropped++;
+
+            TRACE(Trace::Error, ("Unacknowledged key dropped by the endpoint: %d", static_cast<uint8_t>(message.Result())));
+        }
     }
 
-    uint32_t SerialCommunicator::Reset(const SimpleSerial::Protocol::DeviceAddressType address) const
+    void SerialCommunicator::Latencies(OperationLatencies& operations, DeviceLatencies& devices) const
     {
-        uint32_t result(Core::ERROR_NONE);
+        _adminLock.Lock();
+        operations = _operationLatencies;
+        devices = _deviceLatencies;
+        _adminLock.Unlock();
+    }
 
-        TRACE(Trace::Information, ("Reset device: 0x%02X", address));
+    void SerialCommunicator::Measured(const SimpleSerial::Protocol::OperationType operation, const SimpleSerial::Protocol::DeviceAddressType address, const Stages& stages)
+    {
+        // The timeout covers a request from the moment it is on the line, time spent waiting for the
+        // window or the line would only inflate it. Only requests that went out once get here, a
+        // retransmitted one can not tell which attempt was answered (Karn).
+        const uint32_t roundTrip = stages.line + stages.endpoint + stages.device;
 
-        ResetMessage message(address);
+        _adminLock.Lock();
+        _operationLatencies[operation].Add(stages);
+        _estimates[operation].Add(roundTrip);
+
+        if (address != SimpleSerial::Protocol::InvalidAddress) {
+            _deviceLatencies[address].Add(stages);
+        }
+        _adminLock.Unlock();
+    }
+
+    uint32_t SerialCommunicator::Ping(const uint8_t size, uint32_t& roundTrip) const
+    {
+        Channel::Response response;
+        PingMessage message(size);
 
-        result = _channel.Post(message, 1000);
+        const uint64_t start = Core::Time::Now().Ticks();
 
-        if ((result == Core::ERROR_NONE) && (message.Result() != SimpleSerial::Protocol::ResultType::OK)) {
-            TRACE(Trace::Error, ("Exchange Failed: %d", static_cast<uint8_t>(message.Result())));
-            result = Core::ERROR_GENERAL;
+        uint32_t result = _channel.Post(message, Timeout(message.Operation()), response);
+
+        roundTrip = static_cast<uint32_t>(Core::Time::Now().Ticks() - start);
+
+        if ((result == Core::ERROR_NONE) && (message.IsEcho(*response) == false)) {
+            TRACE(Trace::Error, ("Ping not echoed unaltered: %d", static_cast<uint8_t>(response->Result())));
+            result = Core::ERROR_INCORRECT_HASH;
         }
 
-        return result;
+        _adminLock.Lock();
+
+        _pings++;
+
+        if (result == Core::ERROR_NONE) {
+            _roundTrips[_roundTripIndex] = roundTrip;
+            _roundTripIndex = (_roundTripIndex + 1) % (sizeof(_roundTrips) / sizeof(_roundTrips[0]));
+        } else {
+            _lostPings++;
+        }
+
+        _adminLock.Unlock();
+
+        return (result);
+    }
+
+    SerialCommunicator::LinkStatistics SerialCommunicator::Link() const
+    {
+        static constexpr uint8_t Slots = sizeof(_roundTrips) / sizeof(_roundTrips[0]);
+
+        LinkStatistics result;
+        std::vector<uint32_t> samples;
+
+        result.exchanges = _channel.Counters();
+
+        _adminLock.Lock();
+
+        result.pings = _pings;
+        result.lostPings = _lostPings;
+
+        // Until the ring is full, the round trips are at its start.
+        const uint32_t received = _pings - _lostPings;
+        samples.assign(_roundTrips, _roundTrips + ((received >= Slots) ? Slots : received));
+
+        _adminLock.Unlock();
+
+        result.samples = static_cast<uint32_t>(samples.size());
+        result.roundTripMean = 0;
+        result.roundTripP99 = 0;
+
+        if (samples.empty() == false) {
+            uint64_t sum = 0;
+
+            for (const uint32_t sample : samples) {
+                sum += sample;
+            }
+
+            std::vector<uint32_t>::iterator percentile(samples.begin() + ((samples.size() * 99) / 100));
+            std::nth_element(samples.begin(), percentile, samples.end());
+
+            result.roundTripMean = static_cast<uint32_t>(sum / samples.size());
+            result.roundTripP99 = *percentile;
+        }
+
+        return (result);
     }
-    uint32_t SerialCommunicator::Setup(const SimpleSerial::Protocol::DeviceAddressType address, const string& config) const
+
+    uint32_t SerialCommunicator::LinkTest(const uint32_t length, const uint8_t size, LinkTestReport& report) const
     {
-        uint32_t result(Core::ERROR_INCOMPLETE_CONFIG);
+        uint32_t result = Core::ERROR_NONE;
+        uint32_t remaining = length;
 
-        SetupConfig SetupConfig;
-        SetupConfig.FromString(config);
+        report.frames = 0;
+        report.failed = 0;
+        report.bytes = 0;
+        report.duration = 0;
 
-        TRACE(Trace::Information, ("Setup device: 0x%02X", address));
+        if ((size == 0) || (size > SimpleSerial::Protocol::MaxPayloadSize)) {
+            result = Core::ERROR_BAD_REQUEST;
+        } else {
+            const uint64_t start = Core::Time::Now().Ticks();
 
-        if ((SetupConfig.Type.IsSet() == true) && (SetupConfig.Type.Value() == SimpleSerial::Payload::Peripheral::ROOT)) {
-            result = Core::ERROR_NOT_SUPPORTED;
-        } else if ((SetupConfig.Type.IsSet() == true) && (SetupConfig.Type.Value() == SimpleSerial::Payload::Peripheral::BLE)) {
-            BLEConfig bleConfig;
-            bleConfig.FromString(SetupConfig.Configuration.Value());
+            while ((remaining > 0) && (result == Core::ERROR_NONE) && (_active == true)) {
+                std::vector<std::unique_ptr<PingMessage>> pings;
+                std::vector<std::unique_ptr<PingMessage>> echoes;
+                std::vector<SimpleSerial::Protocol::Message*> requests;
+
+                // The responses are copied over the requests, keep the originals to compare with.
+                while ((pings.size() < _channel.Window(SimpleSerial::Protocol::OperationType::PING)) && (remaining > 0)) {
+                    const uint8_t chunk = static_cast<uint8_t>(std::min(static_cast<uint32_t>(size), remaining));
+
+                    pings.emplace_back(new PingMessage(chunk));
+                    echoes.emplace_back(new PingMessage(chunk));
+                    requests.push_back(echoes.back().get());
 
-            SettingsMessage bleSettings(address, bleConfig);
+                    remaining -= chunk;
+                }
 
-            result = _channel.Post(bleSettings, 1000);
+                const uint32_t outcome = _channel.Post(static_cast<uint8_t>(requests.size()), requests.data(), Timeout(SimpleSerial::Protocol::OperationType::PING) * Rounds(SimpleSerial::Protocol::OperationType::PING, requests.size()));
 
-            if ((result == Core::ERROR_NONE) && (bleSettings.Result() != SimpleSerial::Protocol::ResultType::OK)) {
-                TRACE(Trace::Error, ("Exchange BLE settings Failed: %d", static_cast<uint8_t>(bleSettings.Result())));
+                for (uint8_t index = 0; index < pings.size(); index++) {
+                    report.frames++;
+
+                    if (pings[index]->IsEcho(*echoes[index]) == true) {
+                        report.bytes += pings[index]->PayloadLength();
+                    } else {
+                        report.failed++;
+                    }
+                }
+
+                // A stalled link is the end of the test, a garbled frame is part of the result.
+                if ((outcome == Core::ERROR_TIMEDOUT) && (report.bytes == 0)) {
+                    result = outcome;
+                }
             }
-        } else if ((SetupConfig.Type.IsSet() == true) && (SetupConfig.Type.Value() == SimpleSerial::Payload::Peripheral::IR)) {
-            IRConfig irConfig;
-            irConfig.FromString(SetupConfig.Configuration.Value());
 
-            SettingsMessage irSettings(address, irConfig);
+            if ((result == Core::ERROR_NONE) && (remaining > 0)) {
+                result = Core::ERROR_ASYNC_ABORTED;
+            }
+
+            report.duration = Core::Time::Now().Ticks() - start;
+        }
+
+        return (result);
+    }
+
+    uint32_t SerialCommunicator::Transfer(const SimpleSerial::Protocol::DeviceAddressType address, const string& fileName, TransferCompletion&& completion) const
+    {
+        const TransferCompletion done(std::move(completion));
+
+        return (Schedule([this, address, fileName, done](const bool abort) {
+            TransferReport report = {};
 
-            result = _channel.Post(irSettings, 1000);
+            uint32_t result = Core::ERROR_ASYNC_ABORTED;
 
-            if ((result == Core::ERROR_NONE) && (irSettings.Result() != SimpleSerial::Protocol::ResultType::OK)) {
-                TRACE(Trace::Error, ("Exchange IR settings Failed: %d", static_cast<uint8_t>(irSettings.Result())));
+            if (abort == false) {
+                result = Transfer(address, fileName, report);
             }
+
+            done(result, report);
+        }));
+    }
+
+    uint32_t SerialCommunicator::LinkTest(const uint32_t length, const uint8_t size, LinkTestCompletion&& completion) const
+    {
+        uint32_t result = Core::ERROR_BAD_REQUEST;
+
+        if ((size > 0) && (size <= SimpleSerial::Protocol::MaxPayloadSize)) {
+            const LinkTestCompletion done(std::move(completion));
+
+            result = Schedule([this, length, size, done](const bool abort) {
+                LinkTestReport report = {};
+
+                uint32_t outcome = Core::ERROR_ASYNC_ABORTED;
+
+                if (abort == false) {
+                    outcome = LinkTest(length, size, report);
+                }
+
+                done(outcome, report);
+            });
         }
 
-        return result;
+        return (result);
+    }
+
+    // Bulk runs keep the link busy for seconds, they wait for each other on a job of their own
+    // instead of each keeping a worker thread.
+    uint32_t SerialCommunicator::Schedule(Task&& task) const
+    {
+        uint32_t result = Core::ERROR_ILLEGAL_STATE;
+
+        _adminLock.Lock();
+
+        if (_active == true) {
+            _tasks.push_back(std::move(task));
+            result = Core::ERROR_NONE;
+        }
+
+        _adminLock.Unlock();
+
+        if (result == Core::ERROR_NONE) {
+            _run.Submit();
+        }
+
+        return (result);
+    }
+
+    void SerialCommunicator::Run()
+    {
+        _adminLock.Lock();
+
+        while (_tasks.empty() == false) {
+            Task task(std::move(_tasks.front()));
+            _tasks.pop_front();
+
+            _adminLock.Unlock();
+
+            task(false);
+
+            _adminLock.Lock();
+        }
+
+        _adminLock.Unlock();
+    }
+
+    uint32_t SerialCommunicator::Replay(const string& fileName, const uint8_t speed, ReplayReport& report) const
+    {
+        // Closed and without retransmissions of its own, it only ever sees the capture.
+        SimpleSerial::DataExchange<SerialLink> channel;
+
+        uint32_t result = channel.Replay(fileName, speed, [this](const SimpleSerial::Protocol::OperationType operation) { return (Timeout(operation)); }, report);
+
+        if (result == Core::ERROR_NONE) {
+            TRACE(Trace::Information, ("Replayed %s: %d posted, %d answered, %d unanswered, %d diverged in %d ms", fileName.c_str(), report.posted, report.answered, report.unanswered, report.diverged, report.duration));
+        } else {
+            TRACE(Trace::Error, ("Replay of %s failed: %d", fileName.c_str(), result));
+        }
+
+        return (result);
+    }
+
+    uint32_t SerialCommunicator::Replay(const string& fileName, const uint8_t speed, ReplayCompletion&& completion) const
+    {
+        const ReplayCompletion done(std::move(completion));
+
+        return (Schedule([this, fileName, speed, done](const bool abort) {
+            ReplayReport report = {};
+            uint32_t result = Core::ERROR_ASYNC_ABORTED;
+
+            if (abort == false) {
+                result = Replay(fileName, speed, report);
+            }
+
+            done(result, report);
+        }));
+    }
+
+    void SerialCommunicator::Probe()
+    {
+        uint32_t roundTrip;
+
+        if (Ping(_pingSize, roundTrip) != Core::ERROR_NONE) {
+            TRACE(Trace::Error, ("Link monitor ping failed"));
+        }
+
+        const uint16_t interval = _monitorInterval;
+
+        if (interval > 0) {
+            _probe.Reschedule(Core::Time::Now().Add(interval * 1000));
+        }
+    }
+
+    void SerialCommunicator::Failed(const uint8_t failures)
+    {
+        _adminLock.Lock();
+        const bool raised = (_endpoint.baudrate != _baseBaudRate);
+        _adminLock.Unlock();
+
+        if ((failures >= MaxFailures) && (Gone() == true)) {
+            // Not every link notices a port that went away, requests just stop being answered.
+            Lost();
+        } else if ((failures >= MaxFailures) && (raised == true) && (_fallback.exchange(true) == false)) {
+            _job.Submit();
+        }
+    }
+
+    void SerialCommunicator::Dispatch()
+    {
+        if (_lost == true) {
+            Reopen();
+        } else {
+            if (_fallback.exchange(false) == true) {
+                Fallback();
+            } else {
+                // The endpoint restarted, maybe with other firmware.
+                Hello();
+            }
+
+            if (_channel.Framing() != _framing) {
+                Framing(_framing);
+            }
+            if (_channel.Checksum() != _checksum) {
+                Checksum(_checksum);
+            }
+
+            if (_channel.Link().IsStream() == false) {
+                Upgrade();
+            }
+        }
+    }
+
+    void SerialCommunicator::StateChange()
+    {
+        if (_channel.IsOpen() == false) {
+            Lost();
+        }
+    }
+
+    // The port went away under us, e.g. by a USB hub reset or a rebooting endpoint. Everything
+    // in flight and everything coming in fails with ERROR_CONNECTION_CLOSED, until Reopen()
+    // got the port back.
+    void SerialCommunicator::Lost()
+    {
+        if ((_active == true) && (_lost.exchange(true) == false)) {
+            TRACE(Trace::Error, ("Lost %s, reopening", _port.c_str()));
+
+            _channel.Suspend(Core::ERROR_CONNECTION_CLOSED);
+
+            // Whatever comes back will not report the end of a sequence it got before.
+            Abandon(Core::ERROR_CONNECTION_CLOSED);
+
+            Invalidate();
+
+            _reopenDelay = ReopenMin;
+            _job.Submit();
+        }
+    }
+
+    void SerialCommunicator::Reopen()
+    {
+        uint32_t result = Core::ERROR_NONE;
+
+        // A tty descriptor is stale for sure, a socket that dropped closed itself. Nobody but us
+        // opens the link again, so it stays closed while it is configured.
+        if (_channel.IsOpen() == true) {
+            _channel.Close(0);
+        }
+
+        if (_channel.Link().IsStream() == true) {
+            // A socket keeps its address, only a tty gets its settings applied again.
+            result = _channel.Open(1000);
+        } else if (_channel.Link().Configuration(
+                       _port,
+                       Core::SerialPort::Convert(_baseBaudRate),
+                       Core::SerialPort::NONE,
+                       Core::SerialPort::BITS_8,
+                       Core::SerialPort::BITS_1,
+                       _flowControl)
+            == Core::ERROR_NONE) {
+            result = _channel.Open(1000);
+        } else {
+            result = Core::ERROR_INCOMPLETE_CONFIG;
+        }
+
+        if ((result == Core::ERROR_NONE) && (_channel.IsOpen() == true)) {
+            TRACE(Trace::Information, ("Reopened %s", _port.c_str()));
+
+            _adminLock.Lock();
+            _device = Resolve(_port);
+            _estimates.clear();
+            _adminLock.Unlock();
+
+            // Whatever came back starts out on the preamble framing and the CRC8.
+            _channel.Framing(SimpleSerial::Protocol::FramingType::PREAMBLE);
+            _channel.Checksum(SimpleSerial::Protocol::ChecksumType::CRC8);
+
+            _lost = false;
+            _channel.Resume();
+
+            Handshake();
+            Restore();
+
+            // Read the device table again, so the first caller does not have to wait for it.
+            Devices([](const uint32_t, DeviceIterator&) {});
+
+            Publish(Notification(Notification::STARTED));
+        } else if (_active == true) {
+            _job.Reschedule(Core::Time::Now().Add(_reopenDelay));
+            _reopenDelay = std::min(_reopenDelay * 2, ReopenMax);
+        }
+    }
+
+    // Takes a freshly opened link to the configured framing, checksum, speed and options. Firmware
+    // from before the handshake keeps working as it did, on the preamble framing, the CRC8 and the
+    // configured baud rate. Not being able to switch is not fatal either.
+    void SerialCommunicator::Handshake()
+    {
+        _channel.Flush();
+
+        _adminLock.Lock();
+        _endpoint.baudrate = _baseBaudRate;
+        _endpoint.framing = SimpleSerial::Protocol::FramingType::PREAMBLE;
+        _endpoint.checksum = _channel.Checksum();
+        _adminLock.Unlock();
+
+        _channel.Sniff(true);
+
+        uint32_t result = Hello();
+
+        // Answers that only hold up under the other checksum come from an endpoint that was switched
+        // before we (re)started, it still is.
+        if ((result != Core::ERROR_NONE) && (result != Core::ERROR_NOT_SUPPORTED) && (_channel.Sniffed() > 0)) {
+            SimpleSerial::Protocol::ChecksumType other(SimpleSerial::Protocol::ChecksumType::CRC8);
+
+            if (_channel.Checksum() == SimpleSerial::Protocol::ChecksumType::CRC8) {
+                other = SimpleSerial::Protocol::ChecksumType::CRC32C;
+            }
+
+            TRACE(Trace::Information, ("Endpoint is on checksum %d already, following it", static_cast<uint8_t>(other)));
+
+            _channel.Checksum(other);
+
+            _adminLock.Lock();
+            _endpoint.checksum = other;
+            _adminLock.Unlock();
+
+            result = Hello();
+        }
+
+        _channel.Sniff(false);
+
+        if (result == Core::ERROR_NONE) {
+            if (_framing != SimpleSerial::Protocol::FramingType::PREAMBLE) {
+                Framing(_framing);
+            }
+            if (_channel.Checksum() != _checksum) {
+                Checksum(_checksum);
+            }
+
+            // Behind a socket the line speed is up to whatever serves the tty.
+            if (_channel.Link().IsStream() == false) {
+                Upgrade();
+            }
+
+            _adminLock.Lock();
+            const uint8_t version = _endpoint.version;
+            _adminLock.Unlock();
+
+            if ((_timing == true) && (version >= SimpleSerial::Protocol::TimingVersion)) {
+                _channel.Timing(true);
+            }
+            if (version >= SimpleSerial::Protocol::RetransmitVersion) {
+                _channel.Retries(_retries);
+            }
+        }
+    }
+
+    // Gives the devices the settings they got through Setup() before the port was lost.
+    void SerialCommunicator::Restore()
+    {
+        _adminLock.Lock();
+        const std::map<SimpleSerial::Protocol::DeviceAddressType, string> settings(_settings);
+        _adminLock.Unlock();
+
+        for (const std::pair<const SimpleSerial::Protocol::DeviceAddressType, string>& entry : settings) {
+            if (Setup(entry.first, entry.second) != Core::ERROR_NONE) {
+                TRACE(Trace::Error, ("Could not restore the settings of device 0x%02X", entry.first));
+            }
+        }
+    }
+
+    // The port is not there anymore, or its stable name points at another tty by now.
+    bool SerialCommunicator::Gone() const
+    {
+        bool result = false;
+
+        if (_channel.Link().IsStream() == false) {
+            const string device(Resolve(_port));
+
+            _adminLock.Lock();
+            result = ((device.empty() == true) || (device != _device));
+            _adminLock.Unlock();
+        }
+
+        return (result);
+    }
+
+    // The /dev/serial/by-id name of the port, if it has one.
+    /* static */ string SerialCommunicator::Stable(const string& port)
+    {
+        string result(port);
+        const string target(Resolve(port));
+
+        if ((target.empty() == false) && (port.compare(0, sizeof(SerialById) - 1, SerialById) != 0)) {
+            DIR* directory = ::opendir(SerialById);
+
+            if (directory != nullptr) {
+                struct dirent* entry;
+
+                while ((entry = ::readdir(directory)) != nullptr) {
+                    const string name(string(SerialById) + entry->d_name);
+
+                    if ((entry->d_name[0] != '.') && (Resolve(name) == target)) {
+                        TRACE(Trace::Information, ("Using %s for %s", name.c_str(), port.c_str()));
+                        result = name;
+                        break;
+                    }
+                }
+
+                ::closedir(directory);
+            }
+        }
+
+        return (result);
+    }
+
+    SerialCommunicator::Capabilities SerialCommunicator::Endpoint() const
+    {
+        _adminLock.Lock();
+        Capabilities result(_endpoint);
+        _adminLock.Unlock();
+
+        return (result);
+    }
+
+    uint32_t SerialCommunicator::Hello()
+    {
+        Channel::Response response;
+        HelloMessage message;
+
+        uint32_t result = _channel.Post(message, Timeout(message.Operation()), response);
+
+        if ((result == Core::ERROR_NONE) && (response->Result() == SimpleSerial::Protocol::ResultType::OK) && (response->PayloadLength() >= sizeof(SimpleSerial::Payload::Hello))) {
+            const SimpleSerial::Payload::Hello* hello(reinterpret_cast<const SimpleSerial::Payload::Hello*>(response->Payload()));
+            const uint8_t count = std::min(hello->baudrates, static_cast<uint8_t>((response->PayloadLength() - sizeof(SimpleSerial::Payload::Hello)) / sizeof(uint32_t)));
+
+            _adminLock.Lock();
+
+            _endpoint.version = hello->version;
+            _endpoint.payload = hello->payload;
+            _endpoint.operations = hello->operations;
+            _endpoint.build = string(hello->build, strnlen(hello->build, sizeof(hello->build)));
+            _endpoint.baudrates.clear();
+
+            for (uint8_t index = 0; index < count; index++) {
+                uint32_t rate;
+                memcpy(&rate, response->Payload() + sizeof(SimpleSerial::Payload::Hello) + (index * sizeof(rate)), sizeof(rate));
+                _endpoint.baudrates.push_back(rate);
+            }
+
+            // Every endpoint knows the CRC8, later ones tell what else they know after the baud rates.
+            const uint16_t checksums(sizeof(SimpleSerial::Payload::Hello) + (count * sizeof(uint32_t)));
+
+            if ((hello->version >= SimpleSerial::Protocol::ChecksumVersion) && (response->PayloadLength() > checksums)) {
+                _endpoint.checksums = response->Payload()[checksums];
+            } else {
+                _endpoint.checksums = (1U << static_cast<uint8_t>(SimpleSerial::Protocol::ChecksumType::CRC8));
+            }
+
+            TRACE(Trace::Information, ("Endpoint build %s, protocol version %d, %d baud rates, checksums 0x%02X", _endpoint.build.c_str(), _endpoint.version, count, _endpoint.checksums));
+
+            _adminLock.Unlock();
+        } else if ((result == Core::ERROR_NONE) && (response->Result() == SimpleSerial::Protocol::ResultType::OPERATION_INVALID)) {
+            TRACE(Trace::Information, ("Endpoint has no HELLO support, keeping the configured link settings"));
+            result = Core::ERROR_NOT_SUPPORTED;
+        } else if (result == Core::ERROR_NONE) {
+            TRACE(Trace::Error, ("Exchange Failed: %d", static_cast<uint8_t>(response->Result())));
+            result = Core::ERROR_GENERAL;
+        }
+
+        return result;
+    }
+
+    // Moves both sides of the link to another speed, confirmed by a HELLO at the new speed.
+    uint32_t SerialCommunicator::Baudrate(const uint32_t rate)
+    {
+        Channel::Response response;
+        BaudrateMessage message(rate);
+
+        uint32_t result = _channel.Post(message, Timeout(message.Operation()), response);
+
+        if ((result == Core::ERROR_NONE) && (response->Result() != SimpleSerial::Protocol::ResultType::OK)) {
+            TRACE(Trace::Error, ("Baud rate %d refused: %d", rate, static_cast<uint8_t>(response->Result())));
+            result = Core::ERROR_GENERAL;
+        } else if (result == Core::ERROR_NONE) {
+            _channel.Link().SetBaudRate(Core::SerialPort::Convert(rate));
+
+            // Round trips measured at the old speed say nothing about the new one.
+            _adminLock.Lock();
+            _endpoint.baudrate = rate;
+            _estimates.clear();
+            _adminLock.Unlock();
+
+            result = Hello();
+
+            TRACE(Trace::Information, ("Switched to %d baud: %s", rate, (result == Core::ERROR_NONE) ? "confirmed" : "failed"));
+        }
+
+        return result;
+    }
+
+    void SerialCommunicator::Expired(const SimpleSerial::Protocol::OperationType operation)
+    {
+        _adminLock.Lock();
+        _estimates[operation].Backoff();
+        _adminLock.Unlock();
+    }
+
+    uint32_t SerialCommunicator::Timeout(const SimpleSerial::Protocol::OperationType operation, const uint32_t deadline) const
+    {
+        uint32_t result(deadline);
+
+        if (result == 0) {
+            const TimeoutBounds* bounds(std::find_if(std::begin(Timeouts), std::end(Timeouts), [operation](const TimeoutBounds& entry) { return (entry.operation == operation); }));
+            const uint32_t floor((bounds != std::end(Timeouts)) ? bounds->floor : TimeoutFloor);
+            const uint32_t ceiling((bounds != std::end(Timeouts)) ? bounds->ceiling : TimeoutCeiling);
+
+            _adminLock.Lock();
+
+            std::map<SimpleSerial::Protocol::OperationType, RoundTripEstimate>::const_iterator index(_estimates.find(operation));
+
+            result = ((index != _estimates.end()) && (index->second.IsValid() == true)) ? std::min(std::max(index->second.Timeout(), floor), ceiling) : ceiling;
+
+            _adminLock.Unlock();
+
+            // Every attempt gets the full timeout.
+            result *= _channel.Attempts(operation);
+        }
+
+        return (result);
+    }
+
+    // Exchanges needed to get count requests of an operation through its lane's share of the window.
+    uint32_t SerialCommunicator::Rounds(const SimpleSerial::Protocol::OperationType operation, const size_t count) const
+    {
+        const uint32_t window(std::max(static_cast<uint32_t>(_channel.Window(operation)), 1u));
+
+        return ((static_cast<uint32_t>(count) + window - 1) / window);
+    }
+
+    void SerialCommunicator::Upgrade()
+    {
+        std::vector<uint32_t> candidates;
+
+        _adminLock.Lock();
+
+        for (const uint32_t rate : _endpoint.baudrates) {
+            if ((rate > _endpoint.baudrate) && ((_maxBaudRate == 0) || (rate <= _maxBaudRate))
+                && (std::find(std::begin(Baudrates), std::end(Baudrates), rate) != std::end(Baudrates))
+                && (std::find(_failedBaudRates.begin(), _failedBaudRates.end(), rate) == _failedBaudRates.end())) {
+                candidates.push_back(rate);
+            }
+        }
+
+        _adminLock.Unlock();
+
+        std::sort(candidates.begin(), candidates.end(), std::greater<uint32_t>());
+
+        for (const uint32_t rate : candidates) {
+            if (Baudrate(rate) == Core::ERROR_NONE) {
+                break;
+            }
+
+            _adminLock.Lock();
+            _failedBaudRates.push_back(rate);
+            _adminLock.Unlock();
+
+            Fallback();
+        }
+    }
+
+    // Takes the link back to the configured speed. The endpoint follows when it still hears us,
+    // otherwise it goes back by itself once it only receives noise for BaudrateConfirmTime.
+    void SerialCommunicator::Fallback()
+    {
+        _adminLock.Lock();
+        const uint32_t current = _endpoint.baudrate;
+
+        if ((current != _baseBaudRate) && (std::find(_failedBaudRates.begin(), _failedBaudRates.end(), current) == _failedBaudRates.end())) {
+            _failedBaudRates.push_back(current);
+        }
+        _adminLock.Unlock();
+
+        if (current != _baseBaudRate) {
+            uint32_t result = Core::ERROR_UNAVAILABLE;
+
+            TRACE(Trace::Error, ("Link failing at %d baud, back to %d baud", current, _baseBaudRate));
+
+            BaudrateMessage message(_baseBaudRate);
+            _channel.Post(message, 250);
+
+            _channel.Link().SetBaudRate(Core::SerialPort::Convert(_baseBaudRate));
+
+            _adminLock.Lock();
+            _endpoint.baudrate = _baseBaudRate;
+            _estimates.clear();
+            _adminLock.Unlock();
+
+            // Our frames at the old speed are noise to an endpoint that missed the switch,
+            // which sends it back within BaudrateConfirmTime.
+            for (uint8_t attempt = 0; (attempt < 3) && (result != Core::ERROR_NONE); attempt++) {
+                result = Hello();
+            }
+
+            if ((result != Core::ERROR_NONE) && ((_channel.Framing() != SimpleSerial::Protocol::FramingType::PREAMBLE) || (_channel.Checksum() != SimpleSerial::Protocol::ChecksumType::CRC8))) {
+                // Still nothing, an endpoint that restarted in the mean time is on the preamble framing and the CRC8.
+                _channel.Framing(SimpleSerial::Protocol::FramingType::PREAMBLE);
+                _channel.Checksum(SimpleSerial::Protocol::ChecksumType::CRC8);
+
+                _adminLock.Lock();
+                _endpoint.framing = SimpleSerial::Protocol::FramingType::PREAMBLE;
+                _endpoint.checksum = SimpleSerial::Protocol::ChecksumType::CRC8;
+                _adminLock.Unlock();
+
+                Hello();
+            }
+        }
+    }
+
+    uint32_t SerialCommunicator::Framing(const SimpleSerial::Protocol::FramingType framing)
+    {
+        Channel::Response response;
+        FramingMessage message(framing);
+
+        // Asked and answered in the current framing, the endpoint switches right after its answer.
+        uint32_t result = _channel.Post(message, Timeout(message.Operation()), response);
+
+        if ((result == Core::ERROR_NONE) && (response->Result() == SimpleSerial::Protocol::ResultType::OK)) {
+            _channel.Framing(framing);
+
+            _adminLock.Lock();
+            _endpoint.framing = framing;
+            _adminLock.Unlock();
+
+            TRACE(Trace::Information, ("Switched to framing: %d", static_cast<uint8_t>(framing)));
+        } else if ((result == Core::ERROR_NONE) && (response->Result() == SimpleSerial::Protocol::ResultType::OPERATION_INVALID)) {
+            TRACE(Trace::Information, ("Endpoint has no framing support, staying on the preamble framing"));
+            result = Core::ERROR_NOT_SUPPORTED;
+        } else if (result == Core::ERROR_NONE) {
+            TRACE(Trace::Error, ("Exchange Failed: %d", static_cast<uint8_t>(response->Result())));
+            result = Core::ERROR_GENERAL;
+        }
+
+        return result;
+    }
+
+    uint32_t SerialCommunicator::Checksum(const SimpleSerial::Protocol::ChecksumType checksum)
+    {
+        uint32_t result = Core::ERROR_NOT_SUPPORTED;
+
+        _adminLock.Lock();
+        const bool supported = ((_endpoint.version >= SimpleSerial::Protocol::ChecksumVersion) && (_endpoint.IsSupported(checksum) == true));
+        _adminLock.Unlock();
+
+        if (supported == false) {
+            TRACE(Trace::Information, ("Endpoint has no support for checksum %d, staying on checksum %d", static_cast<uint8_t>(checksum), static_cast<uint8_t>(_channel.Checksum())));
+        } else {
+            Channel::Response response;
+            ChecksumMessage message(checksum);
+
+            // Asked and answered under the current checksum, the endpoint switches right after its answer.
+            result = _channel.Post(message, Timeout(message.Operation()), response);
+
+            if ((result == Core::ERROR_NONE) && (response->Result() == SimpleSerial::Protocol::ResultType::OK)) {
+                _channel.Checksum(checksum);
+
+                _adminLock.Lock();
+                _endpoint.checksum = checksum;
+                _adminLock.Unlock();
+
+                TRACE(Trace::Information, ("Switched to checksum: %d", static_cast<uint8_t>(checksum)));
+            } else if (result == Core::ERROR_NONE) {
+                TRACE(Trace::Error, ("Exchange Failed: %d", static_cast<uint8_t>(response->Result())));
+                result = Core::ERROR_GENERAL;
+            }
+        }
+
+        return result;
+    }
+
+    uint32_t SerialCommunicator::Reset(const SimpleSerial::Protocol::DeviceAddressType address, const uint32_t deadline) const
+    {
+        uint32_t result(Core::ERROR_NONE);
+
+        TRACE(Trace::Information, ("Reset device: 0x%02X", address));
+
+        Channel::Response response;
+        ResetMessage message(address);
+
+        result = _channel.Post(message, Timeout(message.Operation(), deadline), response);
+
+        if ((result == Core::ERROR_NONE) && (response->Result() != SimpleSerial::Protocol::ResultType::OK)) {
+            TRACE(Trace::Error, ("Exchange Failed: %d", static_cast<uint8_t>(response->Result())));
+            result = Core::ERROR_GENERAL;
+        } else if (result == Core::ERROR_NONE) {
+            Remember(address, string());
+            Invalidate();
+        }
+
+        return result;
+    }
+    uint32_t SerialCommunicator::Setup(const SimpleSerial::Protocol::DeviceAddressType address, const string& config, const uint32_t deadline) const
+    {
+        std::unique_ptr<Message> request;
+
+        TRACE(Trace::Information, ("Setup device: 0x%02X", address));
+
+        uint32_t result = Settings(address, config, request);
+
+        if (result == Core::ERROR_NONE) {
+            result = _channel.Post(*request, Timeout(request->Operation(), deadline));
+
+            if ((result == Core::ERROR_NONE) && (request->Result() != SimpleSerial::Protocol::ResultType::OK)) {
+                TRACE(Trace::Error, ("Exchange settings Failed: %d", static_cast<uint8_t>(request->Result())));
+            } else if (result == Core::ERROR_NONE) {
+                Remember(address, config);
+                Invalidate();
+            }
+        }
+
+        return result;
+    }
+
+    uint32_t SerialCommunicator::Settings(const SimpleSerial::Protocol::DeviceAddressType address, const string& config, std::unique_ptr<Message>& request) const
+    {
+        uint32_t result(Core::ERROR_INCOMPLETE_CONFIG);
+
+        SetupConfig SetupConfig;
+        SetupConfig.FromString(config);
+
+        if ((SetupConfig.Type.IsSet() == true) && (SetupConfig.Type.Value() == SimpleSerial::Payload::Peripheral::ROOT)) {
+            result = Core::ERROR_NOT_SUPPORTED;
+        } else if ((SetupConfig.Type.IsSet() == true) && (SetupConfig.Type.Value() == SimpleSerial::Payload::Peripheral::BLE)) {
+            BLEConfig bleConfig;
+            bleConfig.FromString(SetupConfig.Configuration.Value());
+
+            request.reset(new SettingsMessage(address, bleConfig));
+            result = Core::ERROR_NONE;
+        } else if ((SetupConfig.Type.IsSet() == true) && (SetupConfig.Type.Value() == SimpleSerial::Payload::Peripheral::IR)) {
+            IRConfig irConfig;
+            irConfig.FromString(SetupConfig.Configuration.Value());
+
+            request.reset(new SettingsMessage(address, irConfig));
+            result = Core::ERROR_NONE;
+        }
+
+        return result;
+    }
+
+    // An empty config forgets the settings, a reset device is back on its defaults.
+    void SerialCommunicator::Remember(const SimpleSerial::Protocol::DeviceAddressType address, const string& config) const
+    {
+        _adminLock.Lock();
+
+        if (config.empty() == true) {
+            _settings.erase(address);
+        } else {
+            _settings[address] = config;
+        }
+
+        _adminLock.Unlock();
+    }
+
+    /* static */ uint32_t SerialCommunicator::Outcome(const uint32_t result, const Channel::Response& response)
+    {
+        uint32_t outcome(result);
+
+        if ((outcome == Core::ERROR_NONE) && (response->Result() != SimpleSerial::Protocol::ResultType::OK)) {
+            TRACE_GLOBAL(Trace::Error, ("Exchange Failed: %d", static_cast<uint8_t>(response->Result())));
+            outcome = Core::ERROR_GENERAL;
+        }
+
+        return (outcome);
+    }
+
+    uint32_t SerialCommunicator::KeyEvent(const SimpleSerial::Protocol::DeviceAddressType address, const bool pressed, const uint16_t code, Completion&& completion, const uint32_t deadline) const
+    {
+        KeyMessage message(address, code, pressed);
+
+        return (_channel.Post(message, Timeout(message.Operation(), deadline), [completion](const uint32_t result, const Channel::Response& response) {
+            completion(Outcome(result, response));
+        }));
+    }
+
+    uint32_t SerialCommunicator::Reset(const SimpleSerial::Protocol::DeviceAddressType address, Completion&& completion, const uint32_t deadline) const
+    {
+        ResetMessage message(address);
+
+        TRACE(Trace::Information, ("Reset device: 0x%02X", address));
+
+        return (_channel.Post(message, Timeout(message.Operation(), deadline), [this, address, completion](const uint32_t result, const Channel::Response& response) {
+            const uint32_t outcome(Outcome(result, response));
+
+            if (outcome == Core::ERROR_NONE) {
+                Remember(address, string());
+                Invalidate();
+            }
+
+            completion(outcome);
+        }));
+    }
+
+    uint32_t SerialCommunicator::Setup(const SimpleSerial::Protocol::DeviceAddressType address, const string& config, Completion&& completion, const uint32_t deadline) const
+    {
+        std::unique_ptr<Message> request;
+
+        TRACE(Trace::Information, ("Setup device: 0x%02X", address));
+
+        uint32_t result = Settings(address, config, request);
+
+        if (result == Core::ERROR_NONE) {
+            // Like the blocking Setup(), a refusal of the endpoint is only traced.
+            result = _channel.Post(*request, Timeout(request->Operation(), deadline), [this, address, config, completion](const uint32_t result, const Channel::Response& response) {
+                if ((result == Core::ERROR_NONE) && (response->Result() != SimpleSerial::Protocol::ResultType::OK)) {
+                    TRACE_GLOBAL(Trace::Error, ("Exchange settings Failed: %d", static_cast<uint8_t>(response->Result())));
+                } else if (result == Core::ERROR_NONE) {
+                    Remember(address, config);
+                    Invalidate();
+                }
+                completion(result);
+            });
+        }
+
+        return result;
+    }
+
+    uint32_t SerialCommunicator::KeyEvents(const std::vector<SimpleSerial::Payload::KeyBatchEvent>& events, KeysCompletion&& completion, const uint32_t deadline) const
+    {
+        uint32_t result = Core::ERROR_BAD_REQUEST;
+
+        if (events.empty() == false) {
+            std::shared_ptr<KeyBatch> batch(new KeyBatch());
+
+            batch->events = events;
+            batch->results.reserve(events.size());
+            batch->end = Core::Time::Now().Ticks() + (static_cast<uint64_t>(deadline) * Core::Time::TicksPerMillisecond);
+            batch->deadline = deadline;
+            batch->completion = std::move(completion);
+
+            result = Batch(batch);
+        }
+
+        return result;
+    }
+
+    // Packs the next events in as few frames as possible, the endpoint applies them in order.
+    uint32_t SerialCommunicator::Batch(const std::shared_ptr<KeyBatch>& batch) const
+    {
+        uint32_t result = Core::ERROR_TIMEDOUT;
+        const uint32_t offset = static_cast<uint32_t>(batch->results.size());
+        const uint8_t count = static_cast<uint8_t>(std::min(static_cast<uint32_t>(batch->events.size() - offset), static_cast<uint32_t>(SimpleSerial::Payload::MaxKeyBatch)));
+        const uint64_t now = Core::Time::Now().Ticks();
+
+        KeyBatchMessage message(count, &batch->events[offset]);
+
+        if ((batch->deadline == 0) || (now < batch->end)) {
+            const uint32_t timeout = (batch->deadline == 0) ? Timeout(message.Operation()) : static_cast<uint32_t>((batch->end - now) / Core::Time::TicksPerMillisecond);
+
+            result = _channel.Post(message, timeout, [this, batch, count](const uint32_t result, const Channel::Response& response) {
+                Batched(batch, count, result, response);
+            });
+        }
+
+        return result;
+    }
+
+    void SerialCommunicator::Batched(const std::shared_ptr<KeyBatch>& batch, const uint8_t count, const uint32_t result, const Channel::Response& response) const
+    {
+        uint32_t outcome = result;
+
+        if ((outcome == Core::ERROR_NONE) && ((response->PayloadLength() / sizeof(SimpleSerial::Protocol::ResultType)) != count)) {
+            TRACE(Trace::Error, ("Exchange Failed: %d results for %d events", response->PayloadLength() / sizeof(SimpleSerial::Protocol::ResultType), count));
+            outcome = Core::ERROR_GENERAL;
+        } else if (outcome == Core::ERROR_NONE) {
+            const SimpleSerial::Protocol::ResultType* results(reinterpret_cast<const SimpleSerial::Protocol::ResultType*>(response->Payload()));
+
+            batch->results.insert(batch->results.end(), results, results + count);
+
+            if (response->Result() != SimpleSerial::Protocol::ResultType::OK) {
+                TRACE(Trace::Error, ("Exchange Failed: %d", static_cast<uint8_t>(response->Result())));
+            }
+
+            if (batch->results.size() < batch->events.size()) {
+                outcome = Batch(batch);
+
+                // The completion of the next frame takes it from here.
+                if (outcome == Core::ERROR_NONE) {
+                    return;
+                }
+            }
+        }
+
+        if ((outcome == Core::ERROR_NONE) && (std::find_if(batch->results.begin(), batch->results.end(), [](const SimpleSerial::Protocol::ResultType entry) { return (entry != SimpleSerial::Protocol::ResultType::OK); }) != batch->results.end())) {
+            outcome = Core::ERROR_GENERAL;
+        }
+
+        batch->completion(outcome, batch->results);
+    }
+
+    uint32_t SerialCommunicator::Sequence(const SimpleSerial::Protocol::DeviceAddressType address, const std::vector<SimpleSerial::Payload::SequenceStep>& steps, Completion&& completion, const uint32_t deadline) const
+    {
+        uint32_t result = Core::ERROR_NONE;
+        uint64_t duration = 0;
+
+        if ((steps.empty() == true) || (steps.size() > SimpleSerial::Payload::MaxSequenceSteps)) {
+            result = Core::ERROR_INVALID_INPUT_LENGTH;
+        } else {
+            for (const SimpleSerial::Payload::SequenceStep& step : steps) {
+                if (step.action == SimpleSerial::Payload::SequenceAction::DELAY) {
+                    duration += step.value;
+                }
+            }
+
+            SequenceMessage message(address, static_cast<uint8_t>(steps.size()), steps.data());
+
+            const uint64_t start = Core::Time::Now().Ticks();
+            const uint32_t timeout = Timeout(message.Operation(), deadline);
+
+            result = _channel.Post(message, timeout, [this, start, duration, timeout, deadline, completion](const uint32_t result, const Channel::Response& response) {
+                const uint32_t outcome(Outcome(result, response));
+
+                if (outcome != Core::ERROR_NONE) {
+                    completion(outcome);
+                } else {
+                    // Without a deadline the endpoint gets another exchange worth of time after the last step.
+                    const uint64_t end = (deadline != 0) ? start + (static_cast<uint64_t>(deadline) * Core::Time::TicksPerMillisecond) : Core::Time::Now().Ticks() + duration + (static_cast<uint64_t>(timeout) * Core::Time::TicksPerMillisecond);
+
+                    Follow(response->Sequence(), start, end, completion);
+                }
+            });
+        }
+
+        return result;
+    }
+
+    // The endpoint accepted the sequence, its completion EVENT tells how it ended.
+    void SerialCommunicator::Follow(const SimpleSerial::Protocol::SequenceType id, const uint64_t start, const uint64_t end, const Completion& completion) const
+    {
+        uint32_t result = Core::ERROR_NONE;
+        Completion replaced;
+        bool reported = false;
+        bool reschedule = false;
+
+        _adminLock.Lock();
+
+        std::map<SimpleSerial::Protocol::SequenceType, std::pair<SimpleSerial::Protocol::ResultType, uint64_t>>::iterator index(_sequences.find(id));
+
+        if ((index != _sequences.end()) && (index->second.second < start)) {
+            // Left behind by an earlier sequence that timed out with the same id.
+            _sequences.erase(index);
+            index = _sequences.end();
+        }
+
+        if (index != _sequences.end()) {
+            result = (index->second.first == SimpleSerial::Protocol::ResultType::OK) ? Core::ERROR_NONE : Core::ERROR_GENERAL;
+            reported = true;
+            _sequences.erase(index);
+        } else {
+            std::pair<uint64_t, Completion>& entry(_running[id]);
+
+            // An earlier sequence with the same id never reported back, it will not anymore.
+            replaced = std::move(entry.second);
+
+            entry.first = end;
+            entry.second = completion;
+
+            reschedule = ((_sequenceExpiry == 0) || (end < _sequenceExpiry));
+
+            if (reschedule == true) {
+                _sequenceExpiry = end;
+            }
+        }
+
+        _adminLock.Unlock();
+
+        if (replaced != nullptr) {
+            replaced(Core::ERROR_TIMEDOUT);
+        }
+
+        if (reported == true) {
+            completion(result);
+        } else if (reschedule == true) {
+            const uint64_t now = Core::Time::Now().Ticks();
+
+            _expire.Reschedule(Core::Time::Now().Add((end > now) ? static_cast<uint32_t>((end - now + Core::Time::TicksPerMillisecond - 1) / Core::Time::TicksPerMillisecond) : 0));
+        }
+    }
+
+    // Ends the sequences that did not report back in time.
+    void SerialCommunicator::Expire()
+    {
+        const uint64_t now = Core::Time::Now().Ticks();
+        std::list<Completion> expired;
+        uint64_t next = 0;
+
+        _adminLock.Lock();
+
+        std::map<SimpleSerial::Protocol::SequenceType, std::pair<uint64_t, Completion>>::iterator index(_running.begin());
+
+        while (index != _running.end()) {
+            if (index->second.first <= now) {
+                expired.push_back(std::move(index->second.second));
+                index = _running.erase(index);
+            } else {
+                next = ((next == 0) || (index->second.first < next)) ? index->second.first : next;
+                ++index;
+            }
+        }
+
+        _sequenceExpiry = next;
+
+        _adminLock.Unlock();
+
+        if (next != 0) {
+            _expire.Reschedule(Core::Time::Now().Add(static_cast<uint32_t>((next - now + Core::Time::TicksPerMillisecond - 1) / Core::Time::TicksPerMillisecond)));
+        }
+
+        for (Completion& completion : expired) {
+            TRACE(Trace::Error, ("Sequence did not complete in time"));
+            completion(Core::ERROR_TIMEDOUT);
+        }
+    }
+
+    // Ends all sequences the endpoint runs with the given reason.
+    void SerialCommunicator::Abandon(const uint32_t reason)
+    {
+        std::map<SimpleSerial::Protocol::SequenceType, std::pair<uint64_t, Completion>> running;
+
+        _adminLock.Lock();
+        running.swap(_running);
+        _sequences.clear();
+        _sequenceExpiry = 0;
+        _adminLock.Unlock();
+
+        for (std::pair<const SimpleSerial::Protocol::SequenceType, std::pair<uint64_t, Completion>>& entry : running) {
+            entry.second.second(reason);
+        }
+    }
+
+    uint32_t SerialCommunicator::Devices(DevicesCompletion&& completion) const
+    {
+        _adminLock.Lock();
+
+        if (_devices.IsValid() == true) {
+            DeviceIterator devices(_devices);
+
+            _adminLock.Unlock();
+
+            completion(Core::ERROR_NONE, devices);
+        } else {
+            const bool query = (_readers.empty() == true);
+            const uint32_t generation = _generation;
+
+            _readers.push_back(std::move(completion));
+
+            _adminLock.Unlock();
+
+            if (query == true) {
+                StateMessage message(static_cast<SimpleSerial::Protocol::DeviceAddressType>(SimpleSerial::Payload::Peripheral::ROOT));
+
+                const uint32_t result = _channel.Post(message, Timeout(message.Operation()), [this, generation](const uint32_t result, const Channel::Response& response) {
+                    Refreshed(generation, result, response);
+                });
+
+                // Refused right away, e.g. while the port is being reopened.
+                if (result != Core::ERROR_NONE) {
+                    Refreshed(generation, result, Channel::Response());
+                }
+            }
+        }
+
+        return (Core::ERROR_NONE);
+    }
+
+    void SerialCommunicator::Refreshed(const uint32_t generation, const uint32_t result, const Channel::Response& response) const
+    {
+        const uint32_t outcome(Outcome(result, response));
+        std::list<DevicesCompletion> readers;
+
+        _adminLock.Lock();
+
+        if ((outcome == Core::ERROR_NONE) && (generation == _generation)) {
+            _devices = response;
+        }
+
+        readers.swap(_readers);
+
+        _adminLock.Unlock();
+
+        if (outcome == Core::ERROR_NONE) {
+            TRACE(Trace::Information, ("Got %d devices", response->PayloadLength() / sizeof(SimpleSerial::Payload::Device)));
+        }
+
+        for (DevicesCompletion& reader : readers) {
+            DeviceIterator devices((outcome == Core::ERROR_NONE) ? response : Channel::Response());
+
+            reader(outcome, devices);
+        }
     }
 } // namespace Doofah
 } // namespace Thunder
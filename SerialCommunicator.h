@@ -22,13 +22,25 @@
 #include "Module.h"
 
 #include "DataExchange.h"
+#include "Link.h"
 #include "SimpleSerial.h"
 
-#include <list>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
 
 namespace Thunder {
 
 namespace Doofah {
+#ifdef DOOFAH_REACTOR
+    // Links share a small pool of epoll threads, for plugins driving many endpoints.
+    typedef SimpleSerial::LinkType<SimpleSerial::ReactorPort> SerialLink;
+#else
+    typedef SimpleSerial::LinkType<Core::SerialPort> SerialLink;
+#endif
+
     class SerialCommunicator {
     private:
         class SerialConfig : public Core::JSON::Container {
@@ -42,10 +54,30 @@ namespace Doofah {
                 , Port(_T("/dev/ttyUSB0"))
                 , BaudRate(115200)
                 , FlowControl(Core::SerialPort::OFF)
+                , Window(SimpleSerial::DataExchange<SerialLink>::DefaultWindow)
+                , Framing(SimpleSerial::Protocol::FramingType::PREAMBLE)
+                , Checksum(SimpleSerial::Protocol::ChecksumType::CRC8)
+                , MaxBaudRate(0)
+                , Timing(false)
+                , Monitor(10)
+                , PingSize(16)
+                , Retries(2)
+                , Capture()
+                , CaptureSize(1024)
             {
                 Add(_T("port"), &Port);
                 Add(_T("baudrate"), &BaudRate);
                 Add(_T("flowcontrol"), &FlowControl);
+                Add(_T("window"), &Window);
+                Add(_T("framing"), &Framing);
+                Add(_T("checksum"), &Checksum);
+                Add(_T("maxbaudrate"), &MaxBaudRate);
+                Add(_T("timing"), &Timing);
+                Add(_T("monitor"), &Monitor);
+                Add(_T("pingsize"), &PingSize);
+                Add(_T("retries"), &Retries);
+                Add(_T("capture"), &Capture);
+                Add(_T("capturesize"), &CaptureSize);
             }
             ~SerialConfig()
             {
@@ -55,6 +87,16 @@ namespace Doofah {
             Core::JSON::String Port;
             Core::JSON::DecUInt32 BaudRate;
             Core::JSON::EnumType<Core::SerialPort::FlowControl> FlowControl;
+            Core::JSON::DecUInt8 Window;
+            Core::JSON::EnumType<SimpleSerial::Protocol::FramingType> Framing;
+            Core::JSON::EnumType<SimpleSerial::Protocol::ChecksumType> Checksum;
+            Core::JSON::DecUInt32 MaxBaudRate;
+            Core::JSON::Boolean Timing;
+            Core::JSON::DecUInt16 Monitor;
+            Core::JSON::DecUInt8 PingSize;
+            Core::JSON::DecUInt8 Retries;
+            Core::JSON::String Capture;
+            Core::JSON::DecUInt32 CaptureSize; // In KB
         };
 
         class BLEConfig : public Core::JSON::Container {
@@ -138,8 +180,9 @@ namespace Doofah {
             {
                 Clear();
 
+                // The sequence id is handed out by the link when the message is posted.
                 Operation(operation);
-                Sequence(SimpleSerial::GetSequence());
+                Sequence(0);
                 Address(address);
             }
         };
@@ -150,8 +193,8 @@ namespace Doofah {
             KeyMessage(const KeyMessage&) = delete;
             KeyMessage& operator=(const KeyMessage&) = delete;
 
-            KeyMessage(const SimpleSerial::Protocol::DeviceAddressType address, const uint16_t keyCode, const bool pressed)
-                : Message(SimpleSerial::Protocol::OperationType::KEY, address)
+            KeyMessage(const SimpleSerial::Protocol::DeviceAddressType address, const uint16_t keyCode, const bool pressed, const bool acknowledge = true)
+                : Message((acknowledge == true) ? SimpleSerial::Protocol::OperationType::KEY : SimpleSerial::Protocol::OperationType::KEY_NOACK, address)
             {
                 SimpleSerial::Payload::KeyEvent payload;
 
@@ -162,47 +205,135 @@ namespace Doofah {
             }
         };
 
-        class StateMessage : public Message {
+        class KeyBatchMessage : public Message {
         public:
-            StateMessage() = delete;
-            StateMessage(const StateMessage&) = delete;
-            StateMessage& operator=(const StateMessage&) = delete;
+            KeyBatchMessage() = delete;
+            KeyBatchMessage(const KeyBatchMessage&) = delete;
+            KeyBatchMessage& operator=(const KeyBatchMessage&) = delete;
 
-            StateMessage(const SimpleSerial::Protocol::DeviceAddressType address)
-                : Message(SimpleSerial::Protocol::OperationType::STATE, address)
-                , _offset(~0)
+            KeyBatchMessage(const uint8_t count, const SimpleSerial::Payload::KeyBatchEvent events[])
+                : Message(SimpleSerial::Protocol::OperationType::KEY_BATCH, static_cast<SimpleSerial::Protocol::DeviceAddressType>(SimpleSerial::Payload::Peripheral::ROOT))
             {
-                PayloadLength(0);
+                ASSERT(count <= SimpleSerial::Payload::MaxKeyBatch);
+
+                Payload(count * sizeof(SimpleSerial::Payload::KeyBatchEvent), reinterpret_cast<const uint8_t*>(events));
             }
 
-            inline bool IsValidPayload() const
+            inline uint8_t Results() const
             {
-                return (_offset < PayloadLength());
+                return (PayloadLength() / sizeof(SimpleSerial::Protocol::ResultType));
             }
+            inline SimpleSerial::Protocol::ResultType EventResult(const uint8_t index) const
+            {
+                ASSERT(index < Results());
+                return (reinterpret_cast<const SimpleSerial::Protocol::ResultType*>(Payload())[index]);
+            }
+        };
 
-            inline bool Next()
+        class SequenceMessage : public Message {
+        public:
+            SequenceMessage() = delete;
+            SequenceMessage(const SequenceMessage&) = delete;
+            SequenceMessage& operator=(const SequenceMessage&) = delete;
+
+            SequenceMessage(const SimpleSerial::Protocol::DeviceAddressType address, const uint8_t count, const SimpleSerial::Payload::SequenceStep steps[])
+                : Message(SimpleSerial::Protocol::OperationType::SEQUENCE, address)
+            {
+                ASSERT(count <= SimpleSerial::Payload::MaxSequenceSteps);
+
+                Payload(count * sizeof(SimpleSerial::Payload::SequenceStep), reinterpret_cast<const uint8_t*>(steps));
+            }
+        };
+
+        class TransferMessage : public Message {
+        public:
+            TransferMessage() = delete;
+            TransferMessage(const TransferMessage&) = delete;
+            TransferMessage& operator=(const TransferMessage&) = delete;
+
+            TransferMessage(const SimpleSerial::Protocol::OperationType operation, const SimpleSerial::Protocol::DeviceAddressType address)
+                : Message(operation, address)
             {
-                if (_offset == static_cast<uint8_t>(~0)) {
-                    _offset = 0;
-                } else if (_offset < PayloadLength()) {
-                    _offset += sizeof(SimpleSerial::Payload::Device);
+                PayloadLength(0);
+            }
+
+            // Only a response carries the offset the endpoint expects next.
+            inline bool State(uint32_t& offset) const
+            {
+                bool result((IsValid() == true) && (PayloadLength() == sizeof(SimpleSerial::Payload::TransferState)));
+
+                if (result == true) {
+                    offset = reinterpret_cast<const SimpleSerial::Payload::TransferState*>(Payload())->offset;
                 }
 
-                return IsValidPayload();
+                return (result);
             }
+        };
+
+        class TransferBeginMessage : public TransferMessage {
+        public:
+            TransferBeginMessage() = delete;
+            TransferBeginMessage(const TransferBeginMessage&) = delete;
+            TransferBeginMessage& operator=(const TransferBeginMessage&) = delete;
+
+            TransferBeginMessage(const SimpleSerial::Protocol::DeviceAddressType address, const uint32_t size, const uint32_t crc)
+                : TransferMessage(SimpleSerial::Protocol::OperationType::TRANSFER_BEGIN, address)
+            {
+                SimpleSerial::Payload::TransferBegin payload;
+
+                payload.size = size;
+                payload.crc = crc;
+
+                Payload(sizeof(payload), reinterpret_cast<const uint8_t*>(&payload));
+            }
+        };
 
-            void Reset()
+        class TransferChunkMessage : public TransferMessage {
+        public:
+            TransferChunkMessage() = delete;
+            TransferChunkMessage(const TransferChunkMessage&) = delete;
+            TransferChunkMessage& operator=(const TransferChunkMessage&) = delete;
+
+            TransferChunkMessage(const SimpleSerial::Protocol::DeviceAddressType address, const uint32_t offset, const uint8_t length, const uint8_t data[])
+                : TransferMessage(SimpleSerial::Protocol::OperationType::TRANSFER_CHUNK, address)
             {
-                _offset = ~0;
+                uint8_t payload[SimpleSerial::Protocol::MaxPayloadSize];
+                SimpleSerial::Payload::TransferChunk header;
+
+                ASSERT(length <= SimpleSerial::Payload::MaxTransferChunk);
+
+                header.offset = offset;
+
+                memcpy(payload, &header, sizeof(header));
+                memcpy(&payload[sizeof(header)], data, length);
+
+                Payload(sizeof(header) + length, payload);
             }
+        };
+
+        class TransferCommitMessage : public TransferMessage {
+        public:
+            TransferCommitMessage() = delete;
+            TransferCommitMessage(const TransferCommitMessage&) = delete;
+            TransferCommitMessage& operator=(const TransferCommitMessage&) = delete;
 
-            const SimpleSerial::Payload::Device* Current()
+            TransferCommitMessage(const SimpleSerial::Protocol::DeviceAddressType address)
+                : TransferMessage(SimpleSerial::Protocol::OperationType::TRANSFER_COMMIT, address)
             {
-                return (IsValidPayload() == true) ? reinterpret_cast<const SimpleSerial::Payload::Device*>(Payload() + _offset) : nullptr;
             }
+        };
 
-        private:
-            uint8_t _offset;
+        class StateMessage : public Message {
+        public:
+            StateMessage() = delete;
+            StateMessage(const StateMessage&) = delete;
+            StateMessage& operator=(const StateMessage&) = delete;
+
+            StateMessage(const SimpleSerial::Protocol::DeviceAddressType address)
+                : Message(SimpleSerial::Protocol::OperationType::STATE, address)
+            {
+                PayloadLength(0);
+            }
         };
 
         class SettingsMessage : public Message {
@@ -268,17 +399,328 @@ namespace Doofah {
             }
         };
 
+        class HelloMessage : public Message {
+        public:
+            HelloMessage(const HelloMessage&) = delete;
+            HelloMessage& operator=(const HelloMessage&) = delete;
+
+            HelloMessage()
+                : Message(SimpleSerial::Protocol::OperationType::HELLO, static_cast<SimpleSerial::Protocol::DeviceAddressType>(SimpleSerial::Payload::Peripheral::ROOT))
+            {
+                PayloadLength(0);
+            }
+        };
+
+        class BaudrateMessage : public Message {
+        public:
+            BaudrateMessage() = delete;
+            BaudrateMessage(const BaudrateMessage&) = delete;
+            BaudrateMessage& operator=(const BaudrateMessage&) = delete;
+
+            BaudrateMessage(const uint32_t rate)
+                : Message(SimpleSerial::Protocol::OperationType::BAUDRATE, static_cast<SimpleSerial::Protocol::DeviceAddressType>(SimpleSerial::Payload::Peripheral::ROOT))
+            {
+                SimpleSerial::Payload::Baudrate payload;
+                payload.rate = rate;
+
+                Payload(sizeof(payload), reinterpret_cast<uint8_t*>(&payload));
+            }
+        };
+
+        class FramingMessage : public Message {
+        public:
+            FramingMessage() = delete;
+            FramingMessage(const FramingMessage&) = delete;
+            FramingMessage& operator=(const FramingMessage&) = delete;
+
+            FramingMessage(const SimpleSerial::Protocol::FramingType framing)
+                : Message(SimpleSerial::Protocol::OperationType::FRAMING, static_cast<SimpleSerial::Protocol::DeviceAddressType>(SimpleSerial::Payload::Peripheral::ROOT))
+            {
+                SimpleSerial::Payload::Framing payload;
+                payload.type = framing;
+
+                Payload(sizeof(payload), reinterpret_cast<uint8_t*>(&payload));
+            }
+        };
+
+        class ChecksumMessage : public Message {
+        public:
+            ChecksumMessage() = delete;
+            ChecksumMessage(const ChecksumMessage&) = delete;
+            ChecksumMessage& operator=(const ChecksumMessage&) = delete;
+
+            ChecksumMessage(const SimpleSerial::Protocol::ChecksumType checksum)
+                : Message(SimpleSerial::Protocol::OperationType::CHECKSUM, static_cast<SimpleSerial::Protocol::DeviceAddressType>(SimpleSerial::Payload::Peripheral::ROOT))
+            {
+                SimpleSerial::Payload::Checksum payload;
+                payload.type = checksum;
+
+                Payload(sizeof(payload), reinterpret_cast<uint8_t*>(&payload));
+            }
+        };
+
+        class PingMessage : public Message {
+        public:
+            PingMessage() = delete;
+            PingMessage(const PingMessage&) = delete;
+            PingMessage& operator=(const PingMessage&) = delete;
+
+            // No peripheral is involved. The invalid address keeps a request that was never
+            // answered from passing for an OK result, as both share the same byte.
+            PingMessage(const uint8_t size)
+                : Message(SimpleSerial::Protocol::OperationType::PING, SimpleSerial::Protocol::InvalidAddress)
+            {
+                uint8_t payload[SimpleSerial::Protocol::MaxPayloadSize];
+                const uint8_t length = std::min(size, SimpleSerial::Protocol::MaxPayloadSize);
+
+                for (uint8_t index = 0; index < length; index++) {
+                    payload[index] = Pattern(index);
+                }
+
+                if (length > 0) {
+                    Payload(length, payload);
+                } else {
+                    PayloadLength(0);
+                }
+            }
+
+        public:
+            // Did the payload come back unaltered.
+            bool IsEcho(const SimpleSerial::Protocol::Message& response) const
+            {
+                return ((response.IsValid() == true) && (response.Result() == SimpleSerial::Protocol::ResultType::OK) && (response.PayloadLength() == PayloadLength()) && (::memcmp(response.Payload(), Payload(), PayloadLength()) == 0));
+            }
+
+        private:
+            // Runs through all byte values, including the preamble and the COBS delimiter.
+            static uint8_t Pattern(const uint8_t index)
+            {
+                return (static_cast<uint8_t>(index * 0x9D));
+            }
+        };
+
     public:
+        struct TransferReport {
+            uint32_t size; // Bytes in the blob
+            uint32_t sent; // Bytes put on the link, including the resent ones
+            uint32_t resumes; // Times the transfer continued from the endpoints offset
+            uint64_t duration; // Microseconds from begin up to and including the commit
+
+            inline uint32_t Throughput() const
+            {
+                return ((duration > 0) ? static_cast<uint32_t>((static_cast<uint64_t>(size) * Core::Time::MicroSecondsPerSecond) / duration) : 0);
+            }
+        };
+
+        // What the endpoint reported in its HELLO and the state of the link to it.
+        struct Capabilities {
+            uint8_t version; // Zero when the endpoint does not know HELLO
+            uint8_t payload;
+            uint32_t operations;
+            string build;
+            std::vector<uint32_t> baudrates;
+            uint32_t baudrate; // Current speed of the link
+            uint8_t checksums; // Bit n is set when ChecksumType n is supported
+            SimpleSerial::Protocol::FramingType framing; // Current framing of the link
+            SimpleSerial::Protocol::ChecksumType checksum; // Current checksum of the link
+
+            inline bool IsSupported(const SimpleSerial::Protocol::OperationType operation) const
+            {
+                return ((static_cast<uint8_t>(operation) < 32) && ((operations & (1UL << static_cast<uint8_t>(operation))) != 0));
+            }
+            inline bool IsSupported(const SimpleSerial::Protocol::ChecksumType type) const
+            {
+                return ((checksums & (1U << static_cast<uint8_t>(type))) != 0);
+            }
+        };
+
         struct ICallback {
             virtual ~ICallback() = default;
             // @brief Signals that the endpoint is started
             virtual void Started() = 0;
+            // @brief Signals that an unacknowledged key action failed on the endpoint
+            virtual void KeyError(const SimpleSerial::Protocol::DeviceAddressType address, const uint16_t code, const bool pressed, const SimpleSerial::Protocol::ResultType result) = 0;
+            // @brief Signals that the button on the endpoint was clicked
+            virtual void Button() = 0;
+        };
+
+        typedef SimpleSerial::DataExchange<SerialLink>::Stages Stages;
+        typedef SimpleSerial::DataExchange<SerialLink>::LaneStatistics LaneStatistics;
+        typedef SimpleSerial::DataExchange<SerialLink>::ReplayReport ReplayReport;
+
+        // Health of the link, the round trips are those of the recent pings.
+        struct LinkStatistics {
+            uint32_t roundTripMean; // Microseconds
+            uint32_t roundTripP99; // Microseconds
+            uint32_t samples; // Pings the round trips are taken from
+            uint32_t pings;
+            uint32_t lostPings; // Timed out or not echoed unaltered
+            SimpleSerial::DataExchange<SerialLink>::Statistics exchanges;
+        };
+
+        struct LinkTestReport {
+            uint32_t frames; // Pings sent
+            uint32_t failed; // Pings that did not come back unaltered
+            uint32_t bytes; // Payload bytes that came back unaltered
+            uint64_t duration; // Microseconds
+
+            inline uint32_t Throughput() const
+            {
+                return ((duration > 0) ? static_cast<uint32_t>((static_cast<uint64_t>(bytes) * Core::Time::MicroSecondsPerSecond) / duration) : 0);
+            }
+        };
+
+        // Durations in microseconds, bucket n counts the ones below 2^(n+1).
+        class Histogram {
+        public:
+            static constexpr uint8_t Buckets = 24;
+
+            Histogram()
+                : _count(0)
+                , _sum(0)
+                , _max(0)
+            {
+                ::memset(_buckets, 0, sizeof(_buckets));
+            }
+            Histogram(const Histogram&) = default;
+            Histogram& operator=(const Histogram&) = default;
+            ~Histogram() = default;
+
+        public:
+            void Add(const uint32_t duration)
+            {
+                uint8_t bucket(0);
+
+                while (((duration >> (bucket + 1)) != 0) && (bucket < (Buckets - 1))) {
+                    bucket++;
+                }
+
+                _buckets[bucket]++;
+                _count++;
+                _sum += duration;
+                _max = std::max(_max, duration);
+            }
+            inline uint32_t Count() const
+            {
+                return (_count);
+            }
+            inline uint32_t Average() const
+            {
+                return ((_count > 0) ? static_cast<uint32_t>(_sum / _count) : 0);
+            }
+            inline uint32_t Max() const
+            {
+                return (_max);
+            }
+            inline uint32_t Bucket(const uint8_t index) const
+            {
+                ASSERT(index < Buckets);
+                return (_buckets[index]);
+            }
+            // Upper bound of the bucket holding the given percentile.
+            uint32_t Percentile(const uint8_t percentile) const
+            {
+                const uint64_t target((static_cast<uint64_t>(_count) * percentile + 99) / 100);
+                uint64_t seen(0);
+                uint8_t bucket(0);
+
+                while ((bucket < (Buckets - 1)) && ((seen += _buckets[bucket]) < target)) {
+                    bucket++;
+                }
+
+                return ((_count > 0) ? std::min(_max, static_cast<uint32_t>((2UL << bucket) - 1)) : 0);
+            }
+
+        private:
+            uint32_t _count;
+            uint64_t _sum;
+            uint32_t _max;
+            uint32_t _buckets[Buckets];
+        };
+
+        // Latency of the exchanges per stage, only exchanges with a timing trailer count for
+        // the endpoint and device stages.
+        struct Breakdown {
+            Histogram queued;
+            Histogram line;
+            Histogram endpoint;
+            Histogram device;
+            Histogram total;
+
+            void Add(const Stages& stages)
+            {
+                queued.Add(stages.queued);
+                line.Add(stages.line);
+                total.Add(stages.total);
+
+                if (stages.timed == true) {
+                    endpoint.Add(stages.endpoint);
+                    device.Add(stages.device);
+                }
+            }
+        };
+
+        typedef std::map<SimpleSerial::Protocol::OperationType, Breakdown> OperationLatencies;
+        typedef std::map<SimpleSerial::Protocol::DeviceAddressType, Breakdown> DeviceLatencies;
+
+        // Bookkeeping of the unacknowledged key actions.
+        struct KeyCounters {
+            uint32_t sent; // Queued for the endpoint
+            uint32_t failed; // Reported back by a KEY_ERROR event
+            uint32_t dropped; // Rejected by the endpoint before it could be handled
         };
 
         SerialCommunicator()
             : _adminLock()
             , _channel(*this)
-            , _callback(nullptr)
+            , _notificationLock()
+            , _notifications()
+            , _callbackLock()
+            , _callbacks()
+            , _sequences()
+            , _running()
+            , _sequenceExpiry(0)
+            , _devices()
+            , _readers()
+            , _generation(0)
+            , _port()
+            , _device()
+            , _flowControl(Core::SerialPort::OFF)
+            , _framing(SimpleSerial::Protocol::FramingType::PREAMBLE)
+            , _checksum(SimpleSerial::Protocol::ChecksumType::CRC8)
+            , _timing(false)
+            , _retries(0)
+            , _endpoint()
+            , _baseBaudRate(0)
+            , _maxBaudRate(0)
+            , _failedBaudRates()
+            , _fallback(false)
+            , _active(false)
+            , _lost(false)
+            , _reopenDelay(0)
+            , _settings()
+            , _job(*this)
+            , _keysSent(0)
+            , _keysFailed(0)
+            , _keysDropped(0)
+            , _operationLatencies()
+            , _deviceLatencies()
+            , _estimates()
+            , _roundTrips()
+            , _roundTripIndex(0)
+            , _pings(0)
+            , _lostPings(0)
+            , _monitorInterval(0)
+            , _pingSize(0)
+            , _monitor(*this)
+            , _probe(_monitor)
+            , _notifier(*this)
+            , _notify(_notifier)
+            , _expiry(*this)
+            , _expire(_expiry)
+            , _tasks()
+            , _runner(*this)
+            , _run(_runner)
         {
         }
         SerialCommunicator(const SerialCommunicator&) = delete;
@@ -286,57 +728,269 @@ namespace Doofah {
 
         virtual ~SerialCommunicator() = default;
 
-        class EXTERNAL DeviceIterator : public Core::IteratorType<const std::list<SimpleSerial::Payload::Device>, const SimpleSerial::Payload::Device&, std::list<SimpleSerial::Payload::Device>::const_iterator> {
-        private:
-            using BaseClass = Core::IteratorType<const std::list<SimpleSerial::Payload::Device>, const SimpleSerial::Payload::Device&, std::list<SimpleSerial::Payload::Device>::const_iterator>;
-
+        // Walks the device entries in place, in the response frame received from the endpoint.
+        class EXTERNAL DeviceIterator {
         public:
+            typedef SimpleSerial::DataExchange<SerialLink>::Response Response;
+
             DeviceIterator()
-                : BaseClass()
-                , _container()
+                : _response()
+                , _index(~0)
             {
-                Container(_container);
             }
-            DeviceIterator(std::list<SimpleSerial::Payload::Device>&& rhs)
-                : BaseClass()
-                , _container(rhs)
+            DeviceIterator(const Response& response)
+                : _response(response)
+                , _index(~0)
             {
-                Container(_container);
             }
             DeviceIterator(const DeviceIterator& rhs)
-                : BaseClass()
-                , _container(rhs._container)
+                : _response(rhs._response)
+                , _index(rhs._index)
             {
-                Container(_container);
             }
             DeviceIterator(DeviceIterator&& rhs)
-                : BaseClass()
-                , _container(rhs._container)
+                : _response(std::move(rhs._response))
+                , _index(rhs._index)
+            {
+                rhs._index = ~0;
+            }
+            ~DeviceIterator() = default;
+
+            DeviceIterator& operator=(const DeviceIterator& rhs)
+            {
+                _response = rhs._response;
+                _index = rhs._index;
+
+                return (*this);
+            }
+            DeviceIterator& operator=(DeviceIterator&& rhs)
+            {
+                if (this != &rhs) {
+                    _response = std::move(rhs._response);
+                    _index = rhs._index;
+                    rhs._index = ~0;
+                }
+
+                return (*this);
+            }
+
+        public:
+            inline bool IsValid() const
+            {
+                return (_index < Count());
+            }
+            inline void Reset(const uint32_t position)
+            {
+                _index = (position == 0) ? ~0 : position - 1;
+            }
+            inline bool Next()
+            {
+                _index = (_index == static_cast<uint8_t>(~0)) ? 0 : ((_index < Count()) ? _index + 1 : _index);
+
+                return (IsValid());
+            }
+            inline uint32_t Count() const
             {
-                Container(_container);
+                return (_response.IsValid() == true) ? (_response->PayloadLength() / sizeof(SimpleSerial::Payload::Device)) : 0;
+            }
+            inline const SimpleSerial::Payload::Device& Current() const
+            {
+                ASSERT(IsValid() == true);
+
+                return (reinterpret_cast<const SimpleSerial::Payload::Device*>(_response->Payload())[_index]);
             }
-            ~DeviceIterator() override = default;
 
         private:
-            std::list<SimpleSerial::Payload::Device> _container;
+            Response _response;
+            uint8_t _index;
         };
 
         uint32_t Initialize(const std::string& config);
         void Deinitialize();
 
+        Capabilities Endpoint() const;
+
+        // The device table is read from the endpoint once and shared by all readers, until the
+        // endpoint restarts, a device is reset or set up, or it is invalidated.
         DeviceIterator Devices() const;
+        void Invalidate() const;
+
+        // A deadline, in milliseconds, replaces the timeout that follows from the measured round
+        // trips of the operation, zero keeps the measured one.
+        // Without acknowledge the call returns as soon as the key is queued, failures are
+        // reported through ICallback::KeyError.
+        uint32_t KeyEvent(const SimpleSerial::Protocol::DeviceAddressType address, const bool pressed, const uint16_t code, const bool acknowledge = true, const uint32_t deadline = 0) const;
+        KeyCounters Keys() const;
+        void Latencies(OperationLatencies& operations, DeviceLatencies& devices) const;
+
+        // Round trip of a PING with size bytes of payload, in microseconds.
+        uint32_t Ping(const uint8_t size, uint32_t& roundTrip) const;
+        LinkStatistics Link() const;
+        // Echoes length bytes with the window full of PINGs of the given size.
+        uint32_t LinkTest(const uint32_t length, const uint8_t size, LinkTestReport& report) const;
+        // Plays a capture back on a channel of its own, the link keeps running. The captured
+        // requests get the timeouts this link measured for them. The speed divides the original
+        // pace, zero plays as fast as possible.
+        uint32_t Replay(const string& fileName, const uint8_t speed, ReplayReport& report) const;
+        // The deadline covers all events together.
+        uint32_t KeyEvents(const std::vector<SimpleSerial::Payload::KeyBatchEvent>& events, std::vector<SimpleSerial::Protocol::ResultType>& results, const uint32_t deadline = 0) const;
+        // Blocks until the endpoint reports the end of the sequence, the deadline covers the
+        // steps as well.
+        uint32_t Sequence(const SimpleSerial::Protocol::DeviceAddressType address, const std::vector<SimpleSerial::Payload::SequenceStep>& steps, const uint32_t deadline = 0) const;
+
+        uint32_t Transfer(const SimpleSerial::Protocol::DeviceAddressType address, const uint32_t length, const uint8_t data[], TransferReport& report) const;
+        uint32_t Transfer(const SimpleSerial::Protocol::DeviceAddressType address, const string& fileName, TransferReport& report) const;
+
+        uint32_t Reset(const SimpleSerial::Protocol::DeviceAddressType address, const uint32_t deadline = 0) const;
+        uint32_t Setup(const SimpleSerial::Protocol::DeviceAddressType address, const string& config, const uint32_t deadline = 0) const;
+
+        // Completion based variants, these return as soon as the request is queued. The completion
+        // is called once, from the link's own thread, and must not block.
+        typedef std::function<void(const uint32_t result)> Completion;
+        typedef std::function<void(const uint32_t result, DeviceIterator& devices)> DevicesCompletion;
+        typedef std::function<void(const uint32_t result, const std::vector<SimpleSerial::Protocol::ResultType>& results)> KeysCompletion;
+
+        uint32_t KeyEvent(const SimpleSerial::Protocol::DeviceAddressType address, const bool pressed, const uint16_t code, Completion&& completion, const uint32_t deadline = 0) const;
+        uint32_t Reset(const SimpleSerial::Protocol::DeviceAddressType address, Completion&& completion, const uint32_t deadline = 0) const;
+        uint32_t Setup(const SimpleSerial::Protocol::DeviceAddressType address, const string& config, Completion&& completion, const uint32_t deadline = 0) const;
+        // The next frame of the batch is queued from the completion of the one before.
+        uint32_t KeyEvents(const std::vector<SimpleSerial::Payload::KeyBatchEvent>& events, KeysCompletion&& completion, const uint32_t deadline = 0) const;
+        // Completes once the endpoint reports the end of the sequence, or expires.
+        uint32_t Sequence(const SimpleSerial::Protocol::DeviceAddressType address, const std::vector<SimpleSerial::Payload::SequenceStep>& steps, Completion&& completion, const uint32_t deadline = 0) const;
+        // With the device table at hand the completion is called right away, from the calling
+        // thread. Readers that come in while the table is read share that one query.
+        uint32_t Devices(DevicesCompletion&& completion) const;
+
+        typedef std::function<void(const uint32_t result, const TransferReport& report)> TransferCompletion;
+        typedef std::function<void(const uint32_t result, const LinkTestReport& report)> LinkTestCompletion;
+        typedef std::function<void(const uint32_t result, const ReplayReport& report)> ReplayCompletion;
+
+        // Transfers, link tests and replays run on a job of the communicator, one after the other,
+        // the completion is called from that job once the run is over.
+        uint32_t Transfer(const SimpleSerial::Protocol::DeviceAddressType address, const string& fileName, TransferCompletion&& completion) const;
+        uint32_t LinkTest(const uint32_t length, const uint8_t size, LinkTestCompletion&& completion) const;
+        uint32_t Replay(const string& fileName, const uint8_t speed, ReplayCompletion&& completion) const;
+
+        // Callbacks are called from a worker, never from the thread that reads the link.
+        void Register(ICallback* callback);
+        void Unregister(ICallback* callback);
+
+    private:
+        // An unsolicited event of the endpoint, decoded where the frame came in.
+        struct Notification {
+            enum type : uint8_t {
+                STARTED,
+                BUTTON,
+                KEY_ERROR
+            };
+
+            Notification(const type kind)
+                : kind(kind)
+                , address(SimpleSerial::Protocol::InvalidAddress)
+                , code(0)
+                , pressed(false)
+                , result(SimpleSerial::Protocol::ResultType::OK)
+            {
+            }
+            Notification(const SimpleSerial::Protocol::DeviceAddressType address, const uint16_t code, const bool pressed, const SimpleSerial::Protocol::ResultType result)
+                : kind(KEY_ERROR)
+                , address(address)
+                , code(code)
+                , pressed(pressed)
+                , result(result)
+            {
+            }
 
-        uint32_t KeyEvent(const SimpleSerial::Protocol::DeviceAddressType address, const bool pressed, const uint16_t code) const;
+            type kind;
+            SimpleSerial::Protocol::DeviceAddressType address;
+            uint16_t code;
+            bool pressed;
+            SimpleSerial::Protocol::ResultType result;
+        };
 
-        uint32_t Reset(const SimpleSerial::Protocol::DeviceAddressType address) const;
-        uint32_t Setup(const SimpleSerial::Protocol::DeviceAddressType address, const string& config) const;
+        // A key batch on its way, frame by frame.
+        struct KeyBatch {
+            std::vector<SimpleSerial::Payload::KeyBatchEvent> events;
+            std::vector<SimpleSerial::Protocol::ResultType> results;
+            uint64_t end;
+            uint32_t deadline;
+            KeysCompletion completion;
+        };
 
-        void Callback(ICallback* callback);
+        class Expiry {
+        public:
+            Expiry() = delete;
+            Expiry(const Expiry&) = delete;
+            Expiry& operator=(const Expiry&) = delete;
+
+            Expiry(SerialCommunicator& parent)
+                : _parent(parent)
+            {
+            }
+            ~Expiry() = default;
+
+        public:
+            void Dispatch()
+            {
+                _parent.Expire();
+            }
+
+        private:
+            SerialCommunicator& _parent;
+        };
+
+        // Runs the queued bulk runs, see Schedule().
+        class Runner {
+        public:
+            Runner() = delete;
+            Runner(const Runner&) = delete;
+            Runner& operator=(const Runner&) = delete;
+
+            Runner(SerialCommunicator& parent)
+                : _parent(parent)
+            {
+            }
+            ~Runner() = default;
+
+        public:
+            void Dispatch()
+            {
+                _parent.Run();
+            }
+
+        private:
+            SerialCommunicator& _parent;
+        };
+
+        // A bulk run, called with abort set when the communicator goes down before it ran.
+        typedef std::function<void(const bool abort)> Task;
+
+        // Hands the queued notifications to the callbacks.
+        class Notifier {
+        public:
+            Notifier() = delete;
+            Notifier(const Notifier&) = delete;
+            Notifier& operator=(const Notifier&) = delete;
+
+            Notifier(SerialCommunicator& parent)
+                : _parent(parent)
+            {
+            }
+            ~Notifier() = default;
+
+        public:
+            void Dispatch()
+            {
+                _parent.Deliver();
+            }
 
-    private:
-        class Channel : public SimpleSerial::DataExchange<Core::SerialPort> {
         private:
-            typedef SimpleSerial::DataExchange<Core::SerialPort> BaseClass;
+            SerialCommunicator& _parent;
+        };
+
+        class Channel : public SimpleSerial::DataExchange<SerialLink> {
+        private:
+            typedef SimpleSerial::DataExchange<SerialLink> BaseClass;
 
         public:
             Channel() = delete;
@@ -356,6 +1010,22 @@ namespace Doofah {
             {
                 _parent.Received(message);
             }
+            virtual void Failed(const uint8_t failures) override
+            {
+                _parent.Failed(failures);
+            }
+            virtual void Expired(const SimpleSerial::Protocol::OperationType operation) override
+            {
+                _parent.Expired(operation);
+            }
+            virtual void Measured(const SimpleSerial::Protocol::OperationType operation, const SimpleSerial::Protocol::DeviceAddressType address, const Stages& stages) override
+            {
+                _parent.Measured(operation, address, stages);
+            }
+            virtual void StateChange() override
+            {
+                _parent.StateChange();
+            }
 
         private:
             SerialCommunicator& _parent;
@@ -364,12 +1034,197 @@ namespace Doofah {
     public:
         virtual void Received(const SimpleSerial::Protocol::Message& element);
 
+    private:
+        friend Core::ThreadPool::JobType<SerialCommunicator&>;
+
+        // Pings the endpoint every interval, to keep the link statistics up to date.
+        class Monitor {
+        public:
+            Monitor() = delete;
+            Monitor(const Monitor&) = delete;
+            Monitor& operator=(const Monitor&) = delete;
+
+            Monitor(SerialCommunicator& parent)
+                : _parent(parent)
+            {
+            }
+            ~Monitor() = default;
+
+        public:
+            void Dispatch()
+            {
+                _parent.Probe();
+            }
+
+        private:
+            SerialCommunicator& _parent;
+        };
+
+        // Smoothed round trip of an operation and its variation, the timeout follows from them
+        // like the retransmission timeout of TCP (RFC 6298). Round trips in microseconds.
+        class RoundTripEstimate {
+        public:
+            RoundTripEstimate()
+                : _smoothed(0)
+                , _variation(0)
+                , _samples(0)
+                , _backoff(0)
+            {
+            }
+            RoundTripEstimate(const RoundTripEstimate&) = default;
+            RoundTripEstimate& operator=(const RoundTripEstimate&) = default;
+            ~RoundTripEstimate() = default;
+
+        public:
+            void Add(const uint32_t roundTrip)
+            {
+                if (_samples == 0) {
+                    _smoothed = roundTrip;
+                    _variation = roundTrip / 2;
+                } else {
+                    const uint32_t error = (roundTrip > _smoothed) ? (roundTrip - _smoothed) : (_smoothed - roundTrip);
+
+                    _variation = ((3 * static_cast<uint64_t>(_variation)) + error) / 4;
+                    _smoothed = ((7 * static_cast<uint64_t>(_smoothed)) + roundTrip) / 8;
+                }
+
+                _samples++;
+                _backoff = 0;
+            }
+            // Doubles the timeout, until an answer comes in time again.
+            inline void Backoff()
+            {
+                if (_backoff < 6) {
+                    _backoff++;
+                }
+            }
+            inline bool IsValid() const
+            {
+                return (_samples > 0);
+            }
+            // In milliseconds, with at least a millisecond for the variation.
+            uint32_t Timeout() const
+            {
+                const uint64_t spread = 4 * static_cast<uint64_t>(_variation);
+                const uint64_t timeout = (_smoothed + ((spread > 1000) ? spread : 1000)) << _backoff;
+
+                return (static_cast<uint32_t>((timeout + 999) / 1000));
+            }
+
+        private:
+            uint32_t _smoothed;
+            uint32_t _variation;
+            uint32_t _samples;
+            uint8_t _backoff;
+        };
+
+        // Brings the link back to the configured framing and the fastest speed that works,
+        // after the endpoint restarted or the line turned bad, or reopens a lost port.
+        void Dispatch();
+        void StateChange();
+        void Lost();
+        void Reopen();
+        void Handshake();
+        void Restore();
+        bool Gone() const;
+        static string Stable(const string& port);
+        void Remember(const SimpleSerial::Protocol::DeviceAddressType address, const string& config) const;
+        void Publish(const Notification& notification);
+        void Deliver();
+        void Failed(const uint8_t failures);
+        void Measured(const SimpleSerial::Protocol::OperationType operation, const SimpleSerial::Protocol::DeviceAddressType address, const Stages& stages);
+        void Expired(const SimpleSerial::Protocol::OperationType operation);
+        // Time an exchange of the operation gets over all its attempts, in milliseconds. A non zero
+        // deadline wins.
+        uint32_t Timeout(const SimpleSerial::Protocol::OperationType operation, const uint32_t deadline = 0) const;
+        uint32_t Rounds(const SimpleSerial::Protocol::OperationType operation, const size_t count) const;
+
+        static uint32_t Outcome(const uint32_t result, const Channel::Response& response);
+        uint32_t Batch(const std::shared_ptr<KeyBatch>& batch) const;
+        void Batched(const std::shared_ptr<KeyBatch>& batch, const uint8_t count, const uint32_t result, const Channel::Response& response) const;
+        void Follow(const SimpleSerial::Protocol::SequenceType id, const uint64_t start, const uint64_t end, const Completion& completion) const;
+        void Expire();
+        void Abandon(const uint32_t reason);
+        void Refreshed(const uint32_t generation, const uint32_t result, const Channel::Response& response) const;
+        uint32_t Schedule(Task&& task) const;
+        void Run();
+        uint32_t Settings(const SimpleSerial::Protocol::DeviceAddressType address, const string& config, std::unique_ptr<Message>& request) const;
+
+        uint32_t Hello();
+        uint32_t Framing(const SimpleSerial::Protocol::FramingType framing);
+        uint32_t Checksum(const SimpleSerial::Protocol::ChecksumType checksum);
+        uint32_t Baudrate(const uint32_t rate);
+        void Upgrade();
+        void Fallback();
+        void Probe();
+
+    public:
+
         typedef std::map<string, SimpleSerial::Protocol::DeviceAddressType> DeviceMap;
 
     private:
         mutable Core::CriticalSection _adminLock;
         mutable Channel _channel;
-        ICallback* _callback;
+        // Notifications on their way to the callbacks. Bounded, so a stalled callback costs
+        // notifications and never the link.
+        Core::CriticalSection _notificationLock;
+        std::list<Notification> _notifications;
+        // Held while the callbacks are called, so none is called anymore once Unregister() returns.
+        Core::CriticalSection _callbackLock;
+        std::list<ICallback*> _callbacks;
+        // Completed sequences with the time the completion EVENT arrived.
+        mutable std::map<SimpleSerial::Protocol::SequenceType, std::pair<SimpleSerial::Protocol::ResultType, uint64_t>> _sequences;
+        // Sequences the endpoint runs, with the time they expire, and the earliest of those.
+        mutable std::map<SimpleSerial::Protocol::SequenceType, std::pair<uint64_t, Completion>> _running;
+        mutable uint64_t _sequenceExpiry;
+        // Response to the last STATE query, the readers waiting for the one in flight and the
+        // number of invalidations, so a table that went stale while it was read is not kept.
+        mutable Channel::Response _devices;
+        mutable std::list<DevicesCompletion> _readers;
+        mutable uint32_t _generation;
+        // The port by its stable name if it has one, and the tty that name led to when opened.
+        string _port;
+        string _device;
+        Core::SerialPort::FlowControl _flowControl;
+        SimpleSerial::Protocol::FramingType _framing;
+        SimpleSerial::Protocol::ChecksumType _checksum;
+        bool _timing;
+        uint8_t _retries;
+        Capabilities _endpoint;
+        uint32_t _baseBaudRate;
+        uint32_t _maxBaudRate;
+        // Speeds that turned out too fast for this line, never tried again.
+        std::vector<uint32_t> _failedBaudRates;
+        std::atomic<bool> _fallback;
+        std::atomic<bool> _active;
+        std::atomic<bool> _lost;
+        uint32_t _reopenDelay;
+        // Settings the devices got through Setup(), given again after a reopen.
+        mutable std::map<SimpleSerial::Protocol::DeviceAddressType, string> _settings;
+        Core::WorkerPool::JobType<SerialCommunicator&> _job;
+        mutable std::atomic<uint32_t> _keysSent;
+        std::atomic<uint32_t> _keysFailed;
+        std::atomic<uint32_t> _keysDropped;
+        OperationLatencies _operationLatencies;
+        DeviceLatencies _deviceLatencies;
+        std::map<SimpleSerial::Protocol::OperationType, RoundTripEstimate> _estimates;
+        // Ring of the round trips of the recent pings.
+        mutable uint32_t _roundTrips[64];
+        mutable uint8_t _roundTripIndex;
+        mutable uint32_t _pings;
+        mutable uint32_t _lostPings;
+        std::atomic<uint16_t> _monitorInterval;
+        uint8_t _pingSize;
+        Monitor _monitor;
+        Core::WorkerPool::JobType<Monitor&> _probe;
+        Notifier _notifier;
+        Core::WorkerPool::JobType<Notifier&> _notify;
+        Expiry _expiry;
+        mutable Core::WorkerPool::JobType<Expiry&> _expire;
+        // Bulk runs waiting for the one in progress.
+        mutable std::list<Task> _tasks;
+        Runner _runner;
+        mutable Core::WorkerPool::JobType<Runner&> _run;
     }; // class SerialCommunicator
 } // namespace plugin
 } // namespace Thunder
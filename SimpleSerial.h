@@ -23,6 +23,10 @@
 #include <cstring>
 #include <stdint.h>
 
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
 #ifndef ASSERT
 #define ASSERT(x)
 #endif
@@ -38,6 +42,8 @@ namespace SimpleSerial {
         // Response from target
         // | OperationType | SequenceType | ResultType        | LengthType | DataType   | CRC8   |
         //
+        // After a CHECKSUM request for it, frames carry a 4 byte CRC32C instead of the CRC8.
+        //
         // Request from Host
         // |0x01|0x00|0x12|0x00|CRC8|
         // Response from target
@@ -55,6 +61,17 @@ namespace SimpleSerial {
             KEY, // Do a key action press/release + keycode
             SETTINGS, // Send/Retrieve (VID/PID/NAME)
             STATE, // Get the state of all devices
+            KEY_BATCH, // Do a series of key actions, each on its own device address
+            SEQUENCE, // Run a timed script of key actions, completion is reported by an EVENT
+            TRANSFER_BEGIN, // Start or resume a bulk transfer, responds with the offset to continue from
+            TRANSFER_CHUNK, // Data at an offset of the bulk transfer, responds with the next expected offset
+            TRANSFER_COMMIT, // Verify and store the complete bulk transfer
+            FRAMING, // Switch the framing on the wire, answered in the old framing, followed frames use the new one
+            HELLO, // Get the capabilities of the endpoint
+            BAUDRATE, // Switch the link speed, answered at the old speed, followed frames use the new one
+            KEY_NOACK, // Do a key action without an answer, only a failure is reported by an EVENT
+            PING, // Echo the payload, without touching any peripheral
+            CHECKSUM, // Switch the frame checksum, answered under the old one, followed frames use the new one
             EVENT = 0x80 //
         };
 
@@ -65,9 +82,43 @@ namespace SimpleSerial {
         typedef uint8_t CRC8Type;
 
         constexpr uint8_t Preamble = 0xAA; // weird hook in ascii-2
+        constexpr uint8_t Delimiter = 0x00; // opens a COBS encoded frame, never part of one
+
+        enum class FramingType : uint8_t {
+            PREAMBLE = 0x00, // |Preamble|frame|, what every endpoint starts with
+            COBS = 0x01 // |Delimiter|COBS(frame)|, resynchronises on every delimiter
+        };
+
+        enum class ChecksumType : uint8_t {
+            CRC8 = 0x00, // What every endpoint starts with
+            CRC32C = 0x01 // Stronger on large frames, at three more bytes a frame
+        };
 
         constexpr uint8_t InvalidAddress = DeviceAddressType(~0);
 
+        // Raised on every change a peer needs to know about, reported in a HELLO.
+        //  1: HELLO, FRAMING and BAUDRATE
+        //  2: Timing trailer on requests with the TimingFlag
+        //  3: Answers to retransmissions with the RetransmitFlag come from a cache
+        //  4: CHECKSUM, the supported checksums follow the baud rates in a HELLO
+        constexpr uint8_t Version = 4;
+
+        // Set on the operation of a request to get a Payload::Timing appended to the payload of
+        // its response. The response only carries the flag when it carries the trailer.
+        constexpr uint8_t TimingFlag = 0x40;
+        constexpr uint8_t TimingVersion = 2;
+
+        // Set on the operation of a request that went out before under the same sequence. When
+        // the endpoint handled the first one already, it answers with the answer it gave then.
+        constexpr uint8_t RetransmitFlag = 0x20;
+        constexpr uint8_t RetransmitVersion = 3;
+
+        constexpr uint8_t ChecksumVersion = 4;
+
+        // At a raised baud rate, an endpoint that receives bytes but no valid frame for this
+        // many milliseconds goes back to the baud rate it was built with.
+        constexpr uint16_t BaudrateConfirmTime = 1000;
+
         enum class ResultType : uint8_t {
             OK = 0x00,
             NOT_CONNECTED,
@@ -80,94 +131,283 @@ namespace SimpleSerial {
         };
 
         constexpr uint8_t MaxDataSize = 0xFF;
-        constexpr uint8_t MaxPayloadSize = MaxDataSize - (sizeof(SequenceType) + sizeof(OperationType) + sizeof(DeviceAddressType) + sizeof(LengthType) + sizeof(CRC8Type));
         constexpr uint8_t HeaderSize = sizeof(OperationType) + sizeof(SequenceType) + sizeof(DeviceAddressType) + sizeof(LengthType);
+        // Room for the largest supported checksum, so payload limits hold under either one.
+        constexpr uint8_t MaxChecksumSize = sizeof(uint32_t);
+        constexpr uint8_t MaxPayloadSize = MaxDataSize - (HeaderSize + MaxChecksumSize);
+
+        namespace Checksum {
+            // Compile time generated lookup tables, C++11 constexpr has no loops so
+            // every entry is folded by recursion over the bits.
+            template <uint16_t... INDEX>
+            struct Indices {
+            };
+            template <uint16_t N, uint16_t... INDEX>
+            struct MakeIndices : MakeIndices<N - 1, N - 1, INDEX...> {
+            };
+            template <uint16_t... INDEX>
+            struct MakeIndices<0, INDEX...> {
+                typedef Indices<INDEX...> Type;
+            };
+
+            constexpr uint8_t NormalEntry8(const uint8_t polynomial, const uint8_t crc, const uint8_t bits)
+            {
+                return (bits == 0) ? crc : NormalEntry8(polynomial, static_cast<uint8_t>(((crc & 0x80) != 0) ? ((crc << 1) ^ polynomial) : (crc << 1)), bits - 1);
+            }
+            constexpr uint32_t ReflectedEntry32(const uint32_t polynomial, const uint32_t crc, const uint8_t bits)
+            {
+                return (bits == 0) ? crc : ReflectedEntry32(polynomial, ((crc & 1) != 0) ? ((crc >> 1) ^ polynomial) : (crc >> 1), bits - 1);
+            }
+
+            template <uint8_t POLYNOMIAL, typename INDICES>
+            struct Table8;
+            template <uint8_t POLYNOMIAL, uint16_t... INDEX>
+            struct Table8<POLYNOMIAL, Indices<INDEX...>> {
+                static constexpr uint8_t Entries[256] = { NormalEntry8(POLYNOMIAL, static_cast<uint8_t>(INDEX), 8)... };
+            };
+            template <uint8_t POLYNOMIAL, uint16_t... INDEX>
+            constexpr uint8_t Table8<POLYNOMIAL, Indices<INDEX...>>::Entries[256];
+
+            template <uint32_t POLYNOMIAL, typename INDICES>
+            struct Table32;
+            template <uint32_t POLYNOMIAL, uint16_t... INDEX>
+            struct Table32<POLYNOMIAL, Indices<INDEX...>> {
+                static constexpr uint32_t Entries[256] = { ReflectedEntry32(POLYNOMIAL, INDEX, 8)... };
+            };
+            template <uint32_t POLYNOMIAL, uint16_t... INDEX>
+            constexpr uint32_t Table32<POLYNOMIAL, Indices<INDEX...>>::Entries[256];
+
+            // CRC-8 (polynomial 0x31, initial 0xFF), the frame checksum of the protocol.
+            struct CRC8 {
+                typedef uint8_t Type;
+
+                static Type Calculate(const uint8_t length, const uint8_t data[])
+                {
+                    typedef Table8<0x31, MakeIndices<256>::Type> Lookup;
+
+                    uint8_t crc(~0);
+
+                    for (uint8_t i = 0; i < length; i++) {
+                        crc = Lookup::Entries[crc ^ data[i]];
+                    }
+
+                    return crc;
+                }
+            };
+
+            // CRC-32C (Castagnoli), for links that want a stronger check on large frames.
+            // Uses the SSE4.2 or ARMv8 CRC instructions when the host has them.
+            struct CRC32C {
+                typedef uint32_t Type;
+
+                static Type Calculate(const uint8_t length, const uint8_t data[])
+                {
+#if defined(__x86_64__) && defined(__GNUC__)
+                    static const bool accelerated = __builtin_cpu_supports("sse4.2");
+                    return ((accelerated == true) ? Hardware(length, data) : Software(length, data));
+#elif defined(__ARM_FEATURE_CRC32)
+                    return (Hardware(length, data));
+#else
+                    return (Software(length, data));
+#endif
+                }
+
+            private:
+                static Type Software(const uint8_t length, const uint8_t data[])
+                {
+                    typedef Table32<0x82F63B78, MakeIndices<256>::Type> Lookup;
+
+                    uint32_t crc(~0);
+
+                    for (uint8_t i = 0; i < length; i++) {
+                        crc = (crc >> 8) ^ Lookup::Entries[(crc ^ data[i]) & 0xFF];
+                    }
+
+                    return ~crc;
+                }
+#if defined(__x86_64__) && defined(__GNUC__)
+                __attribute__((target("sse4.2"))) static Type Hardware(const uint8_t length, const uint8_t data[])
+                {
+                    uint64_t crc(0xFFFFFFFF);
+                    uint8_t i(0);
+
+                    for (; (i + sizeof(uint64_t)) <= length; i += sizeof(uint64_t)) {
+                        uint64_t word;
+                        memcpy(&word, &data[i], sizeof(word));
+                        crc = __builtin_ia32_crc32di(crc, word);
+                    }
+                    for (; i < length; i++) {
+                        crc = __builtin_ia32_crc32qi(static_cast<uint32_t>(crc), data[i]);
+                    }
+
+                    return ~static_cast<uint32_t>(crc);
+                }
+#elif defined(__ARM_FEATURE_CRC32)
+                static Type Hardware(const uint8_t length, const uint8_t data[])
+                {
+                    uint32_t crc(~0);
+                    uint8_t i(0);
+
+                    for (; (i + sizeof(uint64_t)) <= length; i += sizeof(uint64_t)) {
+                        uint64_t word;
+                        memcpy(&word, &data[i], sizeof(word));
+                        crc = __crc32cd(crc, word);
+                    }
+                    for (; i < length; i++) {
+                        crc = __crc32cb(crc, data[i]);
+                    }
+
+                    return ~crc;
+                }
+#endif
+            };
+
+            inline uint8_t Size(const ChecksumType type)
+            {
+                return ((type == ChecksumType::CRC32C) ? sizeof(CRC32C::Type) : sizeof(CRC8::Type));
+            }
+            inline uint32_t Calculate(const ChecksumType type, const uint8_t length, const uint8_t data[])
+            {
+                return ((type == ChecksumType::CRC32C) ? CRC32C::Calculate(length, data) : CRC8::Calculate(length, data));
+            }
+        } // namespace Checksum
 
         static uint8_t CRC8(const uint8_t length, const uint8_t data[])
         {
-            uint8_t crc(~0);
+            return (Checksum::CRC8::Calculate(length, data));
+        }
 
-            uint8_t i, j;
+        // Checksum over a bulk transfer (reflected 0xEDB88320), seed with 0 and
+        // feed the result back in for every next part.
+        static uint32_t CRC32(const uint32_t seed, const uint32_t length, const uint8_t data[])
+        {
+            typedef Checksum::Table32<0xEDB88320, Checksum::MakeIndices<256>::Type> Lookup;
 
-            for (i = 0; i < length; i++) {
-                crc ^= data[i];
-                for (j = 0; j < 8; j++) {
-                    if ((crc & 0x80) != 0)
-                        crc = static_cast<uint8_t>(((crc << 1) ^ 0x31));
-                    else
-                        crc <<= 1;
-                }
+            uint32_t crc(~seed);
+
+            for (uint32_t i = 0; i < length; i++) {
+                crc = (crc >> 8) ^ Lookup::Entries[(crc ^ data[i]) & 0xFF];
             }
 
-            return crc;
+            return ~crc;
         }
 
+        // Consistent Overhead Byte Stuffing, removes all Delimiter bytes from a frame
+        // so a receiver can always find the start of the next frame.
+        struct COBS {
+            static constexpr uint16_t MaxEncodedSize = MaxDataSize + (MaxDataSize / 254) + 2;
+
+            // Encodes the Delimiter followed by the frame, returns the encoded size.
+            static uint16_t Encode(const uint8_t length, const uint8_t data[], uint8_t output[])
+            {
+                uint16_t code(1);
+                uint16_t offset(2);
+
+                output[0] = Delimiter;
+                output[code] = 1;
+
+                for (uint8_t i = 0; i < length; i++) {
+                    if (data[i] == Delimiter) {
+                        code = offset++;
+                        output[code] = 1;
+                    } else {
+                        output[offset++] = data[i];
+
+                        if (++output[code] == 0xFF) {
+                            code = offset++;
+                            output[code] = 1;
+                        }
+                    }
+                }
+
+                return (offset);
+            }
+        };
+
         struct Message {
             uint8_t _buffer[MaxDataSize];
             uint8_t _size;
-            mutable uint8_t _offset;
+            mutable uint16_t _offset;
             mutable bool _preamble;
+            uint8_t _code;
+            uint8_t _block;
+            ChecksumType _checksum;
+
+            Message()
+                : _size(0)
+                , _offset(0)
+                , _preamble(false)
+                , _code(0)
+                , _block(0)
+                , _checksum(ChecksumType::CRC8)
+            {
+            }
 
             Message& operator=(const Message& message)
             {
-                Clear();
-
                 memcpy(_buffer, message.Data(), message.Size());
                 _size = message.Size();
                 _offset = 0;
                 _preamble = false;
+                _code = 0;
+                _block = 0;
+                _checksum = message.Checksum();
 
                 return *this;
             }
 
+            // Only the header is reset, the payload is always written before it is valid.
+            // The checksum is a property of the link, it stays.
             void Clear()
             {
-                std::memset(_buffer, 0, sizeof(_buffer));
+                std::memset(_buffer, 0, HeaderSize);
                 _size = 0;
                 _offset = 0;
                 _preamble = false;
+                _code = 0;
+                _block = 0;
             }
 
-            uint16_t Deserialize(const uint16_t length, const uint8_t data[])
+            // Consumes bytes until the frame is complete, returns the number of bytes used.
+            uint16_t Deserialize(const uint16_t length, const uint8_t data[], const FramingType framing = FramingType::PREAMBLE)
             {
-                uint16_t result(0);
-                uint8_t offset(0);
-
-                // Flush all data untill we find the preamble. 
-                while ((_preamble == false) && (offset < length)) {
-                    _preamble = (data[offset++] == Preamble);
+                if (framing == FramingType::COBS) {
+                    return (Decode(length, data));
                 }
 
-                // recover from a incomplete message in the buffer 
-                if (((length - offset) > 0) && (data[offset] == Preamble)) {
-                    _size = 0;
-                    _offset = 0;
-                    _preamble = true;
-                }
+                uint16_t offset(0);
 
-                if ((length - offset) > 0) {
-                    if (_size < HeaderSize) {
-                        result = std::min(uint16_t(length - offset), uint16_t(HeaderSize - _size));
+                if (_preamble == false) {
+                    // Skip the noise in front of the frame in one go.
+                    const uint8_t* start = static_cast<const uint8_t*>(std::memchr(data, Preamble, length));
 
-                        std::memcpy(&_buffer[_size], &data[offset], result);
+                    offset = (start != nullptr) ? static_cast<uint16_t>(start - data) + 1 : length;
+                    _preamble = (start != nullptr);
+                    _size = 0;
+                }
 
-                        _size += result;
-                    }
+                while ((_preamble == true) && (offset < length) && (IsComplete() == false)) {
+                    const uint16_t expected = (_size < HeaderSize) ? HeaderSize : (HeaderSize + PayloadLength() + ChecksumSize());
+                    const uint16_t copyLength = std::min(uint16_t(length - offset), uint16_t(expected - _size));
 
-                    if ((_size >= HeaderSize) && (result < length)) {
-                        uint8_t copyLength = std::min(uint8_t(length - result - offset), uint8_t((HeaderSize + PayloadLength() + sizeof(CRC8Type)) - _size));
+                    std::memcpy(&_buffer[_size], &data[offset], copyLength);
 
-                        std::memcpy(&_buffer[_size], &(data[offset + result]), copyLength);
+                    _size += copyLength;
+                    offset += copyLength;
 
-                        _size += copyLength;
-                        result += copyLength;
+                    if ((_size == HeaderSize) && ((HeaderSize + PayloadLength() + ChecksumSize()) > sizeof(_buffer))) {
+                        Resynchronize();
                     }
                 }
 
-                return result + offset;
+                return offset;
             }
-            uint16_t Serialize(uint16_t length, uint8_t data[]) const
+            uint16_t Serialize(uint16_t length, uint8_t data[], const FramingType framing = FramingType::PREAMBLE) const
             {
+                if (framing == FramingType::COBS) {
+                    return (Encode(length, data));
+                }
+
                 uint16_t copyLength(0);
                 uint8_t offset(0);
 
@@ -193,11 +433,31 @@ namespace SimpleSerial {
 
             bool IsComplete() const
             {
-                return ((_size > HeaderSize) && (_size >= (HeaderSize + PayloadLength() + sizeof(CRC8Type))));
+                return ((_size > HeaderSize) && (_size >= (HeaderSize + PayloadLength() + ChecksumSize())));
             }
             bool IsValid() const
             {
-                return (IsComplete() && CRC8((HeaderSize + PayloadLength()), _buffer) == _buffer[(HeaderSize + PayloadLength())]);
+                uint32_t crc(0);
+
+                if (IsComplete() == true) {
+                    if (_checksum == ChecksumType::CRC32C) {
+                        memcpy(&crc, &_buffer[HeaderSize + PayloadLength()], sizeof(crc));
+                    } else {
+                        crc = _buffer[HeaderSize + PayloadLength()];
+                    }
+                }
+
+                return (IsComplete() && (Checksum::Calculate(_checksum, (HeaderSize + PayloadLength()), _buffer) == crc));
+            }
+
+            inline ChecksumType Checksum() const
+            {
+                return _checksum;
+            }
+            // Only for a message that is not on its way, the frame is sized by it.
+            inline void Checksum(const ChecksumType checksum)
+            {
+                _checksum = checksum;
             }
 
             inline uint8_t Size() const
@@ -226,14 +486,40 @@ namespace SimpleSerial {
             inline OperationType Operation() const
             {
                 ASSERT(_size >= 1);
-                return static_cast<OperationType>(_buffer[0]);
+                return static_cast<OperationType>(_buffer[0] & ~(TimingFlag | RetransmitFlag));
             }
             inline void Operation(const OperationType operation)
             {
                 if (_size < 1) {
                     _size = 1;
                 }
-                _buffer[0] = static_cast<uint8_t>(operation);
+                _buffer[0] = static_cast<uint8_t>(operation) | (_buffer[0] & (TimingFlag | RetransmitFlag));
+            }
+
+            inline bool IsTimed() const
+            {
+                ASSERT(_size >= 1);
+                return ((_buffer[0] & TimingFlag) != 0);
+            }
+            inline void Timed(const bool timed)
+            {
+                if (_size < 1) {
+                    _size = 1;
+                }
+                _buffer[0] = (timed == true) ? (_buffer[0] | TimingFlag) : (_buffer[0] & ~TimingFlag);
+            }
+
+            inline bool IsRetransmit() const
+            {
+                ASSERT(_size >= 1);
+                return ((_buffer[0] & RetransmitFlag) != 0);
+            }
+            inline void Retransmit(const bool retransmit)
+            {
+                if (_size < 1) {
+                    _size = 1;
+                }
+                _buffer[0] = (retransmit == true) ? (_buffer[0] | RetransmitFlag) : (_buffer[0] & ~RetransmitFlag);
             }
 
             inline LengthType PayloadLength() const
@@ -271,6 +557,23 @@ namespace SimpleSerial {
                 return result;
             }
 
+            // Appends to the payload, returns the number of bytes appended.
+            inline uint8_t Extend(const uint8_t length, const uint8_t data[])
+            {
+                uint8_t result(0);
+
+                if ((length > 0) && ((PayloadLength() + length) <= MaxPayloadSize)) {
+                    memcpy(&_buffer[HeaderSize + PayloadLength()], data, length);
+
+                    _buffer[3] = static_cast<uint8_t>(PayloadLength() + length);
+                    _size = HeaderSize + PayloadLength();
+
+                    result = length;
+                }
+
+                return result;
+            }
+
             inline ResultType Result() const
             {
                 ASSERT(_size >= 3);
@@ -297,14 +600,20 @@ namespace SimpleSerial {
                 _buffer[1] = static_cast<uint8_t>(sequence);
             }
 
-            inline uint8_t Finalize()
+            inline uint32_t Finalize()
             {
-                CRC8Type crc(0);
+                uint32_t crc(0);
 
                 if ((_size >= HeaderSize) && (_size >= (HeaderSize + PayloadLength()))) {
-                    crc = CRC8((HeaderSize + PayloadLength()), _buffer);
-                    _buffer[HeaderSize + PayloadLength()] = crc;
-                    _size = HeaderSize + PayloadLength() + sizeof(CRC8Type);
+                    crc = Checksum::Calculate(_checksum, (HeaderSize + PayloadLength()), _buffer);
+
+                    if (_checksum == ChecksumType::CRC32C) {
+                        memcpy(&_buffer[HeaderSize + PayloadLength()], &crc, sizeof(crc));
+                    } else {
+                        _buffer[HeaderSize + PayloadLength()] = static_cast<uint8_t>(crc);
+                    }
+
+                    _size = HeaderSize + PayloadLength() + ChecksumSize();
                 }
 
                 // Ready to be send...
@@ -313,7 +622,150 @@ namespace SimpleSerial {
 
                 return crc;
             }
+
+            // A completed frame that fails its checksum but holds another preamble was most
+            // likely started by a data byte. Copies the bytes from that preamble on, to be parsed again.
+            uint8_t Unwind(uint8_t data[]) const
+            {
+                uint8_t result(0);
+                const uint8_t* start = static_cast<const uint8_t*>(std::memchr(_buffer, Preamble, _size));
+
+                if ((start != nullptr) && (IsValid() == false)) {
+                    result = static_cast<uint8_t>(_size - (start - _buffer));
+
+                    std::memcpy(data, start, result);
+                }
+
+                return (result);
+            }
+
+        private:
+            inline size_t ChecksumSize() const
+            {
+                return (Checksum::Size(_checksum));
+            }
+            uint16_t Encode(const uint16_t length, uint8_t data[]) const
+            {
+                uint8_t encoded[COBS::MaxEncodedSize];
+                const uint16_t size = COBS::Encode(_size, _buffer, encoded);
+                uint16_t copyLength(0);
+
+                ASSERT(IsComplete() == true);
+
+                if (_offset < size) {
+                    copyLength = std::min(length, uint16_t(size - _offset));
+
+                    std::memcpy(data, &encoded[_offset], copyLength);
+                    _offset += copyLength;
+                }
+
+                return (copyLength);
+            }
+            uint16_t Decode(const uint16_t length, const uint8_t data[])
+            {
+                uint16_t offset(0);
+
+                while ((offset < length) && (IsComplete() == false)) {
+                    if (_preamble == false) {
+                        // Skip whatever is on the line up to the start of the next frame.
+                        const uint8_t* start = static_cast<const uint8_t*>(std::memchr(&data[offset], Delimiter, length - offset));
+
+                        offset = (start != nullptr) ? static_cast<uint16_t>(start - data) + 1 : length;
+                        _preamble = (start != nullptr);
+                        _size = 0;
+                        _code = 0;
+                        _block = 0;
+                    } else {
+                        const uint8_t byte = data[offset++];
+
+                        if (byte == Delimiter) {
+                            // The frame we were in was cut short by line noise, this is the start of the next one.
+                            _size = 0;
+                            _code = 0;
+                            _block = 0;
+                        } else if (_block == 0) {
+                            // A new block, all but the longest blocks stand for a zero at their end.
+                            if ((_code != 0) && (_code != 0xFF)) {
+                                Append(0);
+                            }
+                            _code = byte;
+                            _block = byte - 1;
+                        } else {
+                            Append(byte);
+                            _block--;
+                        }
+                    }
+                }
+
+                return (offset);
+            }
+            void Append(const uint8_t byte)
+            {
+                ASSERT(_size < sizeof(_buffer));
+
+                _buffer[_size++] = byte;
+
+                if ((_size == HeaderSize) && ((HeaderSize + PayloadLength() + ChecksumSize()) > sizeof(_buffer))) {
+                    // Not a frame we can hold, wait for the next delimiter.
+                    _preamble = false;
+                }
+            }
+
+            // The header can not be the start of a frame, so the preamble was a data byte.
+            // Restart at the next preamble in what was already received, if any.
+            void Resynchronize()
+            {
+                const uint8_t* start = static_cast<const uint8_t*>(std::memchr(_buffer, Preamble, _size));
+
+                if (start != nullptr) {
+                    const uint8_t skip = static_cast<uint8_t>(start - _buffer) + 1;
+
+                    std::memmove(_buffer, &_buffer[skip], _size - skip);
+                    _size -= skip;
+                } else {
+                    _size = 0;
+                    _preamble = false;
+                }
+            }
         };
+
+        // Operations the other side never answers.
+        inline bool IsUnacknowledged(const OperationType operation)
+        {
+            return ((operation == OperationType::EVENT) || (operation == OperationType::KEY_NOACK));
+        }
+
+        // Cuts all frames out of a received span of bytes. Every complete frame is handed to
+        // the action, which may swap the frame for a fresh one before the next frame starts.
+        // A frame that failed its checksum is handed over as well, before the frame it may
+        // have hidden behind a data byte is parsed again.
+        // FRAME is anything that dereferences to a message: a pointer or a proxy.
+        template <typename FRAME, typename ACTION>
+        uint32_t Parse(FRAME& frame, const uint32_t length, const uint8_t data[], ACTION&& action, const FramingType framing = FramingType::PREAMBLE)
+        {
+            uint32_t offset(0);
+
+            while (offset < length) {
+                offset += frame->Deserialize(static_cast<uint16_t>(std::min(length - offset, static_cast<uint32_t>(~uint16_t(0)))), &data[offset], framing);
+
+                if (frame->IsComplete() == true) {
+                    uint8_t backlog[MaxDataSize];
+                    // A COBS frame can not be started by a data byte, there is nothing to unwind.
+                    const uint8_t replay = (framing == FramingType::PREAMBLE) ? frame->Unwind(backlog) : 0;
+
+                    // Reported either way, a frame that fails its checksum is still a sign of a bad line.
+                    action(frame);
+
+                    frame->Clear();
+
+                    if (replay > 0) {
+                        Parse(frame, replay, backlog, action, framing);
+                    }
+                }
+            }
+
+            return (offset);
+        }
     } // namespace Protocol
 
     namespace Payload {
@@ -322,6 +774,25 @@ namespace SimpleSerial {
             PRESSED = 0x01
         };
 
+        enum class PeripheralState : uint8_t {
+            UNINITIALIZED = 0x01,
+            AVAILABLE = 0x02,
+            OCCUPIED = 0x03
+        };
+
+        enum class SequenceAction : uint8_t {
+            RELEASE = 0x00,
+            PRESS = 0x01,
+            DELAY = 0x02
+        };
+
+        // Carried as first payload byte of an EVENT frame, an empty payload is a STARTED event.
+        enum class EventType : uint8_t {
+            STARTED = 0x00,
+            BUTTON = 0x01,
+            SEQUENCE_COMPLETED = 0x02, // Sequence id and result of the SEQUENCE request in the header
+            KEY_ERROR = 0x03 // Sequence id and result of the failed KEY_NOACK in the header, followed by a KeyError
+        };
 
         enum class Peripheral : uint8_t {
             ROOT = 0x00,
@@ -335,6 +806,75 @@ namespace SimpleSerial {
             uint16_t code;
         } KeyEvent;
 
+        // KEY_BATCH request payload entry, the response payload carries one
+        // Protocol::ResultType per entry in the same order.
+        typedef struct KeyBatchEvent {
+            Protocol::DeviceAddressType address;
+            KeyEvent event;
+        } KeyBatchEvent;
+
+        // SEQUENCE request payload entry, value is the key code for a PRESS or
+        // RELEASE and the duration in microseconds for a DELAY.
+        typedef struct SequenceStep {
+            SequenceAction action;
+            uint32_t value;
+        } SequenceStep;
+
+        typedef struct TransferBegin {
+            uint32_t size;
+            uint32_t crc; // CRC32 of the complete blob
+        } TransferBegin;
+
+        // Followed by the chunk data up to the end of the payload.
+        typedef struct TransferChunk {
+            uint32_t offset;
+        } TransferChunk;
+
+        // Response payload of all TRANSFER operations.
+        typedef struct TransferState {
+            uint32_t offset; // Next offset the endpoint expects
+        } TransferState;
+
+        typedef struct Framing {
+            Protocol::FramingType type;
+        } Framing;
+
+        typedef struct Checksum {
+            Protocol::ChecksumType type;
+        } Checksum;
+
+        typedef struct Event {
+            EventType type;
+        } Event;
+
+        // Follows the Event of a KEY_ERROR, the key action that failed.
+        typedef struct KeyError {
+            Protocol::DeviceAddressType address;
+            KeyEvent event;
+        } KeyError;
+
+        // Response payload of HELLO, followed by the supported baud rates as uint32_t's. From
+        // Protocol::ChecksumVersion on, those are followed by a uint8_t with bit n set when
+        // Protocol::ChecksumType n is supported.
+        typedef struct Hello {
+            uint8_t version; // Protocol::Version of the endpoint
+            uint8_t payload; // Largest payload the endpoint accepts
+            uint32_t operations; // Bit n is set when OperationType n is supported
+            char build[24]; // Firmware build, only terminated when shorter
+            uint8_t baudrates; // Number of baud rates that follow
+        } Hello;
+
+        typedef struct Baudrate {
+            uint32_t rate;
+        } Baudrate;
+
+        // Trailer of a response to a request with the Protocol::TimingFlag, micros() of the endpoint.
+        typedef struct Timing {
+            uint32_t received; // The request frame was complete
+            uint32_t dispatched; // The request was handed to the device
+            uint32_t submitted; // The device returned, the HID report or IR signal is out
+        } Timing;
+
         typedef struct BLESettings {
             uint16_t vid;
             uint16_t pid;
@@ -384,6 +924,7 @@ namespace SimpleSerial {
 
         typedef struct Device {
             Protocol::DeviceAddressType address;
+            PeripheralState state;
             Peripheral peripheral;
         } Device;
 
@@ -392,6 +933,10 @@ namespace SimpleSerial {
         } State;
 #pragma pack(pop)
 
+        constexpr uint8_t MaxKeyBatch = Protocol::MaxPayloadSize / sizeof(KeyBatchEvent);
+        constexpr uint8_t MaxSequenceSteps = Protocol::MaxPayloadSize / sizeof(SequenceStep);
+        constexpr uint8_t MaxTransferChunk = Protocol::MaxPayloadSize - sizeof(TransferChunk);
+        constexpr uint8_t MaxBaudrates = (Protocol::MaxPayloadSize - sizeof(Hello) - sizeof(uint8_t)) / sizeof(uint32_t);
     } // namespace Payload
 } // namespace SimpleSerial
 } // namespace Thunder
@@ -19,6 +19,11 @@
 
 #include "Module.h"
 
+// Lets the callers skip the formatting of what nobody listens to.
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED(CATEGORY) Thunder::Messaging::LocalLifetimeType<CATEGORY, &Thunder::Core::System::MODULE_NAME, Thunder::Core::Messaging::Metadata::type::TRACING>::IsEnabled()
+#endif
+
 namespace Thunder {
 namespace Doofah {
     class DataExchangeFlow {
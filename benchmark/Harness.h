@@ -0,0 +1,474 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2022 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "../Module.h"
+
+#include "../Link.h"
+#include "../SimpleSerial.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pty.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace Thunder {
+namespace Benchmark {
+
+    // CPU time spent so far, in microseconds.
+    struct Usage {
+        static uint64_t Process()
+        {
+            return (Spent(RUSAGE_SELF));
+        }
+        static uint64_t Thread()
+        {
+            return (Spent(RUSAGE_THREAD));
+        }
+
+    private:
+        static uint64_t Spent(const int who)
+        {
+            struct rusage usage;
+
+            ::getrusage(who, &usage);
+
+            return ((static_cast<uint64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000) + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+        }
+    };
+
+    // The plugin side of a link, as the DataExchange drives it: KEY requests go out from
+    // SendData() once the driver queued them, the answers are cut from what ReceiveData() gets.
+    class Link : public SimpleSerial::LinkType<SimpleSerial::ReactorPort> {
+    public:
+        Link(const Link&) = delete;
+        Link& operator=(const Link&) = delete;
+
+        Link()
+            : SimpleSerial::LinkType<SimpleSerial::ReactorPort>()
+            , _queued(0)
+            , _answered(0)
+            , _request()
+            , _response()
+        {
+            SimpleSerial::Payload::KeyEvent event;
+            event.pressed = SimpleSerial::Payload::Action::PRESSED;
+            event.code = 0x1E;
+
+            _request.Clear();
+            _request.Operation(SimpleSerial::Protocol::OperationType::KEY);
+            _request.Sequence(0);
+            _request.Address(1);
+            _request.Payload(sizeof(event), reinterpret_cast<const uint8_t*>(&event));
+            _request.Finalize();
+            _response.Clear();
+        }
+        ~Link() override = default;
+
+    public:
+        void Queue(const uint32_t count)
+        {
+            _queued += count;
+            Trigger();
+        }
+        uint32_t Answered() const
+        {
+            return (_answered);
+        }
+
+    protected:
+        void StateChange() override
+        {
+        }
+        uint16_t SendData(uint8_t* dataFrame, const uint16_t maxSendSize) override
+        {
+            uint16_t result(0);
+
+            while ((_queued > 0) && ((maxSendSize - result) > _request.Size())) {
+                _request.Sequence(_request.Sequence() + 1);
+                _request.Finalize();
+
+                result += _request.Serialize(maxSendSize - result, &dataFrame[result]);
+                _queued--;
+            }
+
+            return (result);
+        }
+        uint16_t ReceiveData(uint8_t* dataFrame, const uint16_t receivedSize) override
+        {
+            SimpleSerial::Protocol::Message* frame(&_response);
+
+            SimpleSerial::Protocol::Parse(frame, receivedSize, dataFrame, [this](SimpleSerial::Protocol::Message* message) {
+                if (message->IsValid() == true) {
+                    _answered++;
+                }
+            });
+
+            return (receivedSize);
+        }
+
+    private:
+        std::atomic<uint32_t> _queued;
+        std::atomic<uint32_t> _answered;
+        // Only touched on the reactor thread.
+        SimpleSerial::Protocol::Message _request;
+        SimpleSerial::Protocol::Message _response;
+    };
+
+    enum class Transport : uint8_t {
+        PTY, // ReactorPort on a pseudo terminal
+        TCP, // ReactorStream to a socket on the loopback interface
+        UNIX // ReactorStream to a unix domain socket
+    };
+
+    inline const char* Name(const Transport transport)
+    {
+        return ((transport == Transport::PTY) ? "pty" : (transport == Transport::TCP) ? "tcp" : "unix");
+    }
+
+    // A pseudo terminal in raw mode, a link opens the slave by name and the other side is the master.
+    inline bool Terminal(int& master, string& name)
+    {
+        char path[64];
+        int slave;
+
+        bool result = (::openpty(&master, &slave, path, nullptr, nullptr) == 0);
+
+        if (result == true) {
+            struct termios options;
+
+            ::tcgetattr(master, &options);
+            ::cfmakeraw(&options);
+            ::tcsetattr(master, TCSANOW, &options);
+
+            ::fcntl(master, F_SETFL, ::fcntl(master, F_GETFL) | O_NONBLOCK);
+            ::close(slave);
+
+            name = path;
+        }
+
+        return (result);
+    }
+
+    // The links and, at the same index, the descriptor the driver answers them on.
+    class Links {
+    public:
+        Links(const Links&) = delete;
+        Links& operator=(const Links&) = delete;
+
+        Links()
+            : _links()
+            , _peers()
+            , _listener(-1)
+            , _path()
+        {
+        }
+        ~Links()
+        {
+            Close();
+        }
+
+    public:
+        std::vector<std::unique_ptr<Link>>& Handlers()
+        {
+            return (_links);
+        }
+        const std::vector<int>& Peers() const
+        {
+            return (_peers);
+        }
+
+        bool Open(const Transport transport, const uint32_t count)
+        {
+            string address;
+            bool result = ((transport == Transport::PTY) || (Listen(transport, address) == true));
+
+            while ((result == true) && (_links.size() < count)) {
+                int peer(-1);
+
+                if (transport == Transport::PTY) {
+                    result = Terminal(peer, address);
+                }
+
+                if (result == true) {
+                    _links.emplace_back(new Link());
+
+                    result = (_links.back()->Configuration(address, Core::SerialPort::Convert(115200), Core::SerialPort::NONE, Core::SerialPort::BITS_8, Core::SerialPort::BITS_1, Core::SerialPort::OFF) == Core::ERROR_NONE)
+                        && (_links.back()->Open(1000) == Core::ERROR_NONE);
+                }
+
+                if ((result == true) && (transport != Transport::PTY)) {
+                    // Connected already, the listener has room for every link in its backlog.
+                    peer = ::accept4(_listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    result = (peer != -1);
+
+                    if ((result == true) && (transport == Transport::TCP)) {
+                        // As the link does on its side, every answer is waited for.
+                        const int enabled = 1;
+                        ::setsockopt(peer, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+                    }
+                }
+
+                if (peer != -1) {
+                    _peers.push_back(peer);
+                }
+                if (result == false) {
+                    fprintf(stderr, "Could not open %s link %u at %s\n", Name(transport), static_cast<uint32_t>(_links.size()), address.c_str());
+                }
+            }
+
+            return (result);
+        }
+        void Close()
+        {
+            for (std::unique_ptr<Link>& link : _links) {
+                link->Close(0);
+            }
+            for (const int peer : _peers) {
+                ::close(peer);
+            }
+            if (_listener != -1) {
+                ::close(_listener);
+            }
+            if (_path.empty() == false) {
+                ::unlink(_path.c_str());
+            }
+
+            _links.clear();
+            _peers.clear();
+            _listener = -1;
+            _path.clear();
+        }
+
+    private:
+        bool Listen(const Transport transport, string& address)
+        {
+            struct sockaddr_storage node;
+            socklen_t length;
+
+            ::memset(&node, 0, sizeof(node));
+
+            if (transport == Transport::TCP) {
+                struct sockaddr_in& inet = reinterpret_cast<struct sockaddr_in&>(node);
+
+                inet.sin_family = AF_INET;
+                inet.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                inet.sin_port = 0;
+                length = sizeof(inet);
+            } else {
+                struct sockaddr_un& domain = reinterpret_cast<struct sockaddr_un&>(node);
+
+                _path = "/tmp/doofah-benchmark-" + std::to_string(::getpid()) + ".socket";
+                ::unlink(_path.c_str());
+
+                domain.sun_family = AF_UNIX;
+                ::strncpy(domain.sun_path, _path.c_str(), sizeof(domain.sun_path) - 1);
+                length = sizeof(domain);
+            }
+
+            _listener = ::socket(node.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+            bool result = (_listener != -1)
+                && (::bind(_listener, reinterpret_cast<const struct sockaddr*>(&node), length) == 0)
+                && (::listen(_listener, SOMAXCONN) == 0)
+                && (::getsockname(_listener, reinterpret_cast<struct sockaddr*>(&node), &length) == 0);
+
+            if ((result == true) && (transport == Transport::TCP)) {
+                address = "tcp://127.0.0.1:" + std::to_string(ntohs(reinterpret_cast<const struct sockaddr_in&>(node).sin_port));
+            } else if (result == true) {
+                address = "unix://" + _path;
+            }
+
+            return (result);
+        }
+
+    private:
+        std::vector<std::unique_ptr<Link>> _links;
+        std::vector<int> _peers;
+        int _listener;
+        string _path;
+    };
+
+    struct Result {
+        uint32_t offered; // Key events queued, per second
+        uint32_t answered; // Key events answered, per second
+        uint64_t cpu; // Microseconds of CPU per second, of everything but the driver
+    };
+
+    // Plays the endpoints on the other side of all links from one thread: queues KEY requests
+    // round robin over the links at the given rate and answers every request it receives. Its
+    // own CPU time is taken out, what is left is the reactor threads parsing and sending.
+    class Driver {
+    public:
+        Driver(const Driver&) = delete;
+        Driver& operator=(const Driver&) = delete;
+
+        Driver(Links& links)
+            : _links(links.Handlers())
+            , _peers(links.Peers())
+            , _frames(_peers.size())
+            , _epoll(::epoll_create1(EPOLL_CLOEXEC))
+        {
+            for (uint32_t index = 0; index < _peers.size(); index++) {
+                struct epoll_event event;
+                event.events = EPOLLIN;
+                event.data.u32 = index;
+
+                ::epoll_ctl(_epoll, EPOLL_CTL_ADD, _peers[index], &event);
+
+                _frames[index].Clear();
+            }
+        }
+        ~Driver()
+        {
+            ::close(_epoll);
+        }
+
+    public:
+        // Runs on the calling thread, the first second warms up and is not measured.
+        Result Run(const uint32_t rate, const uint32_t seconds)
+        {
+            typedef std::chrono::steady_clock Clock;
+
+            const Clock::time_point start(Clock::now());
+            const Clock::time_point measured(start + std::chrono::seconds(1));
+            const Clock::time_point end(measured + std::chrono::seconds(seconds));
+            uint64_t issued(0);
+            uint64_t issuedBefore(0);
+            uint64_t answeredBefore(0);
+            uint64_t processBefore(0);
+            uint64_t threadBefore(0);
+            uint32_t next(0);
+            bool measuring(false);
+            Clock::time_point now;
+            Result result;
+
+            while ((now = Clock::now()) < end) {
+                if ((measuring == false) && (now >= measured)) {
+                    measuring = true;
+                    issuedBefore = issued;
+                    answeredBefore = Answered();
+                    processBefore = Usage::Process();
+                    threadBefore = Usage::Thread();
+                }
+
+                const uint64_t due((static_cast<uint64_t>(rate) * std::chrono::duration_cast<std::chrono::microseconds>(now - start).count()) / 1000000);
+
+                for (; issued < due; issued++) {
+                    _links[next]->Queue(1);
+                    next = (next + 1) % _links.size();
+                }
+
+                Answer(1);
+            }
+
+            const uint64_t thread(Usage::Thread() - threadBefore);
+            const uint64_t process(Usage::Process() - processBefore);
+
+            result.offered = static_cast<uint32_t>((issued - issuedBefore) / seconds);
+            result.answered = static_cast<uint32_t>((Answered() - answeredBefore) / seconds);
+            result.cpu = ((process > thread) ? (process - thread) : 0) / seconds;
+
+            // Let what is still on its way settle before the links close.
+            Answer(100);
+
+            return (result);
+        }
+
+    private:
+        uint64_t Answered() const
+        {
+            uint64_t result(0);
+
+            for (const std::unique_ptr<Link>& link : _links) {
+                result += link->Answered();
+            }
+
+            return (result);
+        }
+        void Answer(const int waitTime)
+        {
+            struct epoll_event events[64];
+
+            const int count = ::epoll_wait(_epoll, events, sizeof(events) / sizeof(events[0]), waitTime);
+
+            for (int index = 0; index < count; index++) {
+                const uint32_t peer(events[index].data.u32);
+                uint8_t received[1024];
+                uint8_t reply[1024];
+                uint16_t length(0);
+                ssize_t size;
+
+                while ((size = ::read(_peers[peer], received, sizeof(received))) > 0) {
+                    SimpleSerial::Protocol::Message* frame(&_frames[peer]);
+
+                    SimpleSerial::Protocol::Parse(frame, static_cast<uint32_t>(size), received, [&reply, &length](SimpleSerial::Protocol::Message* message) {
+                        if ((message->IsValid() == true) && ((length + message->Size() + 1u) <= sizeof(reply))) {
+                            message->Result(SimpleSerial::Protocol::ResultType::OK);
+                            message->PayloadLength(0);
+                            message->Finalize();
+
+                            length += message->Serialize(sizeof(reply) - length, &reply[length]);
+                        }
+                    });
+                }
+
+                if (length > 0) {
+                    VARIABLE_IS_NOT_USED const ssize_t written = ::write(_peers[peer], reply, length);
+                }
+            }
+        }
+
+    private:
+        std::vector<std::unique_ptr<Link>>& _links;
+        const std::vector<int>& _peers;
+        std::vector<SimpleSerial::Protocol::Message> _frames;
+        int _epoll;
+    };
+
+    inline void Header()
+    {
+        printf("%-9s %6s %10s %10s %8s %18s %9s\n", "transport", "links", "offered/s", "answered/s", "cpu %", "cpu % per 1000/s", "us/event");
+    }
+    inline void Report(const char transport[], const uint32_t links, const Result& result)
+    {
+        const double cpu(static_cast<double>(result.cpu) / 10000.0);
+        const double perThousand((result.answered > 0) ? ((cpu * 1000.0) / result.answered) : 0.0);
+        const double perEvent((result.answered > 0) ? (static_cast<double>(result.cpu) / result.answered) : 0.0);
+
+        printf("%-9s %6u %10u %10u %8.2f %18.3f %9.2f\n", transport, links, result.offered, result.answered, cpu, perThousand, perEvent);
+    }
+
+} // namespace Benchmark
+} // namespace Thunder
@@ -0,0 +1,57 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2022 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Harness.h"
+
+#include <cstdlib>
+
+MODULE_NAME_DECLARATION(BUILD_REFERENCE)
+
+using namespace Thunder;
+
+// CPU time the reactor threads spend on 8, 64 and 256 links over pseudo terminals, with the
+// same aggregate load of KEY requests spread over them, each answered by the other side.
+//
+//   DoofahReactorBenchmark [key events/s, default 10000] [seconds, default 5]
+//
+// The last columns are what matters when sizing: the share of one core per 1000 key events/s,
+// and the CPU time per answered key event. With the load fixed they should stay flat as the
+// number of links grows, a reactor waits on all of its links in one epoll.
+int main(int argc, char* argv[])
+{
+    const uint32_t rate((argc > 1) ? static_cast<uint32_t>(::atoi(argv[1])) : 10000);
+    const uint32_t seconds((argc > 2) ? static_cast<uint32_t>(::atoi(argv[2])) : 5);
+    const uint32_t counts[] = { 8, 64, 256 };
+
+    printf("%d key events/s over %d reactor threads, %d seconds a run\n", rate, SimpleSerial::Reactor::Shards, seconds);
+
+    Benchmark::Header();
+
+    for (const uint32_t count : counts) {
+        Benchmark::Links links;
+
+        if (links.Open(Benchmark::Transport::PTY, count) == true) {
+            Benchmark::Driver driver(links);
+
+            Benchmark::Report(Benchmark::Name(Benchmark::Transport::PTY), count, driver.Run(rate, seconds));
+        }
+    }
+
+    return (0);
+}
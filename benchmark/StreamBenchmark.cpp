@@ -0,0 +1,59 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2022 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Harness.h"
+
+#include <cstdlib>
+
+MODULE_NAME_DECLARATION(BUILD_REFERENCE)
+
+using namespace Thunder;
+
+// The same load as DoofahReactorBenchmark, over ReactorStream links to sockets on the loopback
+// interface and to unix domain sockets, next to ReactorPort links over pseudo terminals.
+//
+//   DoofahStreamBenchmark [key events/s, default 10000] [seconds, default 5]
+//
+// What a link costs on a socket, e.g. to an endpoint behind ser2net or on WiFi, against a tty.
+// The tty layer is in the pty rows, the TCP stack with TCP_NODELAY in the tcp rows.
+int main(int argc, char* argv[])
+{
+    const uint32_t rate((argc > 1) ? static_cast<uint32_t>(::atoi(argv[1])) : 10000);
+    const uint32_t seconds((argc > 2) ? static_cast<uint32_t>(::atoi(argv[2])) : 5);
+    const uint32_t counts[] = { 8, 64, 256 };
+    const Benchmark::Transport transports[] = { Benchmark::Transport::PTY, Benchmark::Transport::TCP, Benchmark::Transport::UNIX };
+
+    printf("%d key events/s over %d reactor threads, %d seconds a run\n", rate, SimpleSerial::Reactor::Shards, seconds);
+
+    Benchmark::Header();
+
+    for (const uint32_t count : counts) {
+        for (const Benchmark::Transport transport : transports) {
+            Benchmark::Links links;
+
+            if (links.Open(transport, count) == true) {
+                Benchmark::Driver driver(links);
+
+                Benchmark::Report(Benchmark::Name(transport), count, driver.Run(rate, seconds));
+            }
+        }
+    }
+
+    return (0);
+}
@@ -0,0 +1,209 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2022 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Harness.h"
+
+#include "../DataExchange.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <poll.h>
+#include <thread>
+
+MODULE_NAME_DECLARATION(BUILD_REFERENCE)
+
+using namespace Thunder;
+
+// 1, 2, 4, 8, 16 and 32 threads posting KEY_NOACK frames to one DataExchange as fast as they
+// can, over a pty the other side of which only reads.
+//
+//   DoofahSubmitBenchmark [seconds, default 5]
+//
+// Every Post() goes through Submit() into the ring, the reactor thread takes the frames out in
+// SendData(). The frames/s are those that made it to the other side, the latencies those of a
+// Post() as the producer sees it, from a sample of every 16th. Once the producers outrun the
+// line the ring is full, and the tail is the wait for room in it.
+
+namespace {
+
+    typedef SimpleSerial::DataExchange<SimpleSerial::LinkType<SimpleSerial::ReactorPort>> Exchange;
+    typedef std::chrono::steady_clock Clock;
+
+    constexpr uint32_t Producers[] = { 1, 2, 4, 8, 16, 32 };
+    constexpr uint32_t SampleRate = 16;
+
+    struct Producer {
+        uint64_t posted;
+        uint64_t failed;
+        uint64_t longest; // Nanoseconds
+        std::vector<uint32_t> samples; // Nanoseconds
+    };
+
+    void Produce(Exchange& exchange, const std::atomic<bool>& running, Producer& producer)
+    {
+        SimpleSerial::Protocol::Message message;
+        SimpleSerial::Payload::KeyEvent event;
+
+        event.pressed = SimpleSerial::Payload::Action::PRESSED;
+        event.code = 0x1E;
+
+        message.Clear();
+        message.Operation(SimpleSerial::Protocol::OperationType::KEY_NOACK);
+        message.Address(1);
+        message.Payload(sizeof(event), reinterpret_cast<const uint8_t*>(&event));
+
+        while (running == true) {
+            const Clock::time_point start(Clock::now());
+            const uint32_t result(exchange.Post(message, 1000));
+            const uint64_t spent(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+
+            if (result == Core::ERROR_NONE) {
+                producer.posted++;
+            } else {
+                producer.failed++;
+            }
+            if (((producer.posted + producer.failed) % SampleRate) == 0) {
+                producer.samples.push_back(static_cast<uint32_t>(std::min(spent, static_cast<uint64_t>(~0u))));
+            }
+
+            producer.longest = std::max(producer.longest, spent);
+        }
+    }
+
+    // The other side of the line, counts the bytes that came in.
+    void Consume(const int master, const std::atomic<bool>& running, uint64_t& received)
+    {
+        struct pollfd descriptor;
+        uint8_t buffer[4096];
+
+        descriptor.fd = master;
+        descriptor.events = POLLIN;
+
+        while (running == true) {
+            if (::poll(&descriptor, 1, 100) > 0) {
+                ssize_t size;
+
+                while ((size = ::read(master, buffer, sizeof(buffer))) > 0) {
+                    received += size;
+                }
+            }
+        }
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    const uint32_t seconds((argc > 1) ? static_cast<uint32_t>(::atoi(argv[1])) : 5);
+    uint16_t frameSize;
+
+    {
+        // What one frame takes on the line, the sequence id does not change the size.
+        SimpleSerial::Protocol::Message message;
+        SimpleSerial::Payload::KeyEvent event;
+        uint8_t buffer[SimpleSerial::Protocol::MaxDataSize * 2];
+
+        ::memset(&event, 0, sizeof(event));
+
+        message.Clear();
+        message.Operation(SimpleSerial::Protocol::OperationType::KEY_NOACK);
+        message.Address(1);
+        message.Payload(sizeof(event), reinterpret_cast<const uint8_t*>(&event));
+        message.Finalize();
+
+        frameSize = message.Serialize(sizeof(buffer), buffer);
+    }
+
+    printf("KEY_NOACK frames of %d bytes over a pty, %d seconds a run\n", frameSize, seconds);
+    printf("%9s %10s %12s %10s %10s %10s %8s\n", "producers", "frames/s", "per producer", "median ns", "p99 ns", "max us", "failed");
+
+    for (const uint32_t count : Producers) {
+        Exchange exchange;
+        string name;
+        int master(-1);
+
+        if ((Benchmark::Terminal(master, name) == false)
+            || (exchange.Link().Configuration(name, Core::SerialPort::Convert(115200), Core::SerialPort::NONE, Core::SerialPort::BITS_8, Core::SerialPort::BITS_1, Core::SerialPort::OFF) != Core::ERROR_NONE)
+            || (exchange.Open(1000) != Core::ERROR_NONE)) {
+            fprintf(stderr, "Could not open a link at %s\n", name.c_str());
+        } else {
+            std::vector<Producer> producers(count);
+            std::vector<std::thread> threads;
+            std::atomic<bool> consuming(true);
+            std::atomic<bool> producing(true);
+            uint64_t received(0);
+
+            std::thread consumer(Consume, master, std::cref(consuming), std::ref(received));
+
+            for (Producer& producer : producers) {
+                producer.posted = 0;
+                producer.failed = 0;
+                producer.longest = 0;
+                producer.samples.reserve(1 << 16);
+            }
+            for (Producer& producer : producers) {
+                threads.emplace_back(Produce, std::ref(exchange), std::cref(producing), std::ref(producer));
+            }
+
+            std::this_thread::sleep_for(std::chrono::seconds(seconds));
+
+            producing = false;
+
+            for (std::thread& thread : threads) {
+                thread.join();
+            }
+
+            // Let the ring drain before the line is counted.
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+            consuming = false;
+            consumer.join();
+
+            exchange.Close(1000);
+            ::close(master);
+
+            std::vector<uint32_t> samples;
+            uint64_t failed(0);
+            uint64_t longest(0);
+
+            for (const Producer& producer : producers) {
+                samples.insert(samples.end(), producer.samples.begin(), producer.samples.end());
+                failed += producer.failed;
+                longest = std::max(longest, producer.longest);
+            }
+
+            uint32_t median(0);
+            uint32_t tail(0);
+
+            if (samples.empty() == false) {
+                std::nth_element(samples.begin(), samples.begin() + (samples.size() / 2), samples.end());
+                median = samples[samples.size() / 2];
+                std::nth_element(samples.begin(), samples.begin() + ((samples.size() * 99) / 100), samples.end());
+                tail = samples[(samples.size() * 99) / 100];
+            }
+
+            const uint64_t frames(received / frameSize);
+
+            printf("%9u %10u %12u %10u %10u %10u %8u\n", count, static_cast<uint32_t>(frames / seconds), static_cast<uint32_t>(frames / seconds / count),
+                median, tail, static_cast<uint32_t>(longest / 1000), static_cast<uint32_t>(failed));
+        }
+    }
+
+    return (0);
+}